@@ -1,24 +1,333 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define MIN_INPUT   4096U
+#define BLOCK_SIZE  16U
+#define NUM_THREADS 8
+#define MIN_CHUNK   (1U << 16)
+
+#define BIDIRECTIONAL_FLAG  "--bidirectional"
+
+#define NO_DIGIT    -1
+
+struct Input {
+    char *data;
+    size_t length;
+    int mapped;
+};
+
+struct Calibration {
+    int first;
+    int last;
+    size_t total;
+};
+
+/* Sums the calibration values of a line aligned chunk of the input */
+struct ChunkWorker {
+    const char *data;
+    size_t length;
+    int bidirectional;
+    size_t total;
+    pthread_t thread;
+    int started;
+};
+
+/*
+ * Maps stdin when it is a regular file so large documents are never copied,
+ * otherwise (e.g. a pipe) reads it into a growing buffer.
+ */
+int Input_open(struct Input *input)
+{
+    struct stat info;
+    size_t capacity, got;
+    char *tmp;
+
+    input->data = NULL;
+    input->length = 0;
+    input->mapped = 0;
+
+    if (
+        fstat(STDIN_FILENO, &info) == 0
+        && S_ISREG(info.st_mode)
+        && info.st_size > 0
+    ) {
+        tmp = mmap(
+            NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE,
+            STDIN_FILENO, 0
+        );
+        if (tmp != MAP_FAILED) {
+            posix_madvise(
+                tmp, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL
+            );
+            input->data = tmp;
+            input->length = (size_t)info.st_size;
+            input->mapped = 1;
+            return 1;
+        }
+        /* Not fatal, fall back to reading it */
+    }
+
+    capacity = MIN_INPUT;
+    if ((input->data = malloc(capacity)) == NULL) {
+        perror("malloc");
+        puts("Failed to allocate input buffer");
+        return 0;
+    }
+    while ((got = fread(
+        input->data + input->length, 1, capacity - input->length, stdin
+    )) > 0) {
+        input->length += got;
+        if (input->length < capacity)
+            continue;
+        if ((tmp = realloc(input->data, capacity * 2)) == NULL) {
+            perror("realloc");
+            puts("Failed to grow input buffer");
+            free(input->data);
+            input->data = NULL;
+            return 0;
+        }
+        input->data = tmp;
+        capacity *= 2;
+    }
+    if (ferror(stdin)) {
+        perror("fread");
+        puts("Failed to read input");
+        free(input->data);
+        input->data = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+void Input_free(struct Input *input)
+{
+    if (input->mapped)
+        munmap(input->data, input->length);
+    else
+        free(input->data);
+}
+
+/* Bit i of digits/newlines is set when data[i] is a digit/newline */
+void block_masks_scalar(
+    const char *data,
+    size_t length,
+    unsigned int *digits,
+    unsigned int *newlines
+)
+{
+    size_t i;
+
+    *digits = *newlines = 0;
+    for (i = 0; i < length; ++i) {
+        if (data[i] >= '0' && data[i] <= '9')
+            *digits |= 1U << i;
+        else if (data[i] == '\n')
+            *newlines |= 1U << i;
+    }
+}
+
+#ifdef __SSE2__
+void block_masks(
+    const char *data,
+    unsigned int *digits,
+    unsigned int *newlines
+)
+{
+    __m128i bytes, shifted;
+
+    bytes = _mm_loadu_si128((const __m128i *)data);
+    /* Moves '0'..'9' to the bottom of the signed range for one compare */
+    shifted = _mm_add_epi8(bytes, _mm_set1_epi8((char)(0x80 - '0')));
+    *digits = (unsigned int)_mm_movemask_epi8(
+        _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(0x80 + 10)))
+    );
+    *newlines = (unsigned int)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))
+    );
+}
+#else
+void block_masks(
+    const char *data,
+    unsigned int *digits,
+    unsigned int *newlines
+)
+{
+    block_masks_scalar(data, BLOCK_SIZE, digits, newlines);
+}
+#endif
+
+void Calibration_digits(
+    struct Calibration *calibration,
+    const char *block,
+    unsigned int digits
+)
+{
+    if (!digits)
+        return;
+    if (calibration->first == NO_DIGIT)
+        calibration->first = block[__builtin_ctz(digits)] - '0';
+    calibration->last = block[31 - __builtin_clz(digits)] - '0';
+}
+
+void Calibration_end_line(struct Calibration *calibration)
+{
+    if (calibration->first != NO_DIGIT)
+        calibration->total += (size_t)(
+            calibration->first * 10 + calibration->last
+        );
+    calibration->first = calibration->last = NO_DIGIT;
+}
+
+void Calibration_block(
+    struct Calibration *calibration,
+    const char *block,
+    unsigned int digits,
+    unsigned int newlines
+)
+{
+    unsigned int line_end;
+
+    while (newlines) {
+        line_end = newlines & -newlines;
+        Calibration_digits(calibration, block, digits & (line_end - 1));
+        Calibration_end_line(calibration);
+        digits &= ~(line_end | (line_end - 1));
+        newlines &= newlines - 1;
+    }
+    Calibration_digits(calibration, block, digits);
+}
 
-int main()
-{
-    size_t result;
-    int c;
-    char first_digit, last_digit;
-
-    result = 0;
-    first_digit = last_digit = '\0';
-    while ((c = getchar()) != EOF) {
-        if (c >= '0' && c <= '9') {
-            if (!first_digit)
-                first_digit = (char)c;
-            last_digit = (char)c;
-        } else if (c == '\n') {
-            result = result + (size_t)(first_digit - '0') * 10 + (size_t)(last_digit - '0');
-            first_digit = last_digit = '\0';
+size_t calibrate(const char *data, size_t length)
+{
+    struct Calibration calibration;
+    unsigned int digits, newlines;
+    size_t offset;
+
+    calibration.first = calibration.last = NO_DIGIT;
+    calibration.total = 0;
+
+    for (offset = 0; offset + BLOCK_SIZE <= length; offset += BLOCK_SIZE) {
+        block_masks(data + offset, &digits, &newlines);
+        Calibration_block(&calibration, data + offset, digits, newlines);
+    }
+    block_masks_scalar(data + offset, length - offset, &digits, &newlines);
+    Calibration_block(&calibration, data + offset, digits, newlines);
+
+    /* Last line might not end with a newline */
+    Calibration_end_line(&calibration);
+    return calibration.total;
+}
+
+int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/*
+ * Finds the end of each line and then only looks from both ends inwards,
+ * stopping at the first digit either way. The middle of long lines is never
+ * touched when their digits sit near the ends.
+ */
+size_t calibrate_bidirectional(const char *data, size_t length)
+{
+    const char *line, *line_end, *end, *first, *last;
+    size_t total;
+
+    total = 0;
+    end = data + length;
+    for (line = data; line < end; line = line_end + (line_end < end)) {
+        line_end = memchr(line, '\n', (size_t)(end - line));
+        if (line_end == NULL)
+            line_end = end;
+        for (first = line; first < line_end && !is_digit(*first); ++first);
+        if (first == line_end)
+            continue;
+        for (last = line_end - 1; !is_digit(*last); --last);
+        total += (size_t)((*first - '0') * 10 + (*last - '0'));
+    }
+    return total;
+}
+
+void *ChunkWorker_run(void *arg)
+{
+    struct ChunkWorker *worker;
+    worker = arg;
+    worker->total = worker->bidirectional
+        ? calibrate_bidirectional(worker->data, worker->length)
+        : calibrate(worker->data, worker->length);
+    return NULL;
+}
+
+/*
+ * Splits the input into up to NUM_THREADS chunks that end on a newline so
+ * that no line is shared between workers, and sums them in parallel.
+ */
+size_t calibrate_parallel(const char *data, size_t length, int bidirectional)
+{
+    struct ChunkWorker workers[NUM_THREADS];
+    size_t i, num_workers, start, end, total;
+    const char *newline;
+
+    num_workers = length / MIN_CHUNK;
+    if (num_workers > NUM_THREADS)
+        num_workers = NUM_THREADS;
+    if (num_workers == 0)
+        num_workers = 1;
+
+    for (i = start = 0; i < num_workers; ++i, start = end) {
+        end = length / num_workers * (i + 1);
+        if (i == num_workers - 1 || end <= start) {
+            end = i == num_workers - 1 ? length : start;
+        } else {
+            newline = memchr(data + end, '\n', length - end);
+            end = newline == NULL ? length : (size_t)(newline - data) + 1;
         }
+        workers[i] = (struct ChunkWorker) {
+            .data = data + start,
+            .length = end - start,
+            .bidirectional = bidirectional,
+            .total = 0,
+            .started = 0
+        };
+        workers[i].started = pthread_create(
+            &(workers[i].thread), NULL, ChunkWorker_run, workers + i
+        ) == 0;
+        /* Not fatal, just lose the parallelism for this one */
+        if (!workers[i].started)
+            ChunkWorker_run(workers + i);
+    }
+    total = 0;
+    for (i = 0; i < num_workers; ++i) {
+        if (workers[i].started)
+            pthread_join(workers[i].thread, NULL);
+        total += workers[i].total;
     }
+    return total;
+}
+
+int main(int argc, char **argv)
+{
+    struct Input input;
+    int bidirectional;
+
+    if (!Input_open(&input))
+        return 1;
 
-    printf("result = %zu\n", result);
+    bidirectional = argc > 1 && strcmp(argv[1], BIDIRECTIONAL_FLAG) == 0;
+    printf(
+        "result = %zu\n",
+        calibrate_parallel(input.data, input.length, bidirectional)
+    );
+    Input_free(&input);
     return 0;
 }
@@ -1,136 +1,401 @@
-#include <stdio.h>
+#define _POSIX_C_SOURCE 200112L
 
-#define MAX_LINE 200
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#define ONE "one"
-#define ONE_LENGTH 3
-#define ONE_CHAR '1'
+#define MIN_INPUT   4096U
+#define NUM_THREADS 8
+#define MIN_CHUNK   (1U << 16)
 
-#define TWO "two"
-#define TWO_LENGTH 3
-#define TWO_CHAR '2'
+#define BIDIRECTIONAL_FLAG  "--bidirectional"
 
-#define THREE "three"
-#define THREE_LENGTH 5
-#define THREE_CHAR '3'
+/* Automaton states */
+#define ROOT                0U
+#define NEWLINE_STATE       1U
+#define DIGIT_STATE         2U
+#define FIRST_WORD_STATE    (DIGIT_STATE + 10U)
+#define MAX_STATES          64U
 
-#define FOUR "four"
-#define FOUR_LENGTH 4
-#define FOUR_CHAR '4'
+/* Automaton outputs, digit d is reported as d + 1 */
+#define NO_OUTPUT       0U
+#define NEWLINE_OUTPUT  11U
 
-#define FIVE "five"
-#define FIVE_LENGTH 4
-#define FIVE_CHAR '5'
+#define NO_DIGIT    -1
 
-#define SIX "six"
-#define SIX_LENGTH 3
-#define SIX_CHAR '6'
+static const char *const DIGIT_WORDS[] = {
+    "one", "two", "three", "four", "five", "six", "seven", "eight", "nine"
+};
+#define NUM_DIGIT_WORDS (sizeof(DIGIT_WORDS) / sizeof(*DIGIT_WORDS))
 
-#define SEVEN "seven"
-#define SEVEN_LENGTH 5
-#define SEVEN_CHAR '7'
+struct Input {
+    char *data;
+    size_t length;
+    int mapped;
+};
 
-#define EIGHT "eight"
-#define EIGHT_LENGTH 5
-#define EIGHT_CHAR '8'
+/*
+ * Aho-Corasick automaton over the spelled digits, flattened into a DFA over
+ * whole bytes so that scanning costs a single table lookup per byte. Digits
+ * and newlines get dedicated states of their own so they are reported the
+ * same way as a completed word.
+ */
+struct Automaton {
+    unsigned char next[MAX_STATES][256];
+    unsigned char output[MAX_STATES];
+    size_t num_states;
+};
 
-#define NINE "nine"
-#define NINE_LENGTH 4
-#define NINE_CHAR '9'
+struct Calibration {
+    int first;
+    int last;
+    size_t total;
+};
 
+/* Sums the calibration values of a line aligned chunk of the input */
+struct ChunkWorker {
+    const struct Automaton *forward;
+    const struct Automaton *backward;
+    const char *data;
+    size_t length;
+    int bidirectional;
+    size_t total;
+    pthread_t thread;
+    int started;
+};
 
-size_t get_line(char line[], size_t max_line)
+/*
+ * Maps stdin when it is a regular file so large documents are never copied,
+ * otherwise (e.g. a pipe) reads it into a growing buffer.
+ */
+int Input_open(struct Input *input)
 {
-    int c;
-    size_t i;
+    struct stat info;
+    size_t capacity, got;
+    char *tmp;
 
-    for (
-        i = 0;
-        (c = getchar()) != EOF && c != '\n' && i < max_line - 1;
-        ++i
+    input->data = NULL;
+    input->length = 0;
+    input->mapped = 0;
+
+    if (
+        fstat(STDIN_FILENO, &info) == 0
+        && S_ISREG(info.st_mode)
+        && info.st_size > 0
     ) {
-        line[i] = (char)c;
+        tmp = mmap(
+            NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE,
+            STDIN_FILENO, 0
+        );
+        if (tmp != MAP_FAILED) {
+            posix_madvise(
+                tmp, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL
+            );
+            input->data = tmp;
+            input->length = (size_t)info.st_size;
+            input->mapped = 1;
+            return 1;
+        }
+        /* Not fatal, fall back to reading it */
+    }
+
+    capacity = MIN_INPUT;
+    if ((input->data = malloc(capacity)) == NULL) {
+        perror("malloc");
+        puts("Failed to allocate input buffer");
+        return 0;
+    }
+    while ((got = fread(
+        input->data + input->length, 1, capacity - input->length, stdin
+    )) > 0) {
+        input->length += got;
+        if (input->length < capacity)
+            continue;
+        if ((tmp = realloc(input->data, capacity * 2)) == NULL) {
+            perror("realloc");
+            puts("Failed to grow input buffer");
+            free(input->data);
+            input->data = NULL;
+            return 0;
+        }
+        input->data = tmp;
+        capacity *= 2;
     }
-    line[i] = '\0';
-    return i;
+    if (ferror(stdin)) {
+        perror("fread");
+        puts("Failed to read input");
+        free(input->data);
+        input->data = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+void Input_free(struct Input *input)
+{
+    if (input->mapped)
+        munmap(input->data, input->length);
+    else
+        free(input->data);
 }
 
-int is_substring(
-    char line[],
-    size_t index,
-    size_t line_length,
-    const char *substring,
-    size_t substring_length
+int Automaton_insert(
+    struct Automaton *automaton,
+    unsigned char *parent,
+    const char *word,
+    int reverse,
+    unsigned char output
 )
 {
-    size_t i;
-
-    for (
-        i = 0;
-        i + index < line_length
-        && i < substring_length
-        && line[i + index] == substring[i];
-        ++i
-    );
+    unsigned char state, c;
+    size_t i, length;
 
-    return i == substring_length;
+    length = strlen(word);
+    for (state = ROOT, i = 0; i < length; ++i) {
+        c = (unsigned char)word[reverse ? length - 1 - i : i];
+        if (automaton->next[state][c] == ROOT) {
+            if (automaton->num_states == MAX_STATES) {
+                puts("Too many automaton states");
+                return 0;
+            }
+            parent[automaton->num_states] = state;
+            automaton->next[state][c] = (unsigned char)automaton->num_states++;
+        }
+        state = automaton->next[state][c];
+    }
+    automaton->output[state] = output;
+    return 1;
 }
 
-int main()
+/* A reverse automaton matches the words spelled backwards */
+int Automaton_create(struct Automaton *automaton, int reverse)
 {
-    char line[MAX_LINE];
-    size_t line_length, i, result;
-    char first_digit, last_digit;
-    
-    result = 0;
-    first_digit = last_digit = '\0';
-    while ((line_length = get_line(line, MAX_LINE)) != 0) {
-        for (i = 0; i < line_length; ++i) {
-            if (line[i] >= '0' && line[i] <= '9') {
-                if (!first_digit)
-                    first_digit = line[i];
-                last_digit = line[i];
-            } else if (is_substring(line, i, line_length, ONE, ONE_LENGTH)){
-                if (!first_digit)
-                    first_digit = ONE_CHAR;
-                last_digit = ONE_CHAR;
-            } else if (is_substring(line, i, line_length, TWO, TWO_LENGTH)){
-                if (!first_digit)
-                    first_digit = TWO_CHAR;
-                last_digit = TWO_CHAR;
-            } else if (is_substring(line, i, line_length, THREE, THREE_LENGTH)){
-                if (!first_digit)
-                    first_digit = THREE_CHAR;
-                last_digit = THREE_CHAR;
-            } else if (is_substring(line, i, line_length, FOUR, FOUR_LENGTH)){
-                if (!first_digit)
-                    first_digit = FOUR_CHAR;
-                last_digit = FOUR_CHAR;
-            } else if (is_substring(line, i, line_length, FIVE, FIVE_LENGTH)){
-                if (!first_digit)
-                    first_digit = FIVE_CHAR;
-                last_digit = FIVE_CHAR;
-            } else if (is_substring(line, i, line_length, SIX, SIX_LENGTH)){
-                if (!first_digit)
-                    first_digit = SIX_CHAR;
-                last_digit = SIX_CHAR;
-            } else if (is_substring(line, i, line_length, SEVEN, SEVEN_LENGTH)){
-                if (!first_digit)
-                    first_digit = SEVEN_CHAR;
-                last_digit = SEVEN_CHAR;
-            } else if (is_substring(line, i, line_length, EIGHT, EIGHT_LENGTH)){
-                if (!first_digit)
-                    first_digit = EIGHT_CHAR;
-                last_digit = EIGHT_CHAR;
-            } else if (is_substring(line, i, line_length, NINE, NINE_LENGTH)){
-                if (!first_digit)
-                    first_digit = NINE_CHAR;
-                last_digit = NINE_CHAR;
+    unsigned char parent[MAX_STATES], fail[MAX_STATES], queue[MAX_STATES];
+    size_t i, head, tail, c;
+    unsigned char state, child;
+
+    memset(automaton, 0, sizeof(*automaton));
+    automaton->num_states = FIRST_WORD_STATE;
+    for (i = 0; i < NUM_DIGIT_WORDS; ++i)
+        if (!Automaton_insert(
+            automaton, parent, DIGIT_WORDS[i], reverse,
+            (unsigned char)(i + 2)
+        ))
+            return 0;
+
+    /* Breadth first so every fail target is complete before it is used */
+    head = tail = 0;
+    queue[tail++] = ROOT;
+    fail[ROOT] = ROOT;
+    while (head < tail) {
+        state = queue[head++];
+        for (c = 0; c < 256; ++c) {
+            child = automaton->next[state][c];
+            if (child != ROOT && parent[child] == state) {
+                fail[child] = state == ROOT
+                    ? ROOT
+                    : automaton->next[fail[state]][c];
+                if (automaton->output[child] == NO_OUTPUT)
+                    automaton->output[child] =
+                        automaton->output[fail[child]];
+                queue[tail++] = child;
+            } else {
+                automaton->next[state][c] = automaton->next[fail[state]][c];
             }
         }
-        result = result + (size_t)(first_digit - '0') * 10 + (size_t)(last_digit - '0');
-        first_digit = last_digit = '\0';
     }
-    printf("result = %zu\n", result);
+
+    /* No word contains a digit or newline, so these always restart */
+    for (i = 0; i < automaton->num_states; ++i) {
+        automaton->next[i]['\n'] = NEWLINE_STATE;
+        for (c = 0; c < 10; ++c)
+            automaton->next[i]['0' + c] = (unsigned char)(DIGIT_STATE + c);
+    }
+    automaton->output[NEWLINE_STATE] = NEWLINE_OUTPUT;
+    for (c = 0; c < 10; ++c)
+        automaton->output[DIGIT_STATE + c] = (unsigned char)(c + 1);
+    for (i = NEWLINE_STATE; i < FIRST_WORD_STATE; ++i)
+        memcpy(automaton->next[i], automaton->next[ROOT], 256);
+
+    return 1;
+}
+
+void Calibration_end_line(struct Calibration *calibration)
+{
+    if (calibration->first != NO_DIGIT)
+        calibration->total += (size_t)(
+            calibration->first * 10 + calibration->last
+        );
+    calibration->first = calibration->last = NO_DIGIT;
+}
+
+size_t calibrate(
+    const struct Automaton *automaton,
+    const char *data,
+    size_t length
+)
+{
+    struct Calibration calibration;
+    const unsigned char *byte, *end;
+    unsigned char state, output;
+
+    calibration.first = calibration.last = NO_DIGIT;
+    calibration.total = 0;
+
+    state = ROOT;
+    end = (const unsigned char *)data + length;
+    for (byte = (const unsigned char *)data; byte < end; ++byte) {
+        state = automaton->next[state][*byte];
+        if ((output = automaton->output[state]) == NO_OUTPUT)
+            continue;
+        if (output == NEWLINE_OUTPUT) {
+            Calibration_end_line(&calibration);
+            continue;
+        }
+        if (calibration.first == NO_DIGIT)
+            calibration.first = output - 1;
+        calibration.last = output - 1;
+    }
+
+    /* Last line might not end with a newline */
+    Calibration_end_line(&calibration);
+    return calibration.total;
+}
+
+/*
+ * Finds the end of each line and then runs the forward automaton from its
+ * start and the reverse automaton from its end, stopping at the first match
+ * either way. The middle of long lines is never touched when their digits
+ * sit near the ends.
+ */
+size_t calibrate_bidirectional(
+    const struct Automaton *forward,
+    const struct Automaton *backward,
+    const char *data,
+    size_t length
+)
+{
+    const unsigned char *line, *line_end, *end, *byte;
+    unsigned char state, output;
+    size_t total, first;
+
+    total = 0;
+    line = (const unsigned char *)data;
+    end = line + length;
+    for (; line < end; line = line_end + (line_end < end)) {
+        line_end = memchr(line, '\n', (size_t)(end - line));
+        if (line_end == NULL)
+            line_end = end;
+
+        for (state = ROOT, byte = line; byte < line_end; ++byte) {
+            state = forward->next[state][*byte];
+            if (forward->output[state] != NO_OUTPUT)
+                break;
+        }
+        if (byte == line_end)
+            continue;
+        first = forward->output[state] - 1U;
+
+        /* Cannot run past the match the forward scan already found */
+        state = ROOT;
+        byte = line_end;
+        do
+            state = backward->next[state][*--byte];
+        while ((output = backward->output[state]) == NO_OUTPUT);
+        total += first * 10 + (output - 1U);
+    }
+    return total;
+}
+
+void *ChunkWorker_run(void *arg)
+{
+    struct ChunkWorker *worker;
+    worker = arg;
+    worker->total = worker->bidirectional
+        ? calibrate_bidirectional(
+            worker->forward, worker->backward, worker->data, worker->length
+        )
+        : calibrate(worker->forward, worker->data, worker->length);
+    return NULL;
+}
+
+/*
+ * Splits the input into up to NUM_THREADS chunks that end on a newline so
+ * that no line is shared between workers, and sums them in parallel.
+ */
+size_t calibrate_parallel(
+    const struct Automaton *forward,
+    const struct Automaton *backward,
+    const char *data,
+    size_t length,
+    int bidirectional
+)
+{
+    struct ChunkWorker workers[NUM_THREADS];
+    size_t i, num_workers, start, end, total;
+    const char *newline;
+
+    num_workers = length / MIN_CHUNK;
+    if (num_workers > NUM_THREADS)
+        num_workers = NUM_THREADS;
+    if (num_workers == 0)
+        num_workers = 1;
+
+    for (i = start = 0; i < num_workers; ++i, start = end) {
+        end = length / num_workers * (i + 1);
+        if (i == num_workers - 1 || end <= start) {
+            end = i == num_workers - 1 ? length : start;
+        } else {
+            newline = memchr(data + end, '\n', length - end);
+            end = newline == NULL ? length : (size_t)(newline - data) + 1;
+        }
+        workers[i] = (struct ChunkWorker) {
+            .forward = forward,
+            .backward = backward,
+            .data = data + start,
+            .length = end - start,
+            .bidirectional = bidirectional,
+            .total = 0,
+            .started = 0
+        };
+        workers[i].started = pthread_create(
+            &(workers[i].thread), NULL, ChunkWorker_run, workers + i
+        ) == 0;
+        /* Not fatal, just lose the parallelism for this one */
+        if (!workers[i].started)
+            ChunkWorker_run(workers + i);
+    }
+    total = 0;
+    for (i = 0; i < num_workers; ++i) {
+        if (workers[i].started)
+            pthread_join(workers[i].thread, NULL);
+        total += workers[i].total;
+    }
+    return total;
+}
+
+int main(int argc, char **argv)
+{
+    static struct Automaton forward, backward;
+    struct Input input;
+    int bidirectional;
+
+    if (!Automaton_create(&forward, 0) || !Automaton_create(&backward, 1))
+        return 1;
+    if (!Input_open(&input))
+        return 1;
+
+    bidirectional = argc > 1 && strcmp(argv[1], BIDIRECTIONAL_FLAG) == 0;
+    printf(
+        "result = %zu\n",
+        calibrate_parallel(
+            &forward, &backward, input.data, input.length, bidirectional
+        )
+    );
+    Input_free(&input);
     return 0;
 }
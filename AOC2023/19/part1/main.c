@@ -1,7 +1,10 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "interval.h"
+
 #define MIN_CHARBUFFER  32
 #define MIN_PARTBUFFER  8
 #define MIN_WORKFLOW    8
@@ -17,6 +20,19 @@
 
 #define START_WORKFLOW "in"
 
+#define WORKFLOW_ACCEPTED   ((size_t) -1)
+#define WORKFLOW_REJECTED   ((size_t) -2)
+
+#define NUM_ATTRIBUTES  4
+#define ATTRIBUTES      "xmas"
+#define MIN_BOXARRAY    64
+#define MIN_BOXSTACK    32
+
+#define KD_LEAF_SIZE    8
+#define KD_MAX_DEPTH    48
+#define KD_LEAF         ((size_t) -1)
+#define KD_FAIL         ((size_t) -2)
+
 static size_t collisions = 0;
 
 struct WorkflowRule {
@@ -38,11 +54,9 @@ struct WorkflowCache {
     size_t capacity;
 };
 
+/* Indexed by position in ATTRIBUTES */
 struct Part {
-    size_t x;
-    size_t m;
-    size_t a;
-    size_t s;
+    size_t values[NUM_ATTRIBUTES];
 };
 
 struct PartBuffer {
@@ -57,6 +71,68 @@ struct CharBuffer {
     size_t capacity;
 };
 
+/*
+ * A rule passes when values[attribute] < value, or > value when greater is
+ * set. Default rules have attribute NUM_ATTRIBUTES and always pass.
+ */
+struct CompiledRule {
+    size_t attribute;
+    size_t value;
+    int greater;
+    size_t next;
+};
+
+struct DecisionTree {
+    struct CompiledRule *rules;
+    size_t *first_rule;
+    size_t num_workflows;
+    size_t start;
+};
+
+/* Indexed like struct Part */
+struct Box {
+    struct Interval ranges[NUM_ATTRIBUTES];
+};
+
+struct BoxArray {
+    struct Box *boxes;
+    size_t length;
+    size_t capacity;
+};
+
+struct BoxFrame {
+    struct Box box;
+    size_t wf;
+    size_t depth;
+};
+
+struct BoxStack {
+    struct BoxFrame *frames;
+    size_t length;
+    size_t capacity;
+};
+
+/* Leaves have axis == KD_LEAF and own leaf_boxes[first..first+count) */
+struct KdNode {
+    size_t axis;
+    size_t split;
+    size_t left;
+    size_t right;
+    size_t first;
+    size_t count;
+};
+
+struct KdTree {
+    struct KdNode *nodes;
+    size_t length;
+    size_t capacity;
+    size_t *leaf_boxes;
+    size_t leaf_length;
+    size_t leaf_capacity;
+    size_t *scratch;
+    struct Box *boxes;
+};
+
 struct CharBuffer *CharBuffer_create(size_t start_capacity)
 {
     if (start_capacity < MIN_CHARBUFFER) start_capacity = MIN_CHARBUFFER;
@@ -216,7 +292,7 @@ int Part_from_string(struct Part *part, const char* str)
 {
     return sscanf(
         str, "{x=%zu,m=%zu,a=%zu,s=%zu}",
-        &(part->x), &(part->m), &(part->a), &(part->s)
+        part->values, part->values + 1, part->values + 2, part->values + 3
     );
 }
 
@@ -516,7 +592,7 @@ int WorkflowCache_store(
     return 0;
 }
 
-struct Workflow *WorkflowCache_retrieve(
+size_t WorkflowCache_find_slot(
     struct WorkflowCache *p_cache, char *identifier
 )
 {
@@ -524,15 +600,25 @@ struct Workflow *WorkflowCache_retrieve(
     hash = hash_identifier(identifier, p_cache->capacity);
     for (i = hash; i < p_cache->capacity; ++i)
         if (!p_cache->cache[i])
-            return NULL;
+            return p_cache->capacity;
         else if (strcmp(p_cache->cache[i]->identifier, identifier) == 0)
-            return p_cache->cache[i];
+            return i;
     for (i = 0; i < hash; ++i)
         if (!p_cache->cache[i])
-            return NULL;
+            return p_cache->capacity;
         else if (strcmp(p_cache->cache[i]->identifier, identifier) == 0)
-            return p_cache->cache[i];
-    return NULL;
+            return i;
+    return p_cache->capacity;
+}
+
+struct Workflow *WorkflowCache_retrieve(
+    struct WorkflowCache *p_cache, char *identifier
+)
+{
+    size_t slot;
+    slot = WorkflowCache_find_slot(p_cache, identifier);
+    if (slot == p_cache->capacity) return NULL;
+    return p_cache->cache[slot];
 }
 
 void WorkflowCache_free(struct WorkflowCache *p_cache)
@@ -552,88 +638,505 @@ size_t get_line(struct CharBuffer *cb)
     return cb->length;
 }
 
-int test_rule(struct WorkflowRule *rule, struct Part *part)
+int CompiledRule_from_rule(
+    struct CompiledRule *compiled, struct WorkflowRule *rule
+)
 {
+    char *attribute;
+    compiled->attribute = NUM_ATTRIBUTES;
+    compiled->value = 0;
+    compiled->greater = 0;
     if (WorkflowRule_is_default(rule)) return 1;
-    size_t test_value;
-    switch (rule->variable) {
-    case 'x':
-        test_value = part->x;
-        break;
-    case 'm':
-        test_value = part->m;
-        break;
-    case 'a':
-        test_value = part->a;
-        break;
-    case 's':
-        test_value = part->s;
-        break;
-    default:
-        puts("Invalid rule");
-        return -1;
-    }
-    switch (rule->operator) {
-    case LESS_THAN:
-        return test_value < rule->value;
-    case GREATER_THAN:
-        return test_value > rule->value;
-    default:
+    attribute = strchr(ATTRIBUTES, rule->variable);
+    if (
+        !rule->variable || !attribute
+        || (rule->operator != LESS_THAN && rule->operator != GREATER_THAN)
+    ) {
         puts("Invalid rule");
-        return -1;
+        return 0;
     }
-    puts("Invalid rule");
-    return -1;
+    compiled->attribute = attribute - ATTRIBUTES;
+    compiled->value = rule->value;
+    compiled->greater = rule->operator == GREATER_THAN;
+    return 1;
+}
+
+size_t resolve_dest(
+    struct WorkflowCache *p_cache, size_t *ids, char *dest
+)
+{
+    size_t slot;
+    if (strcmp(dest, ACCEPTED) == 0) return WORKFLOW_ACCEPTED;
+    if (strcmp(dest, REJECTED) == 0) return WORKFLOW_REJECTED;
+    slot = WorkflowCache_find_slot(p_cache, dest);
+    if (slot == p_cache->capacity) return p_cache->capacity;
+    return ids[slot];
 }
 
-char *test_workflow(struct Workflow *wf, struct Part *part)
+void DecisionTree_free(struct DecisionTree *tree)
 {
-    size_t i;
-    int passes;
-    for (i = 0; i < wf->length; ++i) {
-        passes = test_rule(wf->rules + i, part);
-        if (passes == -1) return REJECTED;
-        if (passes) return wf->rules[i].dest;
-    }
-    puts("Invalid workflow");
-    return REJECTED;
+    free(tree->rules);
+    tree->rules = NULL;
+    free(tree->first_rule);
+    tree->first_rule = NULL;
+    free(tree);
 }
 
-int test_part(struct WorkflowCache *p_cache, struct Part *part)
+/*
+ * Flattens every workflow into one rule array, indexed by a dense
+ * workflow id, so evaluation never touches the identifier strings.
+ * Every workflow gets a trailing reject rule in case its last rule
+ * is not a default one.
+ */
+struct DecisionTree *DecisionTree_create(struct WorkflowCache *p_cache)
 {
-    char *next;
+    struct DecisionTree *tree;
     struct Workflow *wf;
-    next = START_WORKFLOW;
-    while (strcmp(next, ACCEPTED) != 0 && strcmp(next, REJECTED) != 0) {
-        wf = WorkflowCache_retrieve(p_cache, next);
-        if (!wf) {
-            puts("Missing workflow");
+    struct CompiledRule *compiled;
+    size_t *ids, slot, num_rules, rule, id, next;
+    ids = malloc(p_cache->capacity * sizeof(*ids));
+    if (!ids) {
+        perror("malloc");
+        puts("Failed to allocate workflow ids");
+        return NULL;
+    }
+    tree = malloc(sizeof(*tree));
+    if (!tree) {
+        perror("malloc");
+        puts("Failed to allocate DecisionTree");
+        free(ids);
+        return NULL;
+    }
+    tree->num_workflows = num_rules = 0;
+    for (slot = 0; slot < p_cache->capacity; ++slot) {
+        if (!p_cache->cache[slot]) continue;
+        ids[slot] = tree->num_workflows++;
+        num_rules += p_cache->cache[slot]->length + 1;
+    }
+    tree->rules = malloc(num_rules * sizeof(*(tree->rules)));
+    tree->first_rule = malloc(
+        (tree->num_workflows + 1) * sizeof(*(tree->first_rule))
+    );
+    if (!tree->rules || !tree->first_rule) {
+        perror("malloc");
+        puts("Failed to allocate DecisionTree rules");
+        goto fail;
+    }
+    compiled = tree->rules;
+    for (slot = 0; slot < p_cache->capacity; ++slot) {
+        wf = p_cache->cache[slot];
+        if (!wf) continue;
+        tree->first_rule[ids[slot]] = compiled - tree->rules;
+        for (rule = 0; rule < wf->length; ++rule, ++compiled) {
+            if (!CompiledRule_from_rule(compiled, wf->rules + rule))
+                goto fail;
+            next = resolve_dest(p_cache, ids, wf->rules[rule].dest);
+            if (next == p_cache->capacity) {
+                puts("Missing workflow");
+                goto fail;
+            }
+            compiled->next = next;
+        }
+        *(compiled++) = (struct CompiledRule) {
+            .attribute = NUM_ATTRIBUTES,
+            .value = 0,
+            .greater = 0,
+            .next = WORKFLOW_REJECTED
+        };
+    }
+    id = resolve_dest(p_cache, ids, START_WORKFLOW);
+    if (id == p_cache->capacity) {
+        puts("Missing start workflow");
+        goto fail;
+    }
+    tree->start = id;
+    free(ids);
+    return tree;
+fail:
+    free(ids);
+    DecisionTree_free(tree);
+    return NULL;
+}
+
+struct BoxArray *BoxArray_create(size_t start_capacity)
+{
+    struct BoxArray *ba;
+    if (start_capacity < MIN_BOXARRAY) start_capacity = MIN_BOXARRAY;
+    ba = malloc(sizeof(*ba));
+    if (!ba) {
+        perror("malloc");
+        puts("Failed to allocate BoxArray");
+        return NULL;
+    }
+    ba->boxes = malloc(start_capacity * sizeof(*(ba->boxes)));
+    if (!ba->boxes) {
+        perror("malloc");
+        puts("Failed to allocate BoxArray->boxes");
+        free(ba);
+        return NULL;
+    }
+    ba->length = 0;
+    ba->capacity = start_capacity;
+    return ba;
+}
+
+int BoxArray_push(struct BoxArray *ba, struct Box box)
+{
+    size_t new_capacity;
+    struct Box *temp;
+    if (ba->length + 1 >= ba->capacity) {
+        new_capacity = ba->capacity << 1;
+        temp = realloc(ba->boxes, new_capacity * sizeof(*(ba->boxes)));
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow BoxArray");
             return 0;
         }
-        next = test_workflow(wf, part);
+        ba->boxes = temp;
+        ba->capacity = new_capacity;
     }
-    if (strcmp(next, ACCEPTED) == 0) return 1;
-    if (strcmp(next, REJECTED) == 0) return 0;
-    puts("Failed to test part");
-    return -1;
+    ba->boxes[ba->length++] = box;
+    return 1;
 }
 
-size_t count_parts(struct WorkflowCache *p_cache, struct PartBuffer *pb)
+void BoxArray_free(struct BoxArray *ba)
 {
-    size_t total, part;
-    int success;
+    free(ba->boxes);
+    ba->boxes = NULL;
+    free(ba);
+}
+
+int Box_contains(struct Box *box, struct Part *part)
+{
+    size_t attribute, value;
+    for (attribute = 0; attribute < NUM_ATTRIBUTES; ++attribute) {
+        value = part->values[attribute];
+        if (
+            value < box->ranges[attribute].lo
+            || value >= box->ranges[attribute].hi
+        ) return 0;
+    }
+    return 1;
+}
+
+struct BoxStack *BoxStack_create(size_t start_capacity)
+{
+    struct BoxStack *bs;
+    if (start_capacity < MIN_BOXSTACK) start_capacity = MIN_BOXSTACK;
+    bs = malloc(sizeof(*bs));
+    if (!bs) {
+        perror("malloc");
+        puts("Failed to allocate BoxStack");
+        return NULL;
+    }
+    bs->frames = malloc(start_capacity * sizeof(*(bs->frames)));
+    if (!bs->frames) {
+        perror("malloc");
+        puts("Failed to allocate BoxStack->frames");
+        free(bs);
+        return NULL;
+    }
+    bs->length = 0;
+    bs->capacity = start_capacity;
+    return bs;
+}
+
+int BoxStack_push(struct BoxStack *bs, struct BoxFrame frame)
+{
+    size_t new_capacity;
+    struct BoxFrame *temp;
+    if (bs->length + 1 >= bs->capacity) {
+        new_capacity = bs->capacity << 1;
+        temp = realloc(bs->frames, new_capacity * sizeof(*(bs->frames)));
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow BoxStack");
+            return 0;
+        }
+        bs->frames = temp;
+        bs->capacity = new_capacity;
+    }
+    bs->frames[bs->length++] = frame;
+    return 1;
+}
+
+void BoxStack_free(struct BoxStack *bs)
+{
+    free(bs->frames);
+    bs->frames = NULL;
+    free(bs);
+}
+
+/*
+ * Splits the whole attribute space through the workflows the same way
+ * part 2 does, keeping the boxes that end up accepted. The boxes are
+ * disjoint since every rule splits its box in two. A box can visit
+ * each workflow at most once unless the workflows loop.
+ */
+int DecisionTree_accepted_boxes(
+    struct DecisionTree *tree, struct BoxArray *accepted
+)
+{
+    struct BoxStack *bs;
+    struct BoxFrame frame;
+    struct Box passed;
+    const struct CompiledRule *rule;
+    size_t attribute;
+    int is_default;
+    bs = BoxStack_create(0);
+    if (!bs) return 0;
+    frame.wf = tree->start;
+    frame.depth = 0;
+    for (attribute = 0; attribute < NUM_ATTRIBUTES; ++attribute)
+        frame.box.ranges[attribute] = (struct Interval) {
+            .lo = 0,
+            .hi = SIZE_MAX
+        };
+    if (!BoxStack_push(bs, frame)) goto fail;
+    while (bs->length) {
+        frame = bs->frames[--(bs->length)];
+        if (frame.depth >= tree->num_workflows) {
+            puts("Workflows loop forever");
+            goto fail;
+        }
+        for (rule = tree->rules + tree->first_rule[frame.wf];; ++rule) {
+            is_default = rule->attribute == NUM_ATTRIBUTES;
+            passed = frame.box;
+            if (!is_default)
+                frame.box.ranges[rule->attribute] = Interval_split(
+                    passed.ranges + rule->attribute,
+                    rule->value,
+                    rule->greater
+                );
+            if (is_default || !Interval_is_empty(
+                passed.ranges[rule->attribute]
+            )) {
+                if (rule->next == WORKFLOW_ACCEPTED) {
+                    if (!BoxArray_push(accepted, passed)) goto fail;
+                } else if (rule->next != WORKFLOW_REJECTED) {
+                    if (!BoxStack_push(bs, (struct BoxFrame) {
+                        .box = passed,
+                        .wf = rule->next,
+                        .depth = frame.depth + 1
+                    })) goto fail;
+                }
+            }
+            if (
+                is_default
+                || Interval_is_empty(frame.box.ranges[rule->attribute])
+            ) break;
+        }
+    }
+    BoxStack_free(bs);
+    return 1;
+fail:
+    BoxStack_free(bs);
+    return 0;
+}
+
+int size_t_compare(const void *a, const void *b)
+{
+    size_t left, right;
+    left = *(const size_t *) a;
+    right = *(const size_t *) b;
+    return (left > right) - (left < right);
+}
+
+void KdTree_free(struct KdTree *kd)
+{
+    free(kd->nodes);
+    kd->nodes = NULL;
+    free(kd->leaf_boxes);
+    kd->leaf_boxes = NULL;
+    free(kd->scratch);
+    kd->scratch = NULL;
+    free(kd);
+}
+
+size_t KdTree_push_node(struct KdTree *kd)
+{
+    size_t new_capacity;
+    struct KdNode *temp;
+    if (kd->length + 1 >= kd->capacity) {
+        new_capacity = kd->capacity << 1;
+        temp = realloc(kd->nodes, new_capacity * sizeof(*(kd->nodes)));
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow KdTree");
+            return KD_FAIL;
+        }
+        kd->nodes = temp;
+        kd->capacity = new_capacity;
+    }
+    return kd->length++;
+}
+
+int KdTree_push_leaf(struct KdTree *kd, size_t node, size_t *indices, size_t n)
+{
+    size_t new_capacity, *temp;
+    while (kd->leaf_length + n >= kd->leaf_capacity) {
+        new_capacity = kd->leaf_capacity << 1;
+        temp = realloc(
+            kd->leaf_boxes, new_capacity * sizeof(*(kd->leaf_boxes))
+        );
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow KdTree leaves");
+            return 0;
+        }
+        kd->leaf_boxes = temp;
+        kd->leaf_capacity = new_capacity;
+    }
+    kd->nodes[node] = (struct KdNode) {
+        .axis = KD_LEAF,
+        .first = kd->leaf_length,
+        .count = n
+    };
+    memcpy(kd->leaf_boxes + kd->leaf_length, indices, n * sizeof(*indices));
+    kd->leaf_length += n;
+    return 1;
+}
+
+/*
+ * Splits at the median box start along the first axis, starting from
+ * depth, that actually separates the boxes. Boxes straddling the split
+ * belong to both sides.
+ */
+int KdTree_choose_split(
+    struct KdTree *kd, size_t *indices, size_t n, size_t depth,
+    size_t *axis, size_t *split
+)
+{
+    size_t try, i, median, left, right;
+    struct Box *box;
+    for (try = 0; try < NUM_ATTRIBUTES; ++try) {
+        *axis = (depth + try) % NUM_ATTRIBUTES;
+        for (i = 0; i < n; ++i)
+            kd->scratch[i] = kd->boxes[indices[i]].ranges[*axis].lo;
+        qsort(kd->scratch, n, sizeof(*(kd->scratch)), size_t_compare);
+        for (median = n >> 1; median < n; ++median)
+            if (kd->scratch[median] > kd->scratch[0]) break;
+        if (median == n) continue;
+        *split = kd->scratch[median];
+        left = right = 0;
+        for (i = 0; i < n; ++i) {
+            box = kd->boxes + indices[i];
+            left += box->ranges[*axis].lo < *split;
+            right += box->ranges[*axis].hi > *split;
+        }
+        if (left < n && right < n) return 1;
+    }
+    return 0;
+}
+
+size_t KdTree_build(
+    struct KdTree *kd, size_t *indices, size_t n, size_t depth
+)
+{
+    size_t node, axis, split, i, left_n, right_n, left, right;
+    size_t *left_indices, *right_indices;
+    struct Box *box;
+    node = KdTree_push_node(kd);
+    if (node == KD_FAIL) return KD_FAIL;
+    if (
+        n <= KD_LEAF_SIZE
+        || depth == KD_MAX_DEPTH
+        || !KdTree_choose_split(kd, indices, n, depth, &axis, &split)
+    ) {
+        if (!KdTree_push_leaf(kd, node, indices, n)) return KD_FAIL;
+        return node;
+    }
+    left_indices = malloc(2 * n * sizeof(*left_indices));
+    if (!left_indices) {
+        perror("malloc");
+        puts("Failed to allocate KdTree indices");
+        return KD_FAIL;
+    }
+    right_indices = left_indices + n;
+    left_n = right_n = 0;
+    for (i = 0; i < n; ++i) {
+        box = kd->boxes + indices[i];
+        if (box->ranges[axis].lo < split)
+            left_indices[left_n++] = indices[i];
+        if (box->ranges[axis].hi > split)
+            right_indices[right_n++] = indices[i];
+    }
+    left = KdTree_build(kd, left_indices, left_n, depth + 1);
+    right = left == KD_FAIL
+        ? KD_FAIL
+        : KdTree_build(kd, right_indices, right_n, depth + 1);
+    free(left_indices);
+    if (right == KD_FAIL) return KD_FAIL;
+    kd->nodes[node] = (struct KdNode) {
+        .axis = axis,
+        .split = split,
+        .left = left,
+        .right = right
+    };
+    return node;
+}
+
+/* The tree only indexes into boxes, it doesn't own it */
+struct KdTree *KdTree_create(struct Box *boxes, size_t num_boxes)
+{
+    struct KdTree *kd;
+    size_t *indices, i;
+    kd = malloc(sizeof(*kd));
+    if (!kd) {
+        perror("malloc");
+        puts("Failed to allocate KdTree");
+        return NULL;
+    }
+    kd->boxes = boxes;
+    kd->length = kd->leaf_length = 0;
+    kd->capacity = kd->leaf_capacity = MIN_BOXARRAY;
+    kd->nodes = malloc(kd->capacity * sizeof(*(kd->nodes)));
+    kd->leaf_boxes = malloc(kd->leaf_capacity * sizeof(*(kd->leaf_boxes)));
+    kd->scratch = malloc((num_boxes + 1) * sizeof(*(kd->scratch)));
+    indices = malloc((num_boxes + 1) * sizeof(*indices));
+    if (!kd->nodes || !kd->leaf_boxes || !kd->scratch || !indices) {
+        perror("malloc");
+        puts("Failed to allocate KdTree arrays");
+        free(indices);
+        KdTree_free(kd);
+        return NULL;
+    }
+    for (i = 0; i < num_boxes; ++i)
+        indices[i] = i;
+    if (KdTree_build(kd, indices, num_boxes, 0) == KD_FAIL) {
+        free(indices);
+        KdTree_free(kd);
+        return NULL;
+    }
+    free(indices);
+    return kd;
+}
+
+int KdTree_contains(struct KdTree *kd, struct Part *part)
+{
+    struct KdNode *node;
+    size_t i;
+    node = kd->nodes;
+    while (node->axis != KD_LEAF)
+        node = kd->nodes + (
+            part->values[node->axis] < node->split
+            ? node->left
+            : node->right
+        );
+    for (i = 0; i < node->count; ++i)
+        if (Box_contains(kd->boxes + kd->leaf_boxes[node->first + i], part))
+            return 1;
+    return 0;
+}
+
+size_t count_parts(struct KdTree *kd, struct PartBuffer *pb)
+{
+    size_t total, part, attribute;
     total = 0;
     for (part = 0; part < pb->length; ++part) {
-        success = test_part(p_cache, pb->parts + part);
-        if (success == -1) return 0;
-        if (success == 1) {
-            total = total + (
-                pb->parts[part].x
-                + pb->parts[part].m
-                + pb->parts[part].a
-                + pb->parts[part].s
-            );
-        }
+        if (!KdTree_contains(kd, pb->parts + part)) continue;
+        for (attribute = 0; attribute < NUM_ATTRIBUTES; ++attribute)
+            total += pb->parts[part].values[attribute];
     }
     return total;
 }
@@ -683,32 +1186,60 @@ int parse_parts(struct PartBuffer *pb)
     return 1;
 }
 
+/* Builds the accepted box index, the workflows aren't needed after */
+struct KdTree *index_workflows(
+    struct WorkflowCache *p_cache, struct BoxArray *accepted
+)
+{
+    struct DecisionTree *tree;
+    struct KdTree *kd;
+    tree = DecisionTree_create(p_cache);
+    if (!tree) return NULL;
+    if (!DecisionTree_accepted_boxes(tree, accepted)) {
+        DecisionTree_free(tree);
+        return NULL;
+    }
+    DecisionTree_free(tree);
+    kd = KdTree_create(accepted->boxes, accepted->length);
+    if (!kd) return NULL;
+    printf(
+        "Accepted boxes = %zu, index nodes = %zu\n",
+        accepted->length, kd->length
+    );
+    return kd;
+}
+
 int parse(void)
 {
     struct PartBuffer *pb;
     struct WorkflowCache *p_cache;
+    struct BoxArray *accepted;
+    struct KdTree *kd;
     size_t total;
+    int success;
+    success = 0;
+    pb = NULL;
+    accepted = NULL;
+    kd = NULL;
     p_cache = WorkflowCache_create(0);
     if (!p_cache) return 0;
-    if (!parse_workflows(p_cache)) {
-        WorkflowCache_free(p_cache);
-        return 0;
-    }
+    if (!parse_workflows(p_cache)) goto cleanup;
+    accepted = BoxArray_create(0);
+    if (!accepted) goto cleanup;
+    kd = index_workflows(p_cache, accepted);
+    if (!kd) goto cleanup;
     pb = PartBuffer_create(0);
-    if (!pb) {
-        WorkflowCache_free(p_cache);
-        return 0;
-    }
-    if (!parse_parts(pb)) {
-        WorkflowCache_free(p_cache);
-        PartBuffer_free(pb);
-        return 0;
-    }
-    total = count_parts(p_cache, pb);
-    WorkflowCache_free(p_cache);
-    PartBuffer_free(pb);
+    if (!pb) goto cleanup;
+    if (!parse_parts(pb)) goto cleanup;
+    total = count_parts(kd, pb);
     printf("Total = %zu\n", total);
-    return 1;
+    success = 1;
+cleanup:
+    if (pb) PartBuffer_free(pb);
+    if (kd) KdTree_free(kd);
+    if (accepted) BoxArray_free(accepted);
+    WorkflowCache_free(p_cache);
+    return success;
 }
 
 int main(void)
@@ -2,8 +2,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "interval.h"
+#include "numtheory.h"
+
 #define MIN_CACHE       2048
-#define MIN_STACK       32
 #define MIN_CHARBUFFER  32
 #define MIN_WORKFLOW    8
 
@@ -18,21 +20,17 @@
 #define RANGE_START 1
 #define RANGE_END   4000
 
+#define NUM_ATTRIBUTES  4
+#define ATTRIBUTES      "xmas"
+
 #define HASH_REPEAT     23
 
 #define START_WORKFLOW "in"
 
-struct Range {
-    size_t start;
-    size_t end;
-};
-
 struct InputRange {
     char *wf_identifier;
-    struct Range x_range;
-    struct Range m_range;
-    struct Range a_range;
-    struct Range s_range;
+    size_t depth;
+    struct Interval attributes[NUM_ATTRIBUTES];
 };
 
 struct InputRangeStack {
@@ -45,6 +43,7 @@ struct WorkflowRule {
     char variable;
     char operator;
     size_t value;
+    size_t attribute;
     char *dest;
 };
 
@@ -69,25 +68,34 @@ struct CharBuffer {
 
 int InputRange_is_valid(struct InputRange *range)
 {
-    return (
-        range->x_range.end > range->x_range.start
-        && range->m_range.end > range->m_range.start
-        && range->a_range.end > range->a_range.start
-        && range->s_range.end > range->s_range.start
-    );
+    size_t attribute;
+    for (attribute = 0; attribute < NUM_ATTRIBUTES; ++attribute)
+        if (Interval_is_empty(range->attributes[attribute]))
+            return 0;
+    return 1;
 }
 
-struct InputRangeStack *InputRangeStack_create(size_t start_capacity)
+uint128_t InputRange_count(struct InputRange *range)
+{
+    uint128_t count;
+    size_t attribute;
+    count = 1;
+    for (attribute = 0; attribute < NUM_ATTRIBUTES; ++attribute)
+        count *= Interval_length(range->attributes[attribute]);
+    return count;
+}
+
+/* The stack never grows, push fails once capacity is reached */
+struct InputRangeStack *InputRangeStack_create(size_t capacity)
 {
     struct InputRangeStack *irs;
-    if (start_capacity < MIN_STACK) start_capacity = MIN_STACK;
     irs = malloc(sizeof(*irs));
     if (!irs) {
         perror("malloc");
         puts("Failed to allocate InputRangeStack");
         return NULL;
     }
-    irs->stack = malloc(start_capacity * sizeof(*(irs->stack)));
+    irs->stack = malloc(capacity * sizeof(*(irs->stack)));
     if (!irs->stack) {
         perror("malloc");
         puts("Failed to allocate InputRangeStack->stack");
@@ -95,49 +103,18 @@ struct InputRangeStack *InputRangeStack_create(size_t start_capacity)
         return NULL;
     }
     irs->length = 0;
-    irs->capacity = start_capacity;
+    irs->capacity = capacity;
     return irs;
 }
 
-int InputRangeStack_grow(struct InputRangeStack *irs)
-{
-    size_t new_capacity;
-    struct InputRange *temp;
-    new_capacity = irs->capacity << 1;
-    temp = realloc(irs->stack, new_capacity * sizeof(*(irs->stack)));
-    if (!temp) {
-        perror("realloc");
-        puts("Failed to grow InputRangeStack");
-        return 0;
-    }
-    irs->stack = temp;
-    irs->capacity = new_capacity;
-    return 1;
-}
-
-int InputRangeStack_shrink(struct InputRangeStack *irs)
-{
-    size_t new_capacity;
-    struct InputRange *temp;
-    new_capacity = irs->capacity >> 1;
-    if (new_capacity < MIN_STACK) new_capacity = MIN_STACK;
-    temp = realloc(irs->stack, new_capacity * sizeof(*(irs->stack)));
-    if (!temp) {
-        perror("realloc");
-        puts("Failed to shrink InputRangeStack");
-        return 0;
-    }
-    irs->stack = temp;
-    irs->capacity = new_capacity;
-    return 1;
-}
-
 int InputRangeStack_push(
     struct InputRangeStack *irs, struct InputRange range
 )
 {
-    if (irs->length + 1 >= irs->capacity)
-        if (!InputRangeStack_grow(irs)) return 0;
+    if (irs->length >= irs->capacity) {
+        puts("InputRangeStack overflow");
+        return 0;
+    }
     irs->stack[irs->length] = range;
     ++(irs->length);
     return 1;
@@ -148,11 +125,6 @@ int InputRangeStack_pop(
 )
 {
     if (!irs->length) return STACK_EMPTY;
-    if (
-        irs->length - 1 <= irs->capacity >> 2
-        && irs->capacity > MIN_STACK
-    )
-        if (!InputRangeStack_shrink(irs)) return 0;
     *range = irs->stack[irs->length - 1];
     --(irs->length);
     return 1;
@@ -287,6 +259,7 @@ int WorkflowRule_from_string(struct WorkflowRule *rule, char *str)
             .variable = '\0',
             .operator = '\0',
             .value = 0,
+            .attribute = 0,
             .dest = dest
         };
         return 1;
@@ -298,6 +271,16 @@ int WorkflowRule_from_string(struct WorkflowRule *rule, char *str)
             &(rule->value)
         );
         if (!success) return 0;
+        temp = strchr(ATTRIBUTES, rule->variable);
+        if (!rule->variable || !temp) {
+            puts("Invalid rule variable");
+            return 0;
+        }
+        rule->attribute = temp - ATTRIBUTES;
+        if (rule->operator != LESS_THAN && rule->operator != GREATER_THAN) {
+            puts("Invalid rule operator");
+            return 0;
+        }
         offset = str_offset_of(str, ':');
         if (offset == -1) return 0;
         temp = str + offset + 1;
@@ -590,124 +573,69 @@ int is_rejected(struct InputRange *range)
     return strcmp(range->wf_identifier, REJECTED) == 0;
 }
 
+/*
+ * Narrows range down to what passes the rule and returns what fails it,
+ * which is empty for a default rule
+ */
 struct InputRange cleave(
     struct InputRange *range, struct WorkflowRule *rule
 )
 {
     struct InputRange rejected_range;
-    size_t *cleaved, *rejected_variable, new, rejected;
-    if (WorkflowRule_is_default(rule))
-        return (struct InputRange) { 0 };
     rejected_range = *range;
-    rejected = rule->value;
-    cleaved = rejected_variable = NULL;
-    new = 0;
-    switch (rule->operator) {
-    case LESS_THAN:
-        switch (rule->variable) {
-        case 'x':
-            cleaved = &(range->x_range.end);
-            rejected_variable = &(rejected_range.x_range.start);
-            new = rejected - 1;
-            break;
-        case 'm':
-            cleaved = &(range->m_range.end);
-            rejected_variable = &(rejected_range.m_range.start);
-            new = rejected - 1;
-            break;
-        case 'a':
-            cleaved = &(range->a_range.end);
-            rejected_variable = &(rejected_range.a_range.start);
-            new = rejected - 1;
-            break;
-        case 's':
-            cleaved = &(range->s_range.end);
-            rejected_variable = &(rejected_range.s_range.start);
-            new = rejected - 1;
-            break;
-        }
-        break;
-    case GREATER_THAN:
-        switch (rule->variable) {
-        case 'x':
-            cleaved = &(range->x_range.start);
-            rejected_variable = &(rejected_range.x_range.end);
-            new = rejected + 1;
-            break;
-        case 'm':
-            cleaved = &(range->m_range.start);
-            rejected_variable = &(rejected_range.m_range.end);
-            new = rejected + 1;
-            break;
-        case 'a':
-            cleaved = &(range->a_range.start);
-            rejected_variable = &(rejected_range.a_range.end);
-            new = rejected + 1;
-            break;
-        case 's':
-            cleaved = &(range->s_range.start);
-            rejected_variable = &(rejected_range.s_range.end);
-            new = rejected + 1;
-            break;
-        }
-        break;
-    default:
-        puts("Got invalid operator");
-        return (struct InputRange) { 0 };
-    }
-    if (!cleaved || !rejected_variable) {
-        puts("Invalid rule");
-        return (struct InputRange) { 0 };
-    }
-    *cleaved = new;
-    *rejected_variable = rejected;
+    if (WorkflowRule_is_default(rule)) {
+        rejected_range.attributes[0].hi = rejected_range.attributes[0].lo;
+        return rejected_range;
+    }
+    rejected_range.attributes[rule->attribute] = Interval_split(
+        range->attributes + rule->attribute,
+        rule->value,
+        rule->operator == GREATER_THAN
+    );
     return rejected_range;
 }
 
+/*
+ * Depth first over the workflows. A range visits each workflow at most
+ * once unless they loop, so every depth up to num_workflows has at most
+ * the max_rules ranges pushed by the one range popped above it.
+ */
 int count_possibilities(
     struct WorkflowCache *p_cache,
     struct InputRangeStack *irs,
-    size_t *total
+    size_t num_workflows,
+    uint128_t *total
 )
 {
     struct InputRange range, rejected;
     struct Workflow *wf;
     size_t rule;
-    int pop_result;
-    pop_result = InputRangeStack_pop(irs, &range);
-    if (pop_result == STACK_EMPTY) return 1;
-    if (!pop_result) {
-        puts("Failed to walk the tree");
-        return 0;
-    }
-    if (is_rejected(&range))
-        return count_possibilities(p_cache, irs, total);
-    if (is_accepted(&range)) {
-        *total = *total + (
-            (range.x_range.end - range.x_range.start + 1)
-            * (range.m_range.end - range.m_range.start + 1)
-            * (range.a_range.end - range.a_range.start + 1)
-            * (range.s_range.end - range.s_range.start + 1)
-        );
-        return count_possibilities(p_cache, irs, total);
-    }
-    wf = WorkflowCache_retrieve(p_cache, range.wf_identifier);
-    if (!wf) {
-        puts("Invalid Workflow");
-        return 0;
-    }
-    for (rule = 0; rule < wf->length; ++rule) {
-        rejected = cleave(&range, wf->rules + rule);
-        range.wf_identifier = wf->rules[rule].dest;
-        if (InputRange_is_valid(&range)) {
-            if (!InputRangeStack_push(irs, range)) {
-                puts("Stack failure");
-                return 0;
-            }
+    while (InputRangeStack_pop(irs, &range) != STACK_EMPTY) {
+        if (is_rejected(&range)) continue;
+        if (is_accepted(&range)) {
+            *total += InputRange_count(&range);
+            continue;
+        }
+        if (range.depth >= num_workflows) {
+            puts("Workflows loop forever");
+            return 0;
+        }
+        wf = WorkflowCache_retrieve(p_cache, range.wf_identifier);
+        if (!wf) {
+            puts("Invalid Workflow");
+            return 0;
+        }
+        ++(range.depth);
+        for (rule = 0; rule < wf->length; ++rule) {
+            rejected = cleave(&range, wf->rules + rule);
+            range.wf_identifier = wf->rules[rule].dest;
+            if (InputRange_is_valid(&range))
+                if (!InputRangeStack_push(irs, range)) return 0;
+            range = rejected;
+            if (!InputRange_is_valid(&range)) break;
         }
-        range = rejected;
     }
-    return count_possibilities(p_cache, irs, total);
+    return 1;
 }
 
 size_t get_line(struct CharBuffer *cb)
@@ -722,7 +650,10 @@ int parse_workflows(struct WorkflowCache *p_cache)
     struct Workflow *wf;
     struct InputRangeStack *irs;
     struct InputRange start_range;
-    size_t total;
+    size_t num_workflows, max_rules, attribute;
+    uint128_t total;
+    char total_str[UINT128_STRING_LEN];
+    num_workflows = max_rules = 0;
     cb = CharBuffer_create(0);
     while (get_line(cb)) {
         wf = Workflow_create(0);
@@ -740,39 +671,30 @@ int parse_workflows(struct WorkflowCache *p_cache)
             CharBuffer_free(cb);
             return 0;
         }
+        ++num_workflows;
+        if (wf->length > max_rules) max_rules = wf->length;
     }
     CharBuffer_free(cb);
-    irs = InputRangeStack_create(0);
+    irs = InputRangeStack_create(max_rules * num_workflows + 1);
     if (!irs) return 0;
-    start_range = (struct InputRange) {
-        .wf_identifier = START_WORKFLOW,
-        .x_range = (struct Range) {
-            .start = RANGE_START,
-            .end = RANGE_END
-        },
-        .m_range = (struct Range) {
-            .start = RANGE_START,
-            .end = RANGE_END
-        },
-        .a_range = (struct Range) {
-            .start = RANGE_START,
-            .end = RANGE_END
-        },
-        .s_range = (struct Range) {
-            .start = RANGE_START,
-            .end = RANGE_END
-        }
-    };
+    start_range.wf_identifier = START_WORKFLOW;
+    start_range.depth = 0;
+    for (attribute = 0; attribute < NUM_ATTRIBUTES; ++attribute)
+        start_range.attributes[attribute] = (struct Interval) {
+            .lo = RANGE_START,
+            .hi = RANGE_END + 1
+        };
     if (!InputRangeStack_push(irs, start_range)) {
         InputRangeStack_free(irs);
         return 0;
     }
     total = 0;
-    if (!count_possibilities(p_cache, irs, &total)) {
+    if (!count_possibilities(p_cache, irs, num_workflows, &total)) {
+        puts("Failed to walk the tree");
         InputRangeStack_free(irs);
         return 0;
     }
-    printf("Total = %zu\n", total);
+    printf("Total = %s\n", uint128_to_string(total, total_str));
     InputRangeStack_free(irs);
     return 1;
 }
@@ -1,142 +1,236 @@
-#include <stdio.h>
-
-#define MAX_LINE 200
-
-#define RED "red"
-#define GREEN "green"
-#define BLUE "blue"
+#define _POSIX_C_SOURCE 200112L
 
-#define MAX_RED 12
-#define MAX_GREEN 13
-#define MAX_BLUE 14
-
-int is_digit(char c)
-{
-    return '0' <= c && c <= '9';
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_RED     12
+#define MAX_GREEN   13
+#define MAX_BLUE    14
+
+#define MIN_INPUT   4096U
+#define NUM_THREADS 8
+#define MIN_CHUNK   (1U << 16)
+
+/* Colour lanes of a game's maxima */
+#define RED         0
+#define GREEN       1
+#define BLUE        2
+#define NUM_COLOURS 3
+
+struct Input {
+    char *data;
+    size_t length;
+    int mapped;
+};
 
-size_t get_number(char **p_line)
+/* Scores a line aligned chunk of the input */
+struct ChunkWorker {
+    const char *data;
+    size_t length;
+    size_t total;
+    pthread_t thread;
+    int started;
+};
+
+/*
+ * Maps stdin when it is a regular file so large documents are never copied,
+ * otherwise (e.g. a pipe) reads it into a growing buffer.
+ */
+int Input_open(struct Input *input)
 {
-    size_t number, multiplier;
-    char *base, *end;
-
-    for (base = *p_line; is_digit(**p_line); ++(*p_line));
-    end = *p_line;
-    --(*p_line);
-
-    multiplier = 1;
-    number = 0;
-    while (*p_line != base) {
-        number = number + multiplier * (size_t)(**p_line - '0');
-        multiplier = multiplier * 10;
-        --(*p_line);
+    struct stat info;
+    size_t capacity, got;
+    char *tmp;
+
+    input->data = NULL;
+    input->length = 0;
+    input->mapped = 0;
+
+    if (
+        fstat(STDIN_FILENO, &info) == 0
+        && S_ISREG(info.st_mode)
+        && info.st_size > 0
+    ) {
+        tmp = mmap(
+            NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE,
+            STDIN_FILENO, 0
+        );
+        if (tmp != MAP_FAILED) {
+            posix_madvise(
+                tmp, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL
+            );
+            input->data = tmp;
+            input->length = (size_t)info.st_size;
+            input->mapped = 1;
+            return 1;
+        }
+        /* Not fatal, fall back to reading it */
     }
-    number = number + multiplier * (size_t)(**p_line - '0');
-    *p_line = end;
-    return number;
-}
 
-int is_substring(char **p_line, const char* substring)
-{
-    char *base;
-    base = *p_line;
-    while (**p_line && *substring && **p_line == *substring) {
-        ++(*p_line);
-        ++substring;
+    capacity = MIN_INPUT;
+    if ((input->data = malloc(capacity)) == NULL) {
+        perror("malloc");
+        puts("Failed to allocate input buffer");
+        return 0;
     }
-    if (!*substring) return 1;
-    *p_line = base;
-    return 0;
-}
-
-int first_game_pred(char c)
-{
-    return c == ':';
+    while ((got = fread(
+        input->data + input->length, 1, capacity - input->length, stdin
+    )) > 0) {
+        input->length += got;
+        if (input->length < capacity)
+            continue;
+        if ((tmp = realloc(input->data, capacity * 2)) == NULL) {
+            perror("realloc");
+            puts("Failed to grow input buffer");
+            free(input->data);
+            input->data = NULL;
+            return 0;
+        }
+        input->data = tmp;
+        capacity *= 2;
+    }
+    if (ferror(stdin)) {
+        perror("fread");
+        puts("Failed to read input");
+        free(input->data);
+        input->data = NULL;
+        return 0;
+    }
+    return 1;
 }
 
-int next_game_pred(char c)
+void Input_free(struct Input *input)
 {
-    return c == ';';
+    if (input->mapped)
+        munmap(input->data, input->length);
+    else
+        free(input->data);
 }
 
-int seek_predicate(char **p_line, int (*pred)(char))
+size_t score_possible(size_t game_id, const size_t max[NUM_COLOURS])
 {
-    while (**p_line && !pred(**p_line)) ++(*p_line);
-    return !!**p_line;
+    return max[RED] <= MAX_RED && max[GREEN] <= MAX_GREEN
+        && max[BLUE] <= MAX_BLUE
+        ? game_id
+        : 0;
 }
 
-int seek_first_game(char **p_line)
+/*
+ * Single pass over a line aligned span of games, straight from the input.
+ * Counts accumulate digit by digit until a colour is recognised by its first
+ * letter; every other byte is skipped. The only other r, g or b in a game is
+ * the r in "green", which then finds a count of zero and changes nothing.
+ */
+size_t sum_possible(const char *data, size_t length)
 {
-    if (seek_predicate(p_line, first_game_pred))
-        ++(*p_line);
-    return !!**p_line;
+    size_t max[NUM_COLOURS], number, game_id, total;
+    const char *end;
+    int colour;
+
+    total = number = game_id = 0;
+    max[RED] = max[GREEN] = max[BLUE] = 0;
+    for (end = data + length; data < end; ++data) {
+        switch (*data) {
+        case 'r':
+            colour = RED;
+            break;
+        case 'g':
+            colour = GREEN;
+            break;
+        case 'b':
+            colour = BLUE;
+            break;
+        case ':':
+            game_id = number;
+            number = 0;
+            continue;
+        case '\n':
+            total += score_possible(game_id, max);
+            number = game_id = 0;
+            max[RED] = max[GREEN] = max[BLUE] = 0;
+            continue;
+        default:
+            if (*data >= '0' && *data <= '9')
+                number = number * 10 + (size_t)(*data - '0');
+            continue;
+        }
+        if (number > max[colour])
+            max[colour] = number;
+        number = 0;
+    }
+    /* Last game might not end with a newline */
+    if (length > 0 && end[-1] != '\n')
+        total += score_possible(game_id, max);
+    return total;
 }
 
-int seek_next_game(char **p_line)
+void *ChunkWorker_run(void *arg)
 {
-    if (seek_predicate(p_line, next_game_pred))
-        ++(*p_line);
-    return !!**p_line;
+    struct ChunkWorker *worker;
+    worker = arg;
+    worker->total = sum_possible(worker->data, worker->length);
+    return NULL;
 }
 
-int parse_game(char **p_line)
+/*
+ * Splits the input into up to NUM_THREADS chunks that end on a newline so
+ * that no game is shared between workers, and sums them in parallel.
+ */
+size_t sum_possible_parallel(const char *data, size_t length)
 {
-    size_t number;
-    number = 0;
-    while (**p_line && **p_line != ';') {
-        if (is_digit(**p_line)) {
-            number = get_number(p_line);
-            ++(*p_line);
-        } else if (is_substring(p_line, RED)) {
-            if (number > MAX_RED) return 0;
-            number = 0;
-        } else if (is_substring(p_line, GREEN)) {
-            if (number > MAX_GREEN) return 0;
-            number = 0;
-        } else if (is_substring(p_line, BLUE)) {
-            if (number > MAX_BLUE) return 0;
-            number = 0;
+    struct ChunkWorker workers[NUM_THREADS];
+    size_t i, num_workers, start, end, total;
+    const char *newline;
+
+    num_workers = length / MIN_CHUNK;
+    if (num_workers > NUM_THREADS)
+        num_workers = NUM_THREADS;
+    if (num_workers == 0)
+        num_workers = 1;
+
+    for (i = start = 0; i < num_workers; ++i, start = end) {
+        end = length / num_workers * (i + 1);
+        if (i == num_workers - 1 || end <= start) {
+            end = i == num_workers - 1 ? length : start;
         } else {
-            ++(*p_line);
+            newline = memchr(data + end, '\n', length - end);
+            end = newline == NULL ? length : (size_t)(newline - data) + 1;
         }
+        workers[i] = (struct ChunkWorker) {
+            .data = data + start,
+            .length = end - start,
+            .total = 0,
+            .started = 0
+        };
+        workers[i].started = pthread_create(
+            &(workers[i].thread), NULL, ChunkWorker_run, workers + i
+        ) == 0;
+        /* Not fatal, just lose the parallelism for this one */
+        if (!workers[i].started)
+            ChunkWorker_run(workers + i);
     }
-    return 1;
-}
-
-size_t get_line(char line[], size_t max_line)
-{
-    int c;
-    size_t length;
-    for (
-        length = 0;
-        (c = getchar()) != EOF && c != '\n' && length < max_line - 1;
-        ++length
-    )
-        line[length] = c;
-    line[length] = '\0';
-    return length;
+    total = 0;
+    for (i = 0; i < num_workers; ++i) {
+        if (workers[i].started)
+            pthread_join(workers[i].thread, NULL);
+        total += workers[i].total;
+    }
+    return total;
 }
 
 int main(void)
 {
-    char line[MAX_LINE], *lineptr;
-    size_t game_id, total;
-    int possible;
-
-    game_id = total = 0;
-    while (get_line(line, MAX_LINE)) {
-        lineptr = line;
-        possible = 1;
-        ++game_id;
-        if (!seek_first_game(&lineptr)) continue;
-        while (possible && *lineptr) {
-            possible = parse_game(&lineptr);
-            if (possible)
-                seek_next_game(&lineptr);
-        }
-        if (possible)
-            total = total + game_id;
-    }
-    printf("total = %zu\n", total);
+    struct Input input;
+
+    if (!Input_open(&input))
+        return 1;
+
+    printf("total = %zu\n", sum_possible_parallel(input.data, input.length));
+    Input_free(&input);
     return 0;
 }
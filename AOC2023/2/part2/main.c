@@ -1,154 +1,224 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MIN_INPUT   4096U
+#define NUM_THREADS 8
+#define MIN_CHUNK   (1U << 16)
 
-#define MAX_LINE 200
+/* Colour lanes of a game's maxima */
+#define RED         0
+#define GREEN       1
+#define BLUE        2
+#define NUM_COLOURS 3
 
-#define RED "red"
-#define GREEN "green"
-#define BLUE "blue"
+struct Input {
+    char *data;
+    size_t length;
+    int mapped;
+};
 
-struct MinRGB {
-    size_t min_red;
-    size_t min_green;
-    size_t min_blue;
+/* Scores a line aligned chunk of the input */
+struct ChunkWorker {
+    const char *data;
+    size_t length;
+    size_t total;
+    pthread_t thread;
+    int started;
 };
 
-size_t get_first_game_index(char line[])
+/*
+ * Maps stdin when it is a regular file so large documents are never copied,
+ * otherwise (e.g. a pipe) reads it into a growing buffer.
+ */
+int Input_open(struct Input *input)
 {
-    size_t i;
+    struct stat info;
+    size_t capacity, got;
+    char *tmp;
 
-    for (i = 0; line[i] && line[i] != ':'; ++i);
+    input->data = NULL;
+    input->length = 0;
+    input->mapped = 0;
 
-    if (!line[i]) {
-        printf("ERROR: Could not get first game index");
-        return i;
+    if (
+        fstat(STDIN_FILENO, &info) == 0
+        && S_ISREG(info.st_mode)
+        && info.st_size > 0
+    ) {
+        tmp = mmap(
+            NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE,
+            STDIN_FILENO, 0
+        );
+        if (tmp != MAP_FAILED) {
+            posix_madvise(
+                tmp, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL
+            );
+            input->data = tmp;
+            input->length = (size_t)info.st_size;
+            input->mapped = 1;
+            return 1;
+        }
+        /* Not fatal, fall back to reading it */
     }
-    return ++i;
-}
 
-size_t get_next_game_index(char line[], size_t last_game)
-{
-    size_t i;
-
-    for (i = last_game; line[i] && line[i] != ';'; ++i);
-    if (line[i])
-        ++i;
-    return i;
-}
-
-size_t get_number(char line[], size_t start)
-{
-    size_t i, number, multiplier;
-    for (
-        i = start;
-        line[i] && line[i] >= '0' && line[i] <= '9';
-        ++i
-    );
-
-    multiplier = 1;
-    number = 0;
-    for (--i; i >= start; --i) {
-        number = number + multiplier * (line[i] - (size_t)'0');
-        multiplier = multiplier * 10;
+    capacity = MIN_INPUT;
+    if ((input->data = malloc(capacity)) == NULL) {
+        perror("malloc");
+        puts("Failed to allocate input buffer");
+        return 0;
+    }
+    while ((got = fread(
+        input->data + input->length, 1, capacity - input->length, stdin
+    )) > 0) {
+        input->length += got;
+        if (input->length < capacity)
+            continue;
+        if ((tmp = realloc(input->data, capacity * 2)) == NULL) {
+            perror("realloc");
+            puts("Failed to grow input buffer");
+            free(input->data);
+            input->data = NULL;
+            return 0;
+        }
+        input->data = tmp;
+        capacity *= 2;
+    }
+    if (ferror(stdin)) {
+        perror("fread");
+        puts("Failed to read input");
+        free(input->data);
+        input->data = NULL;
+        return 0;
     }
-    return number;
+    return 1;
 }
 
-int is_substring(char line[], size_t start, const char* substring)
+void Input_free(struct Input *input)
 {
-    size_t i;
-    for (
-        i = 0;
-        line[start + i] && substring[i] && substring[i] == line[start + i];
-        ++i
-    );
-    return !substring[i];
+    if (input->mapped)
+        munmap(input->data, input->length);
+    else
+        free(input->data);
 }
 
-void parse_game(char line[], size_t start, struct MinRGB *min_rgb)
+/*
+ * Single pass over a line aligned span of games, straight from the input.
+ * Counts accumulate digit by digit until a colour is recognised by its first
+ * letter; every other byte is skipped. The only other r, g or b in a game is
+ * the r in "green", which then finds a count of zero and changes nothing.
+ */
+size_t sum_powers(const char *data, size_t length)
 {
-    char c;
-    size_t number, i, red, green, blue;
-    number = red = green = blue = 0;
-    for (c = line[start]; (c = line[start]) && c != ';'; ++start) {
-        if (c >= '0' && c <= '9') {
-            number = get_number(line, start);
-            while (line[start] >= '0' && line[start] <= '9')
-                ++start;
-            if (!line[start] || line[start] == ';')
-                break;
-        } else if (is_substring(line, start, RED)) {
-            red = number;
-            number = 0;
-            for (i = 0; RED[i]; ++i)
-                ++start;
-            if (!line[start] || line[start] == ';')
-                break;
-        } else if (is_substring(line, start, GREEN)) {
-            green = number;
-            number = 0;
-            for (i = 0; GREEN[i]; ++i)
-                ++start;
-            if (!line[start] || line[start] == ';')
-                break;
-        } else if (is_substring(line, start, BLUE)) {
-            blue = number;
+    size_t max[NUM_COLOURS], number, game_id, total;
+    const char *end;
+    int colour;
+
+    total = number = game_id = 0;
+    max[RED] = max[GREEN] = max[BLUE] = 0;
+    for (end = data + length; data < end; ++data) {
+        switch (*data) {
+        case 'r':
+            colour = RED;
+            break;
+        case 'g':
+            colour = GREEN;
+            break;
+        case 'b':
+            colour = BLUE;
+            break;
+        case ':':
+            game_id = number;
             number = 0;
-            for (i = 0; BLUE[i]; ++i)
-                ++start;
-            if (!line[start] || line[start] == ';')
-                break;
+            continue;
+        case '\n':
+            total += max[RED] * max[GREEN] * max[BLUE];
+            number = game_id = 0;
+            max[RED] = max[GREEN] = max[BLUE] = 0;
+            continue;
+        default:
+            if (*data >= '0' && *data <= '9')
+                number = number * 10 + (size_t)(*data - '0');
+            continue;
         }
+        if (number > max[colour])
+            max[colour] = number;
+        number = 0;
     }
-    if (red > min_rgb->min_red)
-        min_rgb->min_red = red;
-    if (green > min_rgb->min_green)
-        min_rgb->min_green = green;
-    if (blue > min_rgb->min_blue)
-        min_rgb->min_blue = blue;
+    /* Last game might not end with a newline */
+    if (length > 0 && end[-1] != '\n')
+        total += max[RED] * max[GREEN] * max[BLUE];
+    return total;
 }
 
-size_t get_line(char line[], size_t max_line)
+void *ChunkWorker_run(void *arg)
 {
-    int c;
-    size_t length;
-    for (
-        length = 0;
-        (c = getchar()) != EOF && c != '\n' && length < max_line - 1;
-        ++length
-    ) line[length] = c;
-    line[length] = '\0';
-    return length;
+    struct ChunkWorker *worker;
+    worker = arg;
+    worker->total = sum_powers(worker->data, worker->length);
+    return NULL;
 }
 
-int main(void)
+/*
+ * Splits the input into up to NUM_THREADS chunks that end on a newline so
+ * that no game is shared between workers, and sums them in parallel.
+ */
+size_t sum_powers_parallel(const char *data, size_t length)
 {
-    char line[MAX_LINE];
-    struct MinRGB min_rgb;
-    size_t line_length, game_id, total, current, power;
-
-    game_id = total = power = 0;
-    while ((line_length = get_line(line, MAX_LINE)) != 0) {
-        ++game_id;
-        min_rgb.min_red = 0;
-        min_rgb.min_green = 0;
-        min_rgb.min_blue = 0;
-        current = get_first_game_index(line);
-        while (current != line_length) {
-            parse_game(line, current, &min_rgb);
-            current = get_next_game_index(line, current);
+    struct ChunkWorker workers[NUM_THREADS];
+    size_t i, num_workers, start, end, total;
+    const char *newline;
+
+    num_workers = length / MIN_CHUNK;
+    if (num_workers > NUM_THREADS)
+        num_workers = NUM_THREADS;
+    if (num_workers == 0)
+        num_workers = 1;
+
+    for (i = start = 0; i < num_workers; ++i, start = end) {
+        end = length / num_workers * (i + 1);
+        if (i == num_workers - 1 || end <= start) {
+            end = i == num_workers - 1 ? length : start;
+        } else {
+            newline = memchr(data + end, '\n', length - end);
+            end = newline == NULL ? length : (size_t)(newline - data) + 1;
         }
-        power = min_rgb.min_red * min_rgb.min_green * min_rgb.min_blue;
-        puts(line);
-        printf(
-            "%zu -> R: %zu, G: %zu, B: %zu -> %zu\n",
-            game_id,
-            min_rgb.min_red,
-            min_rgb.min_green,
-            min_rgb.min_blue,
-            power
-        );
-        total = total + power;
+        workers[i] = (struct ChunkWorker) {
+            .data = data + start,
+            .length = end - start,
+            .total = 0,
+            .started = 0
+        };
+        workers[i].started = pthread_create(
+            &(workers[i].thread), NULL, ChunkWorker_run, workers + i
+        ) == 0;
+        /* Not fatal, just lose the parallelism for this one */
+        if (!workers[i].started)
+            ChunkWorker_run(workers + i);
     }
-    printf("total = %zu\n", total);
+    total = 0;
+    for (i = 0; i < num_workers; ++i) {
+        if (workers[i].started)
+            pthread_join(workers[i].thread, NULL);
+        total += workers[i].total;
+    }
+    return total;
+}
+
+int main(void)
+{
+    struct Input input;
+
+    if (!Input_open(&input))
+        return 1;
+
+    printf("total = %zu\n", sum_powers_parallel(input.data, input.length));
+    Input_free(&input);
     return 0;
 }
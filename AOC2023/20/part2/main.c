@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <pthread.h>
+
+#include "numtheory.h"
 
 /* Signals */
 #define LOW     0U
@@ -83,6 +86,16 @@ struct CharBuffer {
     uint32_t capacity;
 };
 
+/* One counter fed by a single broadcaster output, with its own copy of
+ * the module states so it can be simulated independently of the others
+ */
+struct SubCircuit {
+    struct ModuleHashMap *hashmap;
+    char *output;
+    uint64_t cycle;
+    pthread_t thread;
+};
+
 uint32_t hash(char *str, uint32_t capacity)
 {
     uint32_t hash;
@@ -139,6 +152,7 @@ struct ConjunctionState *ConjunctionState_create(uint32_t start_capacity)
 
 void ConjunctionState_free(struct ConjunctionState *conj_state)
 {
+    if (!conj_state) return;
     free(conj_state->sources);
     conj_state->sources = NULL;
     free(conj_state);
@@ -350,6 +364,15 @@ int StringArray_insert(struct StringArray *sa, char *str, uint32_t length)
     return 1;
 }
 
+int StringArray_contains(struct StringArray *sa, char *str)
+{
+    uint32_t i;
+    for (i = 0; i < sa->length; ++i)
+        if (strcmp(sa->strings[i], str) == 0)
+            return 1;
+    return 0;
+}
+
 int StringArray_load(struct StringArray *sa)
 {
     struct CharBuffer *cb;
@@ -609,6 +632,44 @@ error:
     return NULL;
 }
 
+struct Module *Module_clone(struct Module *module)
+{
+    struct Module *clone;
+    uint32_t i, length;
+
+    clone = Module_create();
+    if (!clone) return NULL;
+    clone->type = module->type;
+    length = strlen(module->identifier);
+    clone->identifier = malloc((length + 1) * sizeof(*(clone->identifier)));
+    if (!clone->identifier) {
+        perror("malloc");
+        puts("Failed to allocate identifier string");
+        Module_free(clone);
+        return NULL;
+    }
+    memcpy(clone->identifier, module->identifier, length + 1);
+    clone->dests = StringArray_create(module->dests->length);
+    if (!clone->dests) {
+        Module_free(clone);
+        return NULL;
+    }
+    for (i = 0; i < module->dests->length; ++i) {
+        if (
+            !StringArray_insert(
+                clone->dests,
+                module->dests->strings[i],
+                strlen(module->dests->strings[i])
+            )
+        ) {
+            puts("Failed to copy module destinations");
+            Module_free(clone);
+            return NULL;
+        }
+    }
+    return clone;
+}
+
 struct ModuleHashMap *ModuleHashMap_create(void)
 {
     struct ModuleHashMap *hashmap;
@@ -1025,28 +1086,238 @@ struct Module *ModuleHashMap_find_by_dest(
     return NULL;
 }
 
-uint64_t lcm(uint64_t number, uint64_t other)
+struct StringArray *ModuleHashMap_reachable(
+    struct ModuleHashMap *hashmap, char *start, char *stop
+)
+{
+    struct StringArray *reached;
+    struct Module *module;
+    char *dest;
+    uint32_t i, j;
+
+    reached = StringArray_create(0);
+    if (!reached) return NULL;
+    if (!StringArray_insert(reached, start, strlen(start))) {
+        StringArray_free(reached);
+        return NULL;
+    }
+    /* The array doubles as the BFS queue */
+    for (i = 0; i < reached->length; ++i) {
+        module = ModuleHashMap_retrieve(hashmap, reached->strings[i]);
+        if (!module) continue;
+        for (j = 0; j < module->dests->length; ++j) {
+            dest = module->dests->strings[j];
+            if (strcmp(dest, stop) == 0) continue;
+            if (StringArray_contains(reached, dest)) continue;
+            if (!StringArray_insert(reached, dest, strlen(dest))) {
+                StringArray_free(reached);
+                return NULL;
+            }
+        }
+    }
+    return reached;
+}
+
+int ModuleHashMap_is_closed(
+    struct ModuleHashMap *hashmap, struct StringArray *identifiers
+)
+{
+    uint32_t i, j;
+    struct Module *module;
+    for (i = 0; i < hashmap->capacity; ++i) {
+        if (!hashmap->modules[i]) continue;
+        module = hashmap->modules[i];
+        if (module->type == BROADCASTER) continue;
+        if (StringArray_contains(identifiers, module->identifier)) continue;
+        for (j = 0; j < module->dests->length; ++j)
+            if (StringArray_contains(identifiers, module->dests->strings[j]))
+                return 0;
+    }
+    return 1;
+}
+
+struct ModuleHashMap *ModuleHashMap_extract(
+    struct ModuleHashMap *hashmap,
+    struct StringArray *identifiers,
+    char *entry
+)
+{
+    struct ModuleHashMap *sub;
+    struct Module *module, *clone;
+    uint32_t i;
+
+    sub = ModuleHashMap_create();
+    if (!sub) return NULL;
+    module = ModuleHashMap_retrieve(hashmap, START_DEST);
+    if (!module) {
+        puts("Failed to find " START_DEST);
+        goto free_sub;
+    }
+    clone = Module_clone(module);
+    if (!clone) goto free_sub;
+    /* The private broadcaster only feeds this sub-circuit */
+    StringArray_free(clone->dests);
+    clone->dests = StringArray_create(0);
+    if (
+        !clone->dests
+        || !StringArray_insert(clone->dests, entry, strlen(entry))
+        || !ModuleHashMap_store(sub, clone)
+    ) {
+        Module_free(clone);
+        goto free_sub;
+    }
+    for (i = 0; i < identifiers->length; ++i) {
+        module = ModuleHashMap_retrieve(hashmap, identifiers->strings[i]);
+        if (!module) continue;
+        clone = Module_clone(module);
+        if (!clone) goto free_sub;
+        if (!ModuleHashMap_store(sub, clone)) {
+            Module_free(clone);
+            goto free_sub;
+        }
+    }
+    if (!ModuleHashMap_init(sub)) goto free_sub;
+    return sub;
+free_sub:
+    puts("Failed to extract sub-circuit");
+    ModuleHashMap_free(sub, 0);
+    return NULL;
+}
+
+char *ModuleHashMap_find_output(
+    struct ModuleHashMap *hashmap, char *dest
+)
 {
-    uint64_t num_mul, oth_mul;
-    num_mul = number;
-    oth_mul = other;
-    while (num_mul != oth_mul) {
-        if (num_mul < oth_mul) {
-            num_mul = num_mul + (
-                (oth_mul - num_mul) / number
-            ) * number;
-            if (num_mul < oth_mul)
-                num_mul = num_mul + number;
+    uint32_t i, j;
+    struct Module *module;
+    char *output;
+    output = NULL;
+    for (i = 0; i < hashmap->capacity; ++i) {
+        if (!hashmap->modules[i]) continue;
+        module = hashmap->modules[i];
+        for (j = 0; j < module->dests->length; ++j) {
+            if (strcmp(module->dests->strings[j], dest) != 0) continue;
+            if (output) return NULL;
+            output = module->identifier;
+        }
+    }
+    return output;
+}
+
+void SubCircuit_free_all(struct SubCircuit *subs, uint32_t length)
+{
+    uint32_t i;
+    if (!subs) return;
+    for (i = 0; i < length; ++i)
+        ModuleHashMap_free(subs[i].hashmap, 0);
+    free(subs);
+}
+
+/* Splits the circuit into one sub-circuit per broadcaster output
+ * Returns NULL if the outputs do not lead to independent counters
+ * that each feed the final conjunction exactly once
+ */
+struct SubCircuit *ModuleHashMap_partition(
+    struct ModuleHashMap *hashmap,
+    struct Module *final,
+    uint32_t *length
+)
+{
+    struct SubCircuit *subs;
+    struct StringArray *identifiers;
+    struct ConjunctionState *state;
+    struct Module *broadcaster;
+    uint32_t i, j;
+
+    state = final->internal_state;
+    broadcaster = ModuleHashMap_retrieve(hashmap, START_DEST);
+    if (!broadcaster) return NULL;
+    if (broadcaster->dests->length != state->length) return NULL;
+    subs = malloc(broadcaster->dests->length * sizeof(*subs));
+    if (!subs) {
+        perror("malloc");
+        puts("Failed to allocate SubCircuits");
+        return NULL;
+    }
+    for (i = 0; i < broadcaster->dests->length; ++i)
+        subs[i].hashmap = NULL;
+    *length = broadcaster->dests->length;
+    for (i = 0; i < *length; ++i) {
+        identifiers = ModuleHashMap_reachable(
+            hashmap, broadcaster->dests->strings[i], final->identifier
+        );
+        if (!identifiers) goto error;
+        if (!ModuleHashMap_is_closed(hashmap, identifiers)) {
+            StringArray_free(identifiers);
+            goto error;
         }
-        if (oth_mul < num_mul) {
-            oth_mul = oth_mul + (
-                (num_mul - oth_mul) / other
-            ) * other;
-            if (oth_mul < num_mul)
-                oth_mul = oth_mul + other;
+        subs[i].hashmap = ModuleHashMap_extract(
+            hashmap, identifiers, broadcaster->dests->strings[i]
+        );
+        StringArray_free(identifiers);
+        if (!subs[i].hashmap) goto error;
+        subs[i].output = ModuleHashMap_find_output(
+            subs[i].hashmap, final->identifier
+        );
+        if (!subs[i].output) goto error;
+        for (j = 0; j < i; ++j)
+            if (strcmp(subs[j].output, subs[i].output) == 0)
+                goto error;
+        subs[i].cycle = 0;
+    }
+    return subs;
+error:
+    SubCircuit_free_all(subs, *length);
+    return NULL;
+}
+
+void *SubCircuit_run(void *arg)
+{
+    struct SubCircuit *sub;
+    sub = arg;
+    sub->cycle = ModuleHashMap_get_cycle_for_module(
+        sub->hashmap, sub->output
+    );
+    return NULL;
+}
+
+int SubCircuit_run_all(
+    struct SubCircuit *subs, uint32_t length, uint128_t *total
+)
+{
+    uint32_t i;
+    int *started, ret;
+
+    started = malloc(length * sizeof(*started));
+    if (!started) {
+        perror("malloc");
+        puts("Failed to allocate thread flags");
+        return 0;
+    }
+    for (i = 0; i < length; ++i) {
+        started[i] = pthread_create(
+            &(subs[i].thread), NULL, SubCircuit_run, subs + i
+        ) == 0;
+        /* Not fatal, just lose the parallelism for this one */
+        if (!started[i])
+            SubCircuit_run(subs + i);
+    }
+    for (i = 0; i < length; ++i)
+        if (started[i])
+            pthread_join(subs[i].thread, NULL);
+    free(started);
+    *total = 1;
+    ret = 1;
+    for (i = 0; i < length && ret; ++i) {
+        if (!subs[i].cycle) {
+            puts("Failed to get cycle count!");
+            ret = 0;
+        } else if (!lcm_accumulate(total, subs[i].cycle)) {
+            puts("Total overflowed 128 bits!");
+            ret = 0;
         }
     }
-    return num_mul;
+    return ret;
 }
 
 int main(void)
@@ -1054,8 +1325,12 @@ int main(void)
     struct ModuleHashMap *hashmap;
     struct ConjunctionState *state;
     struct Module *module;
-    uint64_t total, count;
-    uint32_t i;
+    struct SubCircuit *subs;
+    char total_str[UINT128_STRING_LEN];
+    uint128_t total;
+    uint64_t count;
+    uint32_t i, num_subs;
+    int ret;
 
     hashmap = ModuleHashMap_create();
     if (!hashmap) return 1;
@@ -1084,23 +1359,35 @@ int main(void)
         ModuleHashMap_free(hashmap, 0);
         return 1;
     }
-    state = module->internal_state;
-    total = 0;
-    for (i = 0; i < state->length; ++i) {
-        count = ModuleHashMap_get_cycle_for_module(
-            hashmap, state->sources[i].src
-        );
-        if (!count) {
-            puts("Failed to get cycle count!");
+    subs = ModuleHashMap_partition(hashmap, module, &num_subs);
+    if (subs) {
+        ret = SubCircuit_run_all(subs, num_subs, &total);
+        SubCircuit_free_all(subs, num_subs);
+        if (!ret) {
             ModuleHashMap_free(hashmap, 0);
             return 1;
         }
-        if (!total)
-            total = count;
-        else
-            total = lcm(total, count);
+    } else {
+        puts("Circuit could not be partitioned, simulating serially");
+        state = module->internal_state;
+        total = 1;
+        for (i = 0; i < state->length; ++i) {
+            count = ModuleHashMap_get_cycle_for_module(
+                hashmap, state->sources[i].src
+            );
+            if (!count) {
+                puts("Failed to get cycle count!");
+                ModuleHashMap_free(hashmap, 0);
+                return 1;
+            }
+            if (!lcm_accumulate(&total, count)) {
+                puts("Total overflowed 128 bits!");
+                ModuleHashMap_free(hashmap, 0);
+                return 1;
+            }
+        }
     }
-    printf("Total = %lu\n", total);
+    printf("Total = %s\n", uint128_to_string(total, total_str));
     ModuleHashMap_free(hashmap, 1);
     return 0;
 }
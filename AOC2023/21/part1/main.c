@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <limits.h>
 
 #define START   'S'
@@ -9,31 +10,8 @@
 
 #define NUM_STEPS 64
 
-#define INFINITY            UINT32_MAX
 #define MIN_CAHRBUFFER2D    16
-#define MIN_QUEUE           8
-
-struct QueueItem {
-    uint32_t distance;
-    uint32_t vertex;
-};
-
-struct PriorityQueue {
-    struct QueueItem *items;
-    uint32_t length;
-    uint32_t capacity;
-};
-
-struct AdjListNode {
-    struct AdjListNode *next;
-    uint32_t vertex;
-};
-
-struct AdjacencyList {
-    struct AdjListNode **vertices;
-    uint32_t num_vertices;
-    uint32_t start_vertex;
-};
+#define WORD_BITS           64
 
 struct CharBuffer2D {
     char *buffer;
@@ -43,130 +21,19 @@ struct CharBuffer2D {
     uint32_t num_cols;
 };
 
-struct PriorityQueue *PriorityQueue_create(uint32_t start_capacity)
-{
-    struct PriorityQueue *queue;
-    queue = malloc(sizeof(*queue));
-    if (!queue) {
-        perror("malloc");
-        puts("Failed to create PriorityQueue");
-        return NULL;
-    }
-    if (start_capacity < MIN_QUEUE)
-        start_capacity = MIN_QUEUE;
-    queue->items = malloc(start_capacity * sizeof(*(queue->items)));
-    if (!queue->items) {
-        perror("malloc");
-        puts("Failed to initialize PriorityQueue");
-        free(queue);
-        return NULL;
-    }
-    queue->capacity = start_capacity;
-    queue->length = 0;
-    return queue;
-}
-
-void PriorityQueue_free(struct PriorityQueue *queue)
-{
-    free(queue->items);
-    free(queue);
-}
-
-int PriorityQueue_grow(struct PriorityQueue *queue)
-{
-    struct QueueItem *temp;
-    uint32_t new_capacity;
-    new_capacity = 2 * queue->capacity;
-    temp = realloc(queue->items, new_capacity * sizeof(*(queue->items)));
-    if (!temp) {
-        perror("realloc");
-        puts("Failed to grow PriorityQueue");
-        return 0;
-    }
-    queue->items = temp;
-    queue->capacity = new_capacity;
-    return 1;
-}
-
-int PriorityQueue_shrink(struct PriorityQueue *queue)
-{
-    struct QueueItem *temp;
-    uint32_t new_capacity;
-
-    new_capacity = queue->capacity >> 1;
-    if (new_capacity < MIN_QUEUE)
-        new_capacity = MIN_QUEUE;
-
-    temp = realloc(queue->items, new_capacity * sizeof(*(queue->items)));
-    if (!temp) {
-        perror("realloc");
-        puts("Failed to shrink PriorityQueue");
-        return 0;
-    }
-    queue->items = temp;
-    queue->capacity = new_capacity;
-    return 1;
-}
-
-void QueueItem_swap(struct QueueItem *a, struct QueueItem *b)
-{
-    struct QueueItem temp;
-    temp = *b;
-    *b = *a;
-    *a = temp;
-}
-
-void PriorityQueue_heapify(struct PriorityQueue *queue, uint32_t index)
-{
-    if (queue->length == 1) return;
-    uint32_t smallest, left, right;
-    smallest = index;
-    left = 2 * index + 1;
-    right = left + 1;
-    if (
-        left < queue->length
-        && queue->items[left].distance < queue->items[smallest].distance
-    ) smallest = left;
-    if (
-        right < queue->length
-        && queue->items[right].distance < queue->items[smallest].distance
-    ) smallest = right;
-    if (smallest != index) {
-        QueueItem_swap(&(queue->items[smallest]), &(queue->items[index]));
-        PriorityQueue_heapify(queue, smallest);
-    }
-}
-
-int PriorityQueue_enqueue(struct PriorityQueue *queue, struct QueueItem item)
-{
-    uint32_t i;
-    if (queue->length == 0) {
-        queue->items[0] = item;
-        ++(queue->length);
-    } else {
-        if (queue->length + 1 > queue->capacity)
-            if (!PriorityQueue_grow(queue)) return 0;
-        queue->items[queue->length] = item;
-        ++(queue->length);
-        for (i = queue->length / 2; i > 0; --i)
-            PriorityQueue_heapify(queue, i - 1);
-    }
-    return 1;
-}
-
-int PriorityQueue_dequeue(struct PriorityQueue *queue, struct QueueItem *dest)
-{
-    uint32_t i;
-    if (queue->length == 0) return 0;
-    *dest = queue->items[0];
-    QueueItem_swap(&(queue->items[0]), &(queue->items[queue->length - 1]));
-    --(queue->length);
-    if (queue->length < queue->capacity / 4 && queue->capacity > MIN_QUEUE)
-        if (!PriorityQueue_shrink(queue)) return 0;
-    for (i = queue->length / 2; i > 0; --i)
-        PriorityQueue_heapify(queue, i - 1);
-    return 1;
-}
+/*
+ * One bit per tile, set for garden plots. Each line takes words_per_line
+ * words with column c at bit c % WORD_BITS of word c / WORD_BITS, and the
+ * bits past num_cols stay clear.
+ */
+struct Garden {
+    uint64_t *open;
+    uint32_t words_per_line;
+    uint32_t num_lines;
+    uint32_t num_cols;
+    uint32_t start_line;
+    uint32_t start_col;
+};
 
 struct CharBuffer2D *CharBuffer2D_create(uint32_t start_capacity)
 {
@@ -270,240 +137,133 @@ char CharBuffer2D_at(struct CharBuffer2D *cb, uint32_t line, uint32_t col)
     return cb->buffer[line * cb->num_cols + col];
 }
 
-struct AdjListNode *AdjListNode_create(uint32_t vertex)
-{
-    struct AdjListNode *node;
-    node = malloc(sizeof(*node));
-    if (!node) {
-        perror("malloc");
-        puts("Failed to allocate AdjListNode");
-        return NULL;
-    }
-    node->vertex = vertex;
-    node->next = NULL;
-    return node;
-}
-
-struct AdjListNode *AdjListNode_prepend(
-    struct AdjListNode *node, uint32_t vertex
-)
-{
-    struct AdjListNode *new;
-    new = AdjListNode_create(vertex);
-    if (!new) return NULL;
-    new->next = node;
-    return new;
-}
-
-void AdjListNode_free(struct AdjListNode *node)
-{
-    if (!node) return;
-    struct AdjListNode *next;
-    next = node->next;
-    free(node);
-    AdjListNode_free(next);
-}
-
-struct AdjacencyList *AdjacencyList_create(uint32_t num_vertices)
-{
-    uint32_t i;
-    struct AdjacencyList *adj_list;
-    adj_list = malloc(sizeof(*adj_list));
-    if (!adj_list) {
-        perror("malloc");
-        puts("Failed to allocate AdjacencyList");
-        return NULL;
-    }
-    *adj_list = (struct AdjacencyList) {
-        .vertices = malloc(num_vertices * sizeof(*(adj_list->vertices))),
-        .num_vertices = num_vertices,
-        .start_vertex = 0
-    };
-    if (!adj_list->vertices) {
-        perror("malloc");
-        puts("Failed to allocate AdjacencyList->vertices");
-        free(adj_list);
-        return NULL;
-    }
-    for (i = 0; i < num_vertices; ++i)
-        adj_list->vertices[i] = NULL;
-    return adj_list;
-}
-
-void AdjacencyList_free(struct AdjacencyList *adj_list)
-{
-    uint32_t i;
-    for (i = 0; i < adj_list->num_vertices; ++i)
-        AdjListNode_free(adj_list->vertices[i]);
-    free(adj_list->vertices);
-    free(adj_list);
-}
-
-int AdjacencyList_add_connection(
-    struct AdjacencyList* adj_list, uint32_t from, uint32_t to
-)
+void Garden_free(struct Garden *garden)
 {
-    struct AdjListNode *node;
-    node = AdjListNode_prepend(adj_list->vertices[from], to);
-    if (!node) return 0;
-    adj_list->vertices[from] = node;
-    return 1;
+    free(garden->open);
+    free(garden);
 }
 
-struct AdjacencyList *gen_adj_list(void)
+struct Garden *gen_garden(void)
 {
     struct CharBuffer2D *cb;
-    char type;
-    struct AdjacencyList *adj_list;
+    struct Garden *garden;
     uint32_t line, col;
-    uint32_t vertex;
+    char type;
     cb = CharBuffer2D_create(0);
     if (!cb) goto error;
     if (!CharBuffer2D_load(cb)) goto free_cb;
-    adj_list = AdjacencyList_create(cb->num_lines * cb->num_cols);
-    if (!adj_list) goto free_cb;
+    garden = malloc(sizeof(*garden));
+    if (!garden) goto error_create_garden;
+    *garden = (struct Garden) {
+        .words_per_line = (cb->num_cols + WORD_BITS - 1) / WORD_BITS,
+        .num_lines = cb->num_lines,
+        .num_cols = cb->num_cols,
+        .start_line = 0,
+        .start_col = 0
+    };
+    garden->open = calloc(
+        (size_t) garden->num_lines * garden->words_per_line + 1,
+        sizeof(*(garden->open))
+    );
+    if (!garden->open) goto error_create_open;
     for (line = 0; line < cb->num_lines; ++line) {
         for (col = 0; col < cb->num_cols; ++col) {
             type = CharBuffer2D_at(cb, line, col);
-            vertex = line * cb->num_cols + col;
             if (type == ROCK)
                 continue;
-            if (type == START)
-                adj_list->start_vertex = vertex;
-
-            /* North */
-            if (
-                line
-                && CharBuffer2D_at(cb, line - 1, col) != ROCK
-                && !AdjacencyList_add_connection(
-                    adj_list, vertex, (line - 1) * cb->num_cols + col
-                )
-            ) goto free_adj_list;
-
-            /* South */
-            if (
-                line < cb->num_lines - 1
-                && CharBuffer2D_at(cb, line + 1, col) != ROCK
-                && !AdjacencyList_add_connection(
-                    adj_list, vertex, (line + 1) * cb->num_cols + col
-                )
-            ) goto free_adj_list;
-
-            /* West */
-            if (
-                col
-                && CharBuffer2D_at(cb, line, col - 1) != ROCK
-                && !AdjacencyList_add_connection(
-                    adj_list, vertex, line * cb->num_cols + (col - 1)
-                )
-            ) goto free_adj_list;
-
-            /* East */
-            if (
-                col < cb->num_cols - 1
-                && CharBuffer2D_at(cb, line, col + 1) != ROCK
-                && !AdjacencyList_add_connection(
-                    adj_list, vertex, line * cb->num_cols + (col + 1)
-                )
-            ) goto free_adj_list;
+            if (type == START) {
+                garden->start_line = line;
+                garden->start_col = col;
+            }
+            garden->open[line * garden->words_per_line + col / WORD_BITS] |=
+                (uint64_t) 1 << (col % WORD_BITS);
         }
     }
     CharBuffer2D_free(cb);
-    return adj_list;
+    return garden;
 
-free_adj_list:
-    AdjacencyList_free(adj_list);
+error_create_open:
+    free(garden);
+error_create_garden:
+    perror("malloc");
+    puts("Failed to allocate Garden");
 free_cb:
     CharBuffer2D_free(cb);
 error:
     return NULL;
 }
 
-uint32_t *dijkstra(struct AdjacencyList *adj_list)
+/*
+ * Moves every tile in reach one step in all four directions at once,
+ * 64 columns per word, and masks off the rocks and the edges
+ */
+void Garden_step(struct Garden *garden, uint64_t *reach, uint64_t *next)
 {
-    struct PriorityQueue *queue;
-    struct AdjListNode *node;
-    struct QueueItem item;
-    uint32_t vertex, new_distance, *distances;
-    int result;
-
-    distances = malloc(adj_list->num_vertices * sizeof(*distances));
-    if (!distances) goto error_create_distances;
-    for (vertex = 0; vertex < adj_list->num_vertices; ++vertex)
-        distances[vertex] = INFINITY;
-
-    queue = PriorityQueue_create(adj_list->num_vertices / 2);
-    if (!queue) goto error_create_queue;
-
-    item = (struct QueueItem) {
-        .distance = 0,
-        .vertex = adj_list->start_vertex
-    };
-
-    result = PriorityQueue_enqueue(queue, item);
-    if (!result) goto error_enqueue;
-
-    while (PriorityQueue_dequeue(queue, &item)) {
-        vertex = item.vertex;
-        node = adj_list->vertices[vertex];
-
-        while (node) {
-            new_distance = item.distance + 1;
-            if (new_distance < distances[node->vertex]) {
-                distances[node->vertex] = new_distance;
-                result = PriorityQueue_enqueue(
-                    queue,
-                    (struct QueueItem) {
-                        .distance = new_distance,
-                        .vertex = node->vertex
-                    }
-                );
-                if (!result) goto error_enqueue;
-            }
-            node = node->next;
+    uint32_t line, word, words;
+    uint64_t *row, moved;
+    words = garden->words_per_line;
+    for (line = 0; line < garden->num_lines; ++line) {
+        row = reach + line * words;
+        for (word = 0; word < words; ++word) {
+            moved = row[word] << 1 | row[word] >> 1;
+            if (word)
+                moved |= row[word - 1] >> (WORD_BITS - 1);
+            if (word + 1 < words)
+                moved |= row[word + 1] << (WORD_BITS - 1);
+            if (line)
+                moved |= (row - words)[word];
+            if (line + 1 < garden->num_lines)
+                moved |= (row + words)[word];
+            next[line * words + word] =
+                moved & garden->open[line * words + word];
         }
     }
-    PriorityQueue_free(queue);
-    return distances;
+}
 
-error_create_distances:
-    perror("malloc");
-    puts("Failed to allocate distances array");
-    goto error;
-error_create_queue:
-    puts("Failed to create PriorityQueue");
-    goto free_distances;
-error_enqueue:
-    puts("Failed to enqueue item");
-    goto free_queue;
-free_queue:
-    PriorityQueue_free(queue);
-free_distances:
-    free(distances);
-error:
-    return NULL;
+/* Number of tiles the elf can be on after exactly num_steps steps */
+int Garden_count_reachable(
+    struct Garden *garden, uint32_t num_steps, uint64_t *count
+)
+{
+    uint64_t *reach, *next, *temp;
+    size_t num_words, i;
+    uint32_t step;
+    num_words = (size_t) garden->num_lines * garden->words_per_line;
+    reach = calloc(2 * num_words + 1, sizeof(*reach));
+    if (!reach) {
+        perror("calloc");
+        puts("Failed to allocate bitboards");
+        return 0;
+    }
+    next = reach + num_words;
+    reach[garden->start_line * garden->words_per_line
+        + garden->start_col / WORD_BITS] =
+        (uint64_t) 1 << (garden->start_col % WORD_BITS);
+    for (step = 0; step < num_steps; ++step) {
+        Garden_step(garden, reach, next);
+        temp = reach;
+        reach = next;
+        next = temp;
+    }
+    *count = 0;
+    for (i = 0; i < num_words; ++i)
+        *count += __builtin_popcountll(reach[i]);
+    free(reach < next ? reach : next);
+    return 1;
 }
 
 int run(void)
 {
-    struct AdjacencyList *adj_list;
-    uint32_t i, *distances, count;
-    adj_list = gen_adj_list();
-    if (!adj_list) return 0;
-    distances = dijkstra(adj_list);
-    if (!distances) return 0;
-    for (i = count = 0; i < adj_list->num_vertices; ++i)
-        if (
-            distances[i] == NUM_STEPS
-            || (
-                distances[i] < NUM_STEPS
-                && distances[i] % 2 == NUM_STEPS % 2
-            )
-        )
-            ++count;
-    printf("Reachable = %u\n", count);
-    free(distances);
-    AdjacencyList_free(adj_list);
+    struct Garden *garden;
+    uint64_t count;
+    garden = gen_garden();
+    if (!garden) return 0;
+    if (!Garden_count_reachable(garden, NUM_STEPS, &count)) {
+        Garden_free(garden);
+        return 0;
+    }
+    printf("Reachable = %lu\n", count);
+    Garden_free(garden);
     return 1;
 }
 
@@ -1,7 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <limits.h>
+#include <pthread.h>
+
+#include "numtheory.h"
 
 #define START   'S'
 #define GARDEN  '.'
@@ -9,166 +13,248 @@
 
 #define NUM_STEPS 26501365
 
-#define INFINITY            UINT64_MAX
+#define UNREACHED           UINT32_MAX
 #define MIN_CAHRBUFFER2D    16
-#define MIN_QUEUE           8
+#define MAX_FIELDS          16
+#define NUM_THREADS         8
+#define WORD_BITS           64
+#define MIN_VERTEXARRAY     64
+
+#define MIN_RUNARRAY        16
+#define NO_PROFILE          UINT32_MAX
+#define NO_CLASS            UINT32_MAX
+#define CLOSED              (UINT32_MAX - 1)
+#define MIN_VECTORSET       64
+#define MIN_TILEHEAP        64
+#define KEY_LENGTH          9
+#define NUM_OCTANTS         8
+#define NO_RUN              UINT32_MAX
+
+/*
+ * The tiled search starts INITIAL_RINGS rings of tiles out and doubles
+ * until the runs of tiles along every octant repeat for STABLE_WINDOWS
+ * periods, giving up past MAX_RINGS. The tile class check simulates up
+ * to a MAX_TILED_SIDE wide square.
+ */
+#define STABLE_WINDOWS  2
+#define INITIAL_RINGS   16
+#define MAX_RINGS       1024
+#define MAX_TILED_SIDE  16384
+
+struct CharBuffer2D {
+    char *buffer;
+    uint32_t length;
+    uint32_t capacity;
+    uint32_t num_lines;
+    uint32_t num_cols;
+};
 
-struct QueueItem {
-    uint32_t distance;
-    uint32_t vertex;
+/*
+ * One bit per tile, set for garden plots. Each line takes words_per_line
+ * words with column c at bit c % WORD_BITS of word c / WORD_BITS, and the
+ * bits past num_cols stay clear.
+ */
+struct Garden {
+    uint64_t *open;
+    uint32_t words_per_line;
+    uint32_t num_lines;
+    uint32_t num_cols;
+    uint32_t start_line;
+    uint32_t start_col;
+    uint32_t num_vertices;
+    uint32_t start_vertex;
 };
 
-struct PriorityQueue {
-    struct QueueItem *items;
+/* Fixed capacity FIFO, every vertex is pushed at most once per search */
+struct RingQueue {
+    uint32_t *items;
+    uint32_t head;
     uint32_t length;
     uint32_t capacity;
 };
 
-struct AdjListNode {
-    struct AdjListNode *next;
-    uint32_t vertex;
+/*
+ * within[parity][d] counts the tiles at distance at most d from source
+ * whose distance has that parity, for d up to max_distance
+ */
+struct DistanceField {
+    uint32_t source;
+    uint32_t max_distance;
+    uint64_t *within[2];
 };
 
-struct AdjacencyList {
-    struct AdjListNode **vertices;
-    uint32_t num_vertices;
-    uint32_t start_vertex;
-    uint32_t num_lines;
-    uint32_t num_cols;
+/* Runs the searches for sources[offset], sources[offset + stride], ... */
+struct FieldWorker {
+    struct Garden *garden;
+    uint32_t *sources;
+    struct DistanceField *fields;
+    uint32_t num_sources;
+    uint32_t offset;
+    uint32_t stride;
+    uint32_t *distances;
+    struct RingQueue queue;
+    int success;
+    pthread_t thread;
+    int started;
 };
 
-struct CharBuffer2D {
-    char *buffer;
+struct VertexArray {
+    uint32_t *vertices;
     uint32_t length;
     uint32_t capacity;
-    uint32_t num_lines;
-    uint32_t num_cols;
 };
 
-struct PriorityQueue *PriorityQueue_create(uint32_t start_capacity)
-{
-    struct PriorityQueue *queue;
-    queue = malloc(sizeof(*queue));
-    if (!queue) {
-        perror("malloc");
-        puts("Failed to create PriorityQueue");
-        return NULL;
-    }
-    if (start_capacity < MIN_QUEUE)
-        start_capacity = MIN_QUEUE;
-    queue->items = malloc(start_capacity * sizeof(*(queue->items)));
-    if (!queue->items) {
-        perror("malloc");
-        puts("Failed to initialize PriorityQueue");
-        free(queue);
-        return NULL;
-    }
-    queue->capacity = start_capacity;
-    queue->length = 0;
-    return queue;
-}
+/*
+ * Every distinct vector added gets the next id and is kept at values +
+ * starts[id], lengths[id] long. slots hashes them, at most half full.
+ */
+struct VectorSet {
+    uint32_t *values;
+    size_t num_values;
+    size_t values_capacity;
+    size_t *starts;
+    uint32_t *lengths;
+    uint32_t length;
+    uint32_t capacity;
+    uint32_t *slots;
+    uint32_t num_slots;
+};
 
-void PriorityQueue_free(struct PriorityQueue *queue)
-{
-    free(queue->items);
-    free(queue);
-}
+/* Tiles to solve, keyed by the earliest they could be entered */
+struct TileHeap {
+    uint64_t *items;
+    uint32_t length;
+    uint32_t capacity;
+};
 
-int PriorityQueue_grow(struct PriorityQueue *queue)
-{
-    struct QueueItem *temp;
-    uint32_t new_capacity;
-    new_capacity = 2 * queue->capacity;
-    temp = realloc(queue->items, new_capacity * sizeof(*(queue->items)));
-    if (!temp) {
-        perror("realloc");
-        puts("Failed to grow PriorityQueue");
-        return 0;
-    }
-    queue->items = temp;
-    queue->capacity = new_capacity;
-    return 1;
-}
+/*
+ * Works out the distances in one tile from the plots along the edges of
+ * the tiles next to it. A tile's class holds the distances past its entry
+ * along its top, bottom, left and right edges, then the id of its
+ * profile, which is all the count needs. All the tile next to an edge
+ * sees of it is the edge's id in edges, kept with the plots across it
+ * that are closed left out and counting from its nearest plot, and how
+ * far past the entry that is. side_edges has those two for every side
+ * of every class. Plots are numbered on the tile with a closed border
+ * around it, and blank has them all UNREACHED but the closed ones.
+ * Solutions are kept by the edges around the tile and how much later
+ * than the first of them each is reached, as far from the start the
+ * same few keep coming up.
+ */
+struct TileSolver {
+    struct Garden *garden;
+    uint32_t pitch;
+    uint32_t num_plots;
+    uint32_t perimeter;
+    uint32_t edge_start[4];
+    uint32_t edge_length[4];
+    uint32_t first_plot[4];
+    uint32_t plot_step[4];
+    uint32_t *blank;
+    uint32_t *distances;
+    uint32_t *layer;
+    uint32_t *next;
+    uint32_t *counts;
+    uint32_t num_counts;
+    uint32_t *outline;
+    uint64_t *seeds;
+    struct VectorSet profiles;
+    struct VectorSet classes;
+    struct VectorSet edges;
+    struct VertexArray *side_edges;
+    struct VectorSet keys;
+    struct VertexArray *solutions;
+};
 
-int PriorityQueue_shrink(struct PriorityQueue *queue)
-{
-    struct QueueItem *temp;
-    uint32_t new_capacity;
+/*
+ * What the tiled search found in each tile of the square radius tiles out
+ * from the start tile: the distance it was first entered at, UNREACHED if
+ * never or outside the diamond searched, and its profile of distances
+ * past that. Rings of tiles closer than trusted_rings are exact.
+ */
+struct TiledSearch {
+    uint32_t radius;
+    uint32_t side;
+    uint32_t *entries;
+    uint32_t *profile_ids;
+    struct DistanceField *profiles;
+    uint32_t num_profiles;
+    uint32_t exact_distance;
+    uint32_t trusted_rings;
+};
 
-    new_capacity = queue->capacity >> 1;
-    if (new_capacity < MIN_QUEUE)
-        new_capacity = MIN_QUEUE;
+/*
+ * Tiles in a row along a line with the same profile, the first at
+ * position start, each entered step after the one before. A period of
+ * lines later the same run is entered entry_growth later.
+ */
+struct TileRun {
+    uint32_t profile;
+    int64_t entry;
+    int64_t step;
+    int64_t start;
+    int64_t length;
+    int64_t entry_growth;
+};
 
-    temp = realloc(queue->items, new_capacity * sizeof(*(queue->items)));
-    if (!temp) {
-        perror("realloc");
-        puts("Failed to shrink PriorityQueue");
-        return 0;
-    }
-    queue->items = temp;
-    queue->capacity = new_capacity;
-    return 1;
-}
+struct RunArray {
+    struct TileRun *runs;
+    uint32_t length;
+    uint32_t capacity;
+};
 
-void QueueItem_swap(struct QueueItem *a, struct QueueItem *b)
-{
-    struct QueueItem temp;
-    temp = *b;
-    *b = *a;
-    *a = temp;
-}
+/*
+ * A wedge of tiles with one profile that widens ring by ring, its tiles
+ * along a line each entered step after the one before. Position 0 of the
+ * outermost trusted line would be entered at entry, and every ring out
+ * adds entry_growth to that.
+ */
+struct Region {
+    uint32_t profile;
+    int64_t step;
+    int64_t entry;
+    int64_t entry_growth;
+};
 
-void PriorityQueue_heapify(struct PriorityQueue *queue, uint32_t index)
-{
-    if (queue->length == 1) return;
-    uint32_t smallest, left, right;
-    smallest = index;
-    left = 2 * index + 1;
-    right = left + 1;
-    if (
-        left < queue->length
-        && queue->items[left].distance < queue->items[smallest].distance
-    ) smallest = left;
-    if (
-        right < queue->length
-        && queue->items[right].distance < queue->items[smallest].distance
-    ) smallest = right;
-    if (smallest != index) {
-        QueueItem_swap(&(queue->items[smallest]), &(queue->items[index]));
-        PriorityQueue_heapify(queue, smallest);
-    }
-}
+/*
+ * The runs of a line between two regions. A period of lines later they
+ * are the same runs start_growth further along, each entered its
+ * entry_growth later.
+ */
+struct Band {
+    uint32_t first_run;
+    uint32_t num_runs;
+    int64_t start;
+    int64_t start_growth;
+};
 
-int PriorityQueue_enqueue(struct PriorityQueue *queue, struct QueueItem item)
-{
-    uint32_t i;
-    if (queue->length == 0) {
-        queue->items[0] = item;
-        ++(queue->length);
-    } else {
-        if (queue->length + 1 > queue->capacity)
-            if (!PriorityQueue_grow(queue)) return 0;
-        queue->items[queue->length] = item;
-        ++(queue->length);
-        for (i = queue->length / 2; i > 0; --i)
-            PriorityQueue_heapify(queue, i - 1);
-    }
-    return 1;
-}
+/*
+ * How the lines of an octant go on past ring, bands alternating with
+ * regions. Band k repeats every periods[k] lines, and looks like
+ * bands[first_band[k] + i] on the line i rings in, whose runs are kept
+ * in runs.
+ */
+struct OctantModel {
+    uint32_t octant;
+    uint32_t ring;
+    struct Region *regions;
+    uint32_t num_regions;
+    uint32_t *periods;
+    uint32_t *first_band;
+    struct Band *bands;
+    struct RunArray *runs;
+};
 
-int PriorityQueue_dequeue(struct PriorityQueue *queue, struct QueueItem *dest)
-{
-    uint32_t i;
-    if (queue->length == 0) return 0;
-    *dest = queue->items[0];
-    QueueItem_swap(&(queue->items[0]), &(queue->items[queue->length - 1]));
-    --(queue->length);
-    if (queue->length < queue->capacity / 4 && queue->capacity > MIN_QUEUE)
-        if (!PriorityQueue_shrink(queue)) return 0;
-    for (i = queue->length / 2; i > 0; --i)
-        PriorityQueue_heapify(queue, i - 1);
-    return 1;
-}
+/* Every distinct source is searched once, whatever step counts it's
+ * queried with after that
+ */
+struct FieldCache {
+    struct Garden *garden;
+    struct DistanceField fields[MAX_FIELDS];
+    uint32_t length;
+    uint32_t *distances;
+    struct RingQueue queue;
+};
 
 struct CharBuffer2D *CharBuffer2D_create(uint32_t start_capacity)
 {
@@ -272,389 +358,2245 @@ char CharBuffer2D_at(struct CharBuffer2D *cb, uint32_t line, uint32_t col)
     return cb->buffer[line * cb->num_cols + col];
 }
 
-struct AdjListNode *AdjListNode_create(uint32_t vertex)
+void Garden_free(struct Garden *garden)
 {
-    struct AdjListNode *node;
-    node = malloc(sizeof(*node));
-    if (!node) {
-        perror("malloc");
-        puts("Failed to allocate AdjListNode");
-        return NULL;
+    free(garden->open);
+    free(garden);
+}
+
+struct Garden *gen_garden(void)
+{
+    struct CharBuffer2D *cb;
+    struct Garden *garden;
+    uint32_t line, col;
+    char type;
+    cb = CharBuffer2D_create(0);
+    if (!cb) goto error;
+    if (!CharBuffer2D_load(cb)) goto free_cb;
+    garden = malloc(sizeof(*garden));
+    if (!garden) goto error_create_garden;
+    *garden = (struct Garden) {
+        .words_per_line = (cb->num_cols + WORD_BITS - 1) / WORD_BITS,
+        .num_lines = cb->num_lines,
+        .num_cols = cb->num_cols,
+        .start_line = 0,
+        .start_col = 0,
+        .num_vertices = cb->num_lines * cb->num_cols,
+        .start_vertex = 0
+    };
+    garden->open = calloc(
+        (size_t) garden->num_lines * garden->words_per_line + 1,
+        sizeof(*(garden->open))
+    );
+    if (!garden->open) goto error_create_open;
+    for (line = 0; line < cb->num_lines; ++line) {
+        for (col = 0; col < cb->num_cols; ++col) {
+            type = CharBuffer2D_at(cb, line, col);
+            if (type == ROCK)
+                continue;
+            if (type == START) {
+                garden->start_line = line;
+                garden->start_col = col;
+            }
+            garden->open[line * garden->words_per_line + col / WORD_BITS] |=
+                (uint64_t) 1 << (col % WORD_BITS);
+        }
     }
-    node->vertex = vertex;
-    node->next = NULL;
-    return node;
+    garden->start_vertex =
+        garden->start_line * garden->num_cols + garden->start_col;
+    CharBuffer2D_free(cb);
+    return garden;
+
+error_create_open:
+    free(garden);
+error_create_garden:
+    perror("malloc");
+    puts("Failed to allocate Garden");
+free_cb:
+    CharBuffer2D_free(cb);
+error:
+    return NULL;
 }
 
-struct AdjListNode *AdjListNode_prepend(
-    struct AdjListNode *node, uint32_t vertex
-)
+int Garden_is_open(struct Garden *garden, uint32_t line, uint32_t col)
 {
-    struct AdjListNode *new;
-    new = AdjListNode_create(vertex);
-    if (!new) return NULL;
-    new->next = node;
-    return new;
+    return garden->open[line * garden->words_per_line + col / WORD_BITS]
+        >> (col % WORD_BITS) & 1;
 }
 
-void AdjListNode_free(struct AdjListNode *node)
+void RingQueue_push(struct RingQueue *queue, uint32_t item)
 {
-    if (!node) return;
-    struct AdjListNode *next;
-    next = node->next;
-    free(node);
-    AdjListNode_free(next);
+    queue->items[(queue->head + queue->length) % queue->capacity] = item;
+    ++(queue->length);
 }
 
-struct AdjacencyList *AdjacencyList_create(uint32_t num_vertices)
+int RingQueue_pop(struct RingQueue *queue, uint32_t *dest)
 {
-    uint32_t i;
-    struct AdjacencyList *adj_list;
-    adj_list = malloc(sizeof(*adj_list));
-    if (!adj_list) {
+    if (!queue->length) return 0;
+    *dest = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    --(queue->length);
+    return 1;
+}
+
+/*
+ * Breadth first distances from start_vertex, every step costs the same
+ * so the first visit to a tile is the shortest
+ */
+void Garden_bfs(
+    struct Garden *garden,
+    uint32_t start_vertex,
+    uint32_t *distances,
+    struct RingQueue *queue
+)
+{
+    uint32_t vertex, line, col, next, i;
+    int32_t moves[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+    for (vertex = 0; vertex < garden->num_vertices; ++vertex)
+        distances[vertex] = UNREACHED;
+    queue->head = queue->length = 0;
+    distances[start_vertex] = 0;
+    RingQueue_push(queue, start_vertex);
+    while (RingQueue_pop(queue, &vertex)) {
+        line = vertex / garden->num_cols;
+        col = vertex % garden->num_cols;
+        for (i = 0; i < 4; ++i) {
+            /* Wraps past the edges to huge values the bounds check skips */
+            if (
+                line + moves[i][0] >= garden->num_lines
+                || col + moves[i][1] >= garden->num_cols
+                || !Garden_is_open(
+                    garden, line + moves[i][0], col + moves[i][1]
+                )
+            )
+                continue;
+            next = vertex + moves[i][0] * garden->num_cols + moves[i][1];
+            if (distances[next] != UNREACHED) continue;
+            distances[next] = distances[vertex] + 1;
+            RingQueue_push(queue, next);
+        }
+    }
+}
+
+struct FieldCache *FieldCache_create(struct Garden *garden)
+{
+    struct FieldCache *cache;
+    cache = malloc(sizeof(*cache));
+    if (!cache) {
         perror("malloc");
-        puts("Failed to allocate AdjacencyList");
+        puts("Failed to allocate FieldCache");
         return NULL;
     }
-    *adj_list = (struct AdjacencyList) {
-        .vertices = malloc(num_vertices * sizeof(*(adj_list->vertices))),
-        .num_vertices = num_vertices,
-        .start_vertex = 0,
-        .num_lines = 0,
-        .num_cols = 0
-    };
-    if (!adj_list->vertices) {
+    cache->garden = garden;
+    cache->length = 0;
+    cache->distances = malloc(
+        2 * garden->num_vertices * sizeof(*(cache->distances))
+    );
+    if (!cache->distances) {
         perror("malloc");
-        puts("Failed to allocate AdjacencyList->vertices");
-        free(adj_list);
+        puts("Failed to allocate distances array");
+        free(cache);
         return NULL;
     }
-    for (i = 0; i < num_vertices; ++i)
-        adj_list->vertices[i] = NULL;
-    return adj_list;
+    cache->queue = (struct RingQueue) {
+        .items = cache->distances + garden->num_vertices,
+        .head = 0,
+        .length = 0,
+        .capacity = garden->num_vertices
+    };
+    return cache;
 }
 
-void AdjacencyList_free(struct AdjacencyList *adj_list)
+void FieldCache_free(struct FieldCache *cache)
 {
     uint32_t i;
-    for (i = 0; i < adj_list->num_vertices; ++i)
-        AdjListNode_free(adj_list->vertices[i]);
-    free(adj_list->vertices);
-    free(adj_list);
+    for (i = 0; i < cache->length; ++i)
+        free(cache->fields[i].within[0]);
+    free(cache->distances);
+    free(cache);
 }
 
-int AdjacencyList_add_connection(
-    struct AdjacencyList* adj_list, uint32_t from, uint32_t to
-)
+int DistanceField_alloc(struct DistanceField *field, uint32_t max_distance)
 {
-    struct AdjListNode *node;
-    node = AdjListNode_prepend(adj_list->vertices[from], to);
-    if (!node) return 0;
-    adj_list->vertices[from] = node;
+    field->max_distance = max_distance;
+    field->within[0] = calloc(
+        2 * ((size_t) max_distance + 1), sizeof(uint64_t)
+    );
+    if (!field->within[0]) {
+        perror("calloc");
+        puts("Failed to allocate DistanceField");
+        return 0;
+    }
+    field->within[1] = field->within[0] + max_distance + 1;
     return 1;
 }
 
-struct AdjacencyList *gen_adj_list(void)
+/* Turns within from counts at each distance into prefix sums */
+void DistanceField_accumulate(struct DistanceField *field)
 {
-    struct CharBuffer2D *cb;
-    char type;
-    struct AdjacencyList *adj_list;
-    uint32_t line, col;
-    uint32_t vertex;
-    cb = CharBuffer2D_create(0);
-    if (!cb) goto error;
-    if (!CharBuffer2D_load(cb)) goto free_cb;
-    adj_list = AdjacencyList_create(cb->num_lines * cb->num_cols);
-    if (!adj_list) goto free_cb;
-    adj_list->num_lines = cb->num_lines;
-    adj_list->num_cols = cb->num_cols;
-    for (line = 0; line < cb->num_lines; ++line) {
-        for (col = 0; col < cb->num_cols; ++col) {
-            type = CharBuffer2D_at(cb, line, col);
-            vertex = line * cb->num_cols + col;
-            if (type == ROCK)
-                continue;
-            if (type == START)
-                adj_list->start_vertex = vertex;
+    uint32_t d;
+    for (d = 1; d <= field->max_distance; ++d) {
+        field->within[0][d] += field->within[0][d - 1];
+        field->within[1][d] += field->within[1][d - 1];
+    }
+}
 
-            /* North */
-            if (
-                line
-                && CharBuffer2D_at(cb, line - 1, col) != ROCK
-                && !AdjacencyList_add_connection(
-                    adj_list, vertex, (line - 1) * cb->num_cols + col
-                )
-            ) goto free_adj_list;
+/* Turns the distances left by Garden_bfs into per parity prefix sums */
+int DistanceField_from_distances(
+    struct DistanceField *field,
+    uint32_t source,
+    uint32_t *distances,
+    uint32_t num_vertices
+)
+{
+    uint32_t vertex, max_distance;
+    field->source = source;
+    max_distance = 0;
+    for (vertex = 0; vertex < num_vertices; ++vertex)
+        if (distances[vertex] != UNREACHED && distances[vertex] > max_distance)
+            max_distance = distances[vertex];
+    if (!DistanceField_alloc(field, max_distance)) return 0;
+    for (vertex = 0; vertex < num_vertices; ++vertex)
+        if (distances[vertex] != UNREACHED)
+            ++(field->within[distances[vertex] % 2][distances[vertex]]);
+    DistanceField_accumulate(field);
+    return 1;
+}
 
-            /* South */
-            if (
-                line < cb->num_lines - 1
-                && CharBuffer2D_at(cb, line + 1, col) != ROCK
-                && !AdjacencyList_add_connection(
-                    adj_list, vertex, (line + 1) * cb->num_cols + col
-                )
-            ) goto free_adj_list;
+uint64_t DistanceField_reachable(
+    struct DistanceField *field, uint64_t num_steps
+)
+{
+    if (num_steps > field->max_distance)
+        return field->within[num_steps % 2][field->max_distance];
+    return field->within[num_steps % 2][num_steps];
+}
 
-            /* West */
-            if (
-                col
-                && CharBuffer2D_at(cb, line, col - 1) != ROCK
-                && !AdjacencyList_add_connection(
-                    adj_list, vertex, line * cb->num_cols + (col - 1)
-                )
-            ) goto free_adj_list;
+struct DistanceField *FieldCache_get(
+    struct FieldCache *cache, uint32_t source
+)
+{
+    struct DistanceField *field;
+    uint32_t i;
+    for (i = 0; i < cache->length; ++i)
+        if (cache->fields[i].source == source)
+            return cache->fields + i;
+    if (cache->length == MAX_FIELDS) {
+        puts("FieldCache full");
+        return NULL;
+    }
+    field = cache->fields + cache->length;
+    Garden_bfs(cache->garden, source, cache->distances, &(cache->queue));
+    if (
+        !DistanceField_from_distances(
+            field, source, cache->distances, cache->garden->num_vertices
+        )
+    )
+        return NULL;
+    ++(cache->length);
+    return field;
+}
 
-            /* East */
-            if (
-                col < cb->num_cols - 1
-                && CharBuffer2D_at(cb, line, col + 1) != ROCK
-                && !AdjacencyList_add_connection(
-                    adj_list, vertex, line * cb->num_cols + (col + 1)
-                )
-            ) goto free_adj_list;
+void *FieldWorker_run(void *arg)
+{
+    struct FieldWorker *worker;
+    uint32_t i;
+    worker = arg;
+    worker->success = 1;
+    for (i = worker->offset; i < worker->num_sources; i += worker->stride) {
+        Garden_bfs(
+            worker->garden, worker->sources[i],
+            worker->distances, &(worker->queue)
+        );
+        if (
+            !DistanceField_from_distances(
+                worker->fields + i, worker->sources[i],
+                worker->distances, worker->garden->num_vertices
+            )
+        ) {
+            worker->success = 0;
+            return NULL;
         }
     }
-    CharBuffer2D_free(cb);
-    return adj_list;
-
-free_adj_list:
-    AdjacencyList_free(adj_list);
-free_cb:
-    CharBuffer2D_free(cb);
-error:
     return NULL;
 }
 
-uint64_t dijkstra(
-    struct AdjacencyList *adj_list, uint32_t start_vertex, uint32_t num_steps
+/*
+ * Fills the cache with the fields for every source not already in it,
+ * searching them concurrently on a read only garden. Each worker has its
+ * own distances and queue and writes to its own cache slots.
+ */
+int FieldCache_prefetch(
+    struct FieldCache *cache, uint32_t *sources, uint32_t num_sources
 )
 {
-    struct PriorityQueue *queue;
-    struct AdjListNode *node;
-    struct QueueItem item;
-    uint32_t vertex;
-    uint64_t reachable, *distances, new_distance;
-    int result;
-
-    distances = malloc(adj_list->num_vertices * sizeof(*distances));
-    if (!distances) goto error_create_distances;
-    for (vertex = 0; vertex < adj_list->num_vertices; ++vertex)
-        distances[vertex] = INFINITY;
-
-    queue = PriorityQueue_create(adj_list->num_vertices / 2);
-    if (!queue) goto error_create_queue;
-
-    item = (struct QueueItem) {
-        .distance = 0,
-        .vertex = start_vertex
-    };
-
-    result = PriorityQueue_enqueue(queue, item);
-    if (!result) goto error_enqueue;
-
-    while (PriorityQueue_dequeue(queue, &item)) {
-        vertex = item.vertex;
-        node = adj_list->vertices[vertex];
-
-        while (node) {
-            new_distance = item.distance + 1;
-            if (new_distance < distances[node->vertex]) {
-                distances[node->vertex] = new_distance;
-                result = PriorityQueue_enqueue(
-                    queue,
-                    (struct QueueItem) {
-                        .distance = new_distance,
-                        .vertex = node->vertex
-                    }
-                );
-                if (!result) goto error_enqueue;
-            }
-            node = node->next;
+    struct FieldWorker workers[NUM_THREADS];
+    uint32_t missing[MAX_FIELDS], num_missing, num_workers, i, j;
+    struct DistanceField *fields;
+    int success;
+
+    for (i = num_missing = 0; i < num_sources; ++i) {
+        for (j = 0; j < cache->length; ++j)
+            if (cache->fields[j].source == sources[i]) break;
+        if (j < cache->length) continue;
+        for (j = 0; j < num_missing; ++j)
+            if (missing[j] == sources[i]) break;
+        if (j < num_missing) continue;
+        if (cache->length + num_missing == MAX_FIELDS) {
+            puts("FieldCache full");
+            return 0;
         }
+        missing[num_missing++] = sources[i];
     }
-    reachable = 0;
-    for (vertex = 0; vertex < adj_list->num_vertices; ++vertex)
-        if (
-            distances[vertex] == num_steps
-            || (
-                distances[vertex] < num_steps
-                && distances[vertex] % 2 == num_steps % 2
-            )
-        )
-            ++reachable;
-    free(distances);
-    PriorityQueue_free(queue);
-    return reachable;
+    fields = cache->fields + cache->length;
+    for (i = 0; i < num_missing; ++i)
+        fields[i].within[0] = NULL;
+    num_workers = num_missing < NUM_THREADS ? num_missing : NUM_THREADS;
+    success = 1;
+    for (i = 0; i < num_workers; ++i) {
+        workers[i] = (struct FieldWorker) {
+            .garden = cache->garden,
+            .sources = missing,
+            .fields = fields,
+            .num_sources = num_missing,
+            .offset = i,
+            .stride = num_workers,
+            .distances = malloc(
+                2 * cache->garden->num_vertices * sizeof(uint32_t)
+            ),
+            .success = 0,
+            .started = 0
+        };
+        if (!workers[i].distances) {
+            perror("malloc");
+            puts("Failed to allocate worker distances");
+            success = 0;
+            num_workers = i;
+            break;
+        }
+        workers[i].queue = (struct RingQueue) {
+            .items = workers[i].distances + cache->garden->num_vertices,
+            .head = 0,
+            .length = 0,
+            .capacity = cache->garden->num_vertices
+        };
+        workers[i].started = pthread_create(
+            &(workers[i].thread), NULL, FieldWorker_run, workers + i
+        ) == 0;
+        /* Not fatal, just lose the parallelism for this one */
+        if (!workers[i].started)
+            FieldWorker_run(workers + i);
+    }
+    for (i = 0; i < num_workers; ++i) {
+        if (workers[i].started)
+            pthread_join(workers[i].thread, NULL);
+        free(workers[i].distances);
+        success = success && workers[i].success;
+    }
+    if (!success) {
+        for (i = 0; i < num_missing; ++i)
+            free(fields[i].within[0]);
+        return 0;
+    }
+    cache->length += num_missing;
+    return 1;
+}
 
-error_create_distances:
-    perror("malloc");
-    puts("Failed to allocate distances array");
-    goto error;
-error_create_queue:
-    puts("Failed to create PriorityQueue");
-    goto free_distances;
-error_enqueue:
-    puts("Failed to enqueue item");
-    goto free_queue;
-free_queue:
-    PriorityQueue_free(queue);
-free_distances:
-    free(distances);
-error:
-    return 0;
+/* Tiles reachable from source in exactly num_steps steps */
+uint64_t FieldCache_reachable(
+    struct FieldCache *cache, uint32_t source, uint32_t num_steps
+)
+{
+    struct DistanceField *field;
+    field = FieldCache_get(cache, source);
+    if (!field) return 0;
+    return DistanceField_reachable(field, num_steps);
 }
 
-uint64_t get_odd_points(struct AdjacencyList *adj_list, uint64_t total_steps)
+uint64_t get_odd_points(struct FieldCache *cache, uint64_t total_steps)
 {
+    struct Garden *garden;
     uint32_t num_steps;
     uint64_t num_odd_grids, grid_width, reachable;
-    grid_width = total_steps / adj_list->num_cols - 1;
+    garden = cache->garden;
+    grid_width = total_steps / garden->num_cols - 1;
     num_odd_grids = ((grid_width / 2) * 2 + 1) * ((grid_width / 2) * 2 + 1);
-    num_steps = 2 * adj_list->num_cols + 1;
-    reachable = dijkstra(adj_list, adj_list->start_vertex, num_steps);
+    num_steps = 2 * garden->num_cols + 1;
+    reachable = FieldCache_reachable(cache, garden->start_vertex, num_steps);
     return num_odd_grids * reachable;
 }
 
-uint64_t get_even_points(struct AdjacencyList *adj_list, uint64_t total_steps)
+uint64_t get_even_points(struct FieldCache *cache, uint64_t total_steps)
 {
+    struct Garden *garden;
     uint32_t num_steps;
     uint64_t num_even_grids, grid_width, reachable;
-    grid_width = total_steps / adj_list->num_cols - 1;
+    garden = cache->garden;
+    grid_width = total_steps / garden->num_cols - 1;
     num_even_grids = (
         (((grid_width + 1) / 2) * 2)
         * (((grid_width + 1) / 2) * 2)
     );
-    num_steps = 2 * adj_list->num_cols;
-    reachable = dijkstra(adj_list, adj_list->start_vertex, num_steps);
+    num_steps = 2 * garden->num_cols;
+    reachable = FieldCache_reachable(cache, garden->start_vertex, num_steps);
     return num_even_grids * reachable;
 }
 
-uint64_t get_corners(struct AdjacencyList *adj_list)
+uint64_t get_corners(struct FieldCache *cache)
 {
+    struct Garden *garden;
     uint32_t num_steps, start_line, start_col, start_vertex;
     uint64_t total;
-    num_steps = adj_list->num_cols - 1;
+    garden = cache->garden;
+    num_steps = garden->num_cols - 1;
 
     total = 0;
     /* top */
-    start_line = adj_list->num_lines - 1;
-    start_col = adj_list->num_cols / 2;
-    start_vertex = start_line * adj_list->num_cols + start_col;
-    total = total + dijkstra(adj_list, start_vertex, num_steps);
+    start_line = garden->num_lines - 1;
+    start_col = garden->num_cols / 2;
+    start_vertex = start_line * garden->num_cols + start_col;
+    total = total + FieldCache_reachable(cache, start_vertex, num_steps);
 
     /* right */
-    start_line = adj_list->num_lines / 2;
+    start_line = garden->num_lines / 2;
     start_col = 0;
-    start_vertex = start_line * adj_list->num_cols + start_col;
-    total = total + dijkstra(adj_list, start_vertex, num_steps);
+    start_vertex = start_line * garden->num_cols + start_col;
+    total = total + FieldCache_reachable(cache, start_vertex, num_steps);
 
     /* bottom */
     start_line = 0;
-    start_col = adj_list->num_cols / 2;
-    start_vertex = start_line * adj_list->num_cols + start_col;
-    total = total + dijkstra(adj_list, start_vertex, num_steps);
+    start_col = garden->num_cols / 2;
+    start_vertex = start_line * garden->num_cols + start_col;
+    total = total + FieldCache_reachable(cache, start_vertex, num_steps);
 
     /* left */
-    start_line = adj_list->num_lines / 2;
-    start_col = adj_list->num_cols - 1;
-    start_vertex = start_line * adj_list->num_cols + start_col;
-    total = total + dijkstra(adj_list, start_vertex, num_steps);
+    start_line = garden->num_lines / 2;
+    start_col = garden->num_cols - 1;
+    start_vertex = start_line * garden->num_cols + start_col;
+    total = total + FieldCache_reachable(cache, start_vertex, num_steps);
 
     return total;
 }
 
-uint64_t get_small(struct AdjacencyList *adj_list, uint64_t total_steps)
+uint64_t get_small(struct FieldCache *cache, uint64_t total_steps)
 {
+    struct Garden *garden;
     uint64_t total, num_small, grid_width;
     uint32_t start_line, start_col, start_vertex, num_steps;
-    grid_width = total_steps / adj_list->num_cols - 1;
+    garden = cache->garden;
+    grid_width = total_steps / garden->num_cols - 1;
     num_small = grid_width + 1;
-    num_steps = adj_list->num_cols / 2 - 1;
+    num_steps = garden->num_cols / 2 - 1;
 
     total = 0;
     /* top-right */
-    start_line = adj_list->num_lines - 1;
+    start_line = garden->num_lines - 1;
     start_col = 0;
-    start_vertex = start_line * adj_list->num_cols + start_col;
-    total = total + dijkstra(adj_list, start_vertex, num_steps);
+    start_vertex = start_line * garden->num_cols + start_col;
+    total = total + FieldCache_reachable(cache, start_vertex, num_steps);
 
     /* top-left */
-    start_line = adj_list->num_lines - 1;
-    start_col = adj_list->num_cols - 1;
-    start_vertex = start_line * adj_list->num_cols + start_col;
-    total = total + dijkstra(adj_list, start_vertex, num_steps);
+    start_line = garden->num_lines - 1;
+    start_col = garden->num_cols - 1;
+    start_vertex = start_line * garden->num_cols + start_col;
+    total = total + FieldCache_reachable(cache, start_vertex, num_steps);
 
     /* bottom-right */
     start_line = 0;
     start_col = 0;
-    start_vertex = start_line * adj_list->num_cols + start_col;
-    total = total + dijkstra(adj_list, start_vertex, num_steps);
+    start_vertex = start_line * garden->num_cols + start_col;
+    total = total + FieldCache_reachable(cache, start_vertex, num_steps);
 
     /* bottom-left */
     start_line = 0;
-    start_col = adj_list->num_cols - 1;
-    start_vertex = start_line * adj_list->num_cols + start_col;
-    total = total + dijkstra(adj_list, start_vertex, num_steps);
+    start_col = garden->num_cols - 1;
+    start_vertex = start_line * garden->num_cols + start_col;
+    total = total + FieldCache_reachable(cache, start_vertex, num_steps);
 
     return total * num_small;
 }
 
-uint64_t get_large(struct AdjacencyList *adj_list, uint64_t total_steps)
+uint64_t get_large(struct FieldCache *cache, uint64_t total_steps)
 {
+    struct Garden *garden;
     uint64_t total, num_large, grid_width;
     uint32_t start_line, start_col, start_vertex, num_steps;
-    grid_width = total_steps / adj_list->num_cols - 1;
+    garden = cache->garden;
+    grid_width = total_steps / garden->num_cols - 1;
     num_large = grid_width;
-    num_steps = 3 * adj_list->num_cols / 2 - 1;
+    num_steps = 3 * garden->num_cols / 2 - 1;
 
     total = 0;
     /* top-right */
-    start_line = adj_list->num_lines - 1;
+    start_line = garden->num_lines - 1;
     start_col = 0;
-    start_vertex = start_line * adj_list->num_cols + start_col;
-    total = total + dijkstra(adj_list, start_vertex, num_steps);
+    start_vertex = start_line * garden->num_cols + start_col;
+    total = total + FieldCache_reachable(cache, start_vertex, num_steps);
 
     /* top-left */
-    start_line = adj_list->num_lines - 1;
-    start_col = adj_list->num_cols - 1;
-    start_vertex = start_line * adj_list->num_cols + start_col;
-    total = total + dijkstra(adj_list, start_vertex, num_steps);
+    start_line = garden->num_lines - 1;
+    start_col = garden->num_cols - 1;
+    start_vertex = start_line * garden->num_cols + start_col;
+    total = total + FieldCache_reachable(cache, start_vertex, num_steps);
 
     /* bottom-right */
     start_line = 0;
     start_col = 0;
-    start_vertex = start_line * adj_list->num_cols + start_col;
-    total = total + dijkstra(adj_list, start_vertex, num_steps);
+    start_vertex = start_line * garden->num_cols + start_col;
+    total = total + FieldCache_reachable(cache, start_vertex, num_steps);
 
     /* bottom-left */
     start_line = 0;
-    start_col = adj_list->num_cols - 1;
-    start_vertex = start_line * adj_list->num_cols + start_col;
-    total = total + dijkstra(adj_list, start_vertex, num_steps);
+    start_col = garden->num_cols - 1;
+    start_vertex = start_line * garden->num_cols + start_col;
+    total = total + FieldCache_reachable(cache, start_vertex, num_steps);
 
     return total * num_large;
 }
 
-int run(void)
+uint64_t tile_classes_total(struct FieldCache *cache, uint64_t total_steps)
 {
-    struct AdjacencyList *adj_list;
-    uint64_t total;
-    adj_list = gen_adj_list();
-    if (!adj_list) return 0;
-    total = (
-        get_odd_points(adj_list, NUM_STEPS)
-        + get_even_points(adj_list, NUM_STEPS)
-        + get_corners(adj_list)
-        + get_small(adj_list, NUM_STEPS)
-        + get_large(adj_list, NUM_STEPS)
+    return (
+        get_odd_points(cache, total_steps)
+        + get_even_points(cache, total_steps)
+        + get_corners(cache)
+        + get_small(cache, total_steps)
+        + get_large(cache, total_steps)
     );
-    printf("Total: %lu\n", total);
-    AdjacencyList_free(adj_list);
+}
+
+/* The start, the four edge midpoints and the four corners */
+uint32_t tile_class_sources(struct Garden *garden, uint32_t *sources)
+{
+    uint32_t last_line, last_col;
+    last_line = garden->num_lines - 1;
+    last_col = garden->num_cols - 1;
+    sources[0] = garden->start_vertex;
+    sources[1] = last_line * garden->num_cols + garden->num_cols / 2;
+    sources[2] = garden->num_lines / 2 * garden->num_cols;
+    sources[3] = garden->num_cols / 2;
+    sources[4] = garden->num_lines / 2 * garden->num_cols + last_col;
+    sources[5] = last_line * garden->num_cols;
+    sources[6] = last_line * garden->num_cols + last_col;
+    sources[7] = 0;
+    sources[8] = last_col;
+    return 9;
+}
+
+int Garden_is_open_line(struct Garden *garden, uint32_t line)
+{
+    uint32_t col;
+    for (col = 0; col < garden->num_cols; ++col)
+        if (!Garden_is_open(garden, line, col)) return 0;
+    return 1;
+}
+
+int Garden_is_open_col(struct Garden *garden, uint32_t col)
+{
+    uint32_t line;
+    for (line = 0; line < garden->num_lines; ++line)
+        if (!Garden_is_open(garden, line, col)) return 0;
+    return 1;
+}
+
+struct VertexArray *VertexArray_create(uint32_t start_capacity)
+{
+    struct VertexArray *va;
+    if (start_capacity < MIN_VERTEXARRAY)
+        start_capacity = MIN_VERTEXARRAY;
+    va = malloc(sizeof(*va));
+    if (!va) {
+        perror("malloc");
+        puts("Failed to allocate VertexArray");
+        return NULL;
+    }
+    va->vertices = malloc(start_capacity * sizeof(*(va->vertices)));
+    if (!va->vertices) {
+        perror("malloc");
+        puts("Failed to allocate VertexArray->vertices");
+        free(va);
+        return NULL;
+    }
+    va->length = 0;
+    va->capacity = start_capacity;
+    return va;
+}
+
+void VertexArray_free(struct VertexArray *va)
+{
+    if (!va) return;
+    free(va->vertices);
+    free(va);
+}
+
+int VertexArray_push(struct VertexArray *va, uint32_t vertex)
+{
+    uint32_t new_capacity, *temp;
+    if (va->length + 1 >= va->capacity) {
+        new_capacity = va->capacity << 1;
+        temp = realloc(va->vertices, new_capacity * sizeof(*temp));
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow VertexArray");
+            return 0;
+        }
+        va->vertices = temp;
+        va->capacity = new_capacity;
+    }
+    va->vertices[va->length++] = vertex;
     return 1;
 }
 
-int main(void)
+/*
+ * Breadth first over the garden tiled out to radius steps in every
+ * direction, one layer at a time so only a visited bit per tile is kept.
+ * Fills field with the reachable counts on the infinite garden.
+ */
+int tiled_field(
+    struct Garden *garden, uint32_t radius, struct DistanceField *field
+)
+{
+    struct VertexArray *layer, *next, *temp;
+    uint64_t *visited, bit;
+    uint32_t side, *line_of, *col_of, i, j, distance, vertex, neighbour;
+    uint32_t y, x;
+    int32_t moves[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+    int ret;
+
+    ret = 0;
+    side = 2 * radius + 1;
+    visited = calloc((size_t) side * side / WORD_BITS + 1, sizeof(*visited));
+    line_of = malloc(2 * side * sizeof(*line_of));
+    layer = VertexArray_create(0);
+    next = VertexArray_create(0);
+    if (!visited || !line_of || !layer || !next) {
+        perror("malloc");
+        puts("Failed to allocate tiled garden");
+        goto cleanup;
+    }
+    if (!DistanceField_alloc(field, radius)) goto cleanup;
+    field->source = garden->start_vertex;
+    col_of = line_of + side;
+    /* Position radius in the tiled square is the start tile */
+    for (i = 0; i < side; ++i) {
+        line_of[i] = (
+            garden->start_line + i
+            + garden->num_lines - radius % garden->num_lines
+        ) % garden->num_lines;
+        col_of[i] = (
+            garden->start_col + i
+            + garden->num_cols - radius % garden->num_cols
+        ) % garden->num_cols;
+    }
+    vertex = radius * side + radius;
+    visited[vertex / WORD_BITS] |= (uint64_t) 1 << (vertex % WORD_BITS);
+    if (!VertexArray_push(layer, vertex)) goto cleanup;
+    for (distance = 0; layer->length; ++distance) {
+        field->within[distance % 2][distance] = layer->length;
+        if (distance == radius) break;
+        next->length = 0;
+        for (i = 0; i < layer->length; ++i) {
+            y = layer->vertices[i] / side;
+            x = layer->vertices[i] % side;
+            for (j = 0; j < 4; ++j) {
+                /* Never leaves the square, it's radius wide on every side */
+                neighbour = (y + moves[j][0]) * side + x + moves[j][1];
+                bit = (uint64_t) 1 << (neighbour % WORD_BITS);
+                if (visited[neighbour / WORD_BITS] & bit)
+                    continue;
+                if (
+                    !Garden_is_open(
+                        garden,
+                        line_of[y + moves[j][0]],
+                        col_of[x + moves[j][1]]
+                    )
+                )
+                    continue;
+                visited[neighbour / WORD_BITS] |= bit;
+                if (!VertexArray_push(next, neighbour)) goto cleanup;
+            }
+        }
+        temp = layer;
+        layer = next;
+        next = temp;
+    }
+    DistanceField_accumulate(field);
+    ret = 1;
+cleanup:
+    if (!ret && field->within[0]) {
+        free(field->within[0]);
+        field->within[0] = NULL;
+    }
+    free(visited);
+    free(line_of);
+    VertexArray_free(layer);
+    VertexArray_free(next);
+    return ret;
+}
+
+void TiledSearch_free(struct TiledSearch *search)
+{
+    uint32_t i;
+    if (search->profiles)
+        for (i = 0; i < search->num_profiles; ++i)
+            free(search->profiles[i].within[0]);
+    free(search->profiles);
+    free(search->entries);
+    free(search->profile_ids);
+}
+
+uint64_t fnv1a(const uint32_t *values, uint32_t length)
+{
+    uint64_t hash;
+    uint32_t i;
+    hash = 14695981039346656037UL;
+    for (i = 0; i < length; ++i)
+        hash = (hash ^ values[i]) * 1099511628211UL;
+    return hash;
+}
+
+void VectorSet_free(struct VectorSet *set)
+{
+    free(set->values);
+    free(set->starts);
+    free(set->lengths);
+    free(set->slots);
+}
+
+/* Doubles the hash table, or makes the first one */
+int VectorSet_rehash(struct VectorSet *set)
+{
+    uint32_t *slots, num_slots, slot, id;
+    num_slots = set->num_slots ? 2 * set->num_slots : 2 * MIN_VECTORSET;
+    slots = malloc(num_slots * sizeof(*slots));
+    if (!slots) {
+        perror("malloc");
+        puts("Failed to grow VectorSet->slots");
+        return 0;
+    }
+    for (slot = 0; slot < num_slots; ++slot)
+        slots[slot] = NO_CLASS;
+    for (id = 0; id < set->length; ++id) {
+        slot = fnv1a(set->values + set->starts[id], set->lengths[id])
+            & (num_slots - 1);
+        while (slots[slot] != NO_CLASS)
+            slot = (slot + 1) & (num_slots - 1);
+        slots[slot] = id;
+    }
+    free(set->slots);
+    set->slots = slots;
+    set->num_slots = num_slots;
+    return 1;
+}
+
+/* Sets *id to the id of values, adding them first if they're new */
+int VectorSet_add(
+    struct VectorSet *set,
+    const uint32_t *values,
+    uint32_t length,
+    uint32_t *id
+)
+{
+    uint32_t *temp, slot, capacity;
+    size_t *starts, values_capacity;
+
+    if (2 * (set->length + 1) > set->num_slots && !VectorSet_rehash(set))
+        return 0;
+    slot = fnv1a(values, length) & (set->num_slots - 1);
+    for (
+        ;
+        (*id = set->slots[slot]) != NO_CLASS;
+        slot = (slot + 1) & (set->num_slots - 1)
+    )
+        if (
+            set->lengths[*id] == length
+            && !memcmp(
+                set->values + set->starts[*id], values,
+                length * sizeof(*values)
+            )
+        )
+            return 1;
+    if (set->length == set->capacity) {
+        capacity = set->capacity ? 2 * set->capacity : MIN_VECTORSET;
+        starts = realloc(set->starts, capacity * sizeof(*starts));
+        if (starts) set->starts = starts;
+        temp = realloc(set->lengths, capacity * sizeof(*temp));
+        if (temp) set->lengths = temp;
+        if (!starts || !temp) {
+            perror("realloc");
+            puts("Failed to grow VectorSet");
+            return 0;
+        }
+        set->capacity = capacity;
+    }
+    if (set->num_values + length > set->values_capacity) {
+        values_capacity = set->values_capacity
+            ? set->values_capacity
+            : MIN_VECTORSET;
+        while (set->num_values + length > values_capacity)
+            values_capacity *= 2;
+        temp = realloc(set->values, values_capacity * sizeof(*temp));
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow VectorSet->values");
+            return 0;
+        }
+        set->values = temp;
+        set->values_capacity = values_capacity;
+    }
+    memcpy(set->values + set->num_values, values, length * sizeof(*values));
+    *id = set->length++;
+    set->starts[*id] = set->num_values;
+    set->lengths[*id] = length;
+    set->num_values += length;
+    set->slots[slot] = *id;
+    return 1;
+}
+
+int TileHeap_push(struct TileHeap *heap, uint32_t key, uint32_t tile)
+{
+    uint64_t *temp, item;
+    uint32_t i, capacity;
+    if (heap->length == heap->capacity) {
+        capacity = heap->capacity ? 2 * heap->capacity : MIN_TILEHEAP;
+        temp = realloc(heap->items, capacity * sizeof(*temp));
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow TileHeap");
+            return 0;
+        }
+        heap->items = temp;
+        heap->capacity = capacity;
+    }
+    item = (uint64_t) key << 32 | tile;
+    for (
+        i = heap->length++;
+        i && heap->items[(i - 1) / 2] > item;
+        i = (i - 1) / 2
+    )
+        heap->items[i] = heap->items[(i - 1) / 2];
+    heap->items[i] = item;
+    return 1;
+}
+
+/* Takes the tile with the lowest key off a heap that isn't empty */
+uint32_t TileHeap_pop(struct TileHeap *heap)
+{
+    uint64_t top, last;
+    uint32_t i, child;
+    top = heap->items[0];
+    last = heap->items[--(heap->length)];
+    for (i = 0; (child = 2 * i + 1) < heap->length; i = child) {
+        if (
+            child + 1 < heap->length
+            && heap->items[child + 1] < heap->items[child]
+        )
+            ++child;
+        if (heap->items[child] >= last) break;
+        heap->items[i] = heap->items[child];
+    }
+    heap->items[i] = last;
+    return top & UINT32_MAX;
+}
+
+void TileSolver_free(struct TileSolver *solver)
+{
+    free(solver->blank);
+    free(solver->distances);
+    free(solver->layer);
+    free(solver->next);
+    free(solver->counts);
+    free(solver->outline);
+    free(solver->seeds);
+    VectorSet_free(&solver->profiles);
+    VectorSet_free(&solver->classes);
+    VectorSet_free(&solver->edges);
+    VertexArray_free(solver->side_edges);
+    VectorSet_free(&solver->keys);
+    VertexArray_free(solver->solutions);
+}
+
+/*
+ * Edge j of a class is the plots above, below, left or right of a tile in
+ * turn, and seeds edge j of the tile next to it on that side
+ */
+int TileSolver_init(struct TileSolver *solver, struct Garden *garden)
+{
+    uint32_t lines, cols, y, x, j;
+    lines = garden->num_lines;
+    cols = garden->num_cols;
+    memset(solver, 0, sizeof(*solver));
+    solver->garden = garden;
+    solver->pitch = cols + 2;
+    solver->num_plots = (lines + 2) * solver->pitch;
+    solver->perimeter = 2 * (lines + cols);
+    for (j = 0; j < 4; ++j) {
+        solver->edge_length[j] = j < 2 ? cols : lines;
+        solver->edge_start[j] = j < 2 ? j * cols : 2 * cols + (j - 2) * lines;
+        solver->plot_step[j] = j < 2 ? 1 : solver->pitch;
+    }
+    solver->first_plot[0] = solver->pitch + 1;
+    solver->first_plot[1] = lines * solver->pitch + 1;
+    solver->first_plot[2] = solver->pitch + 1;
+    solver->first_plot[3] = solver->pitch + cols;
+    solver->blank = malloc(solver->num_plots * sizeof(*(solver->blank)));
+    solver->distances = malloc(
+        solver->num_plots * sizeof(*(solver->distances))
+    );
+    solver->layer = malloc(solver->num_plots * sizeof(*(solver->layer)));
+    solver->next = malloc(solver->num_plots * sizeof(*(solver->next)));
+    solver->num_counts = solver->num_plots;
+    solver->counts = malloc(solver->num_counts * sizeof(*(solver->counts)));
+    solver->outline = malloc(
+        (solver->perimeter + 1) * sizeof(*(solver->outline))
+    );
+    solver->seeds = malloc(
+        (solver->perimeter + 1) * sizeof(*(solver->seeds))
+    );
+    solver->side_edges = VertexArray_create(0);
+    solver->solutions = VertexArray_create(0);
+    if (
+        !solver->blank || !solver->distances || !solver->layer
+        || !solver->next || !solver->counts || !solver->outline
+        || !solver->seeds || !solver->side_edges || !solver->solutions
+    ) {
+        perror("malloc");
+        puts("Failed to allocate TileSolver");
+        TileSolver_free(solver);
+        return 0;
+    }
+    for (y = 0; y < lines + 2; ++y)
+        for (x = 0; x < cols + 2; ++x)
+            solver->blank[y * solver->pitch + x] =
+                y && y <= lines && x && x <= cols
+                && Garden_is_open(garden, y - 1, x - 1)
+                    ? UNREACHED
+                    : CLOSED;
+    return 1;
+}
+
+/*
+ * Seeds can reach a pocket of the tile cut off from the rest long after
+ * its entry, so counts grows to cover offset past it
+ */
+int TileSolver_widen(struct TileSolver *solver, uint32_t offset)
+{
+    uint32_t *temp, num_counts;
+    for (
+        num_counts = solver->num_counts;
+        offset >= num_counts;
+        num_counts *= 2
+    );
+    temp = realloc(solver->counts, num_counts * sizeof(*temp));
+    if (!temp) {
+        perror("realloc");
+        puts("Failed to grow TileSolver->counts");
+        return 0;
+    }
+    memset(
+        temp + solver->num_counts, 0,
+        (num_counts - solver->num_counts) * sizeof(*temp)
+    );
+    solver->counts = temp;
+    solver->num_counts = num_counts;
+    return 1;
+}
+
+/*
+ * Files the edges of the class just added, counts being free again by
+ * then. Edge j is seen from the tile next to it across plots on edge
+ * j ^ 1 of that tile.
+ */
+int TileSolver_add_sides(struct TileSolver *solver)
+{
+    uint32_t *edge, j, k, nearest, id;
+    edge = solver->counts;
+    for (j = 0; j < 4; ++j) {
+        nearest = UNREACHED;
+        for (k = 0; k < solver->edge_length[j]; ++k) {
+            edge[k] = solver->blank[
+                solver->first_plot[j ^ 1] + k * solver->plot_step[j ^ 1]
+            ] == CLOSED
+                ? UNREACHED
+                : solver->outline[solver->edge_start[j] + k];
+            if (edge[k] < nearest) nearest = edge[k];
+        }
+        for (k = 0; k < solver->edge_length[j]; ++k)
+            if (edge[k] != UNREACHED) edge[k] -= nearest;
+        if (
+            !VectorSet_add(&solver->edges, edge, solver->edge_length[j], &id)
+            || !VertexArray_push(solver->side_edges, id)
+            || !VertexArray_push(solver->side_edges, nearest)
+        )
+            return 0;
+    }
+    return 1;
+}
+
+int compare_uint64(const void *a, const void *b)
+{
+    uint64_t x, y;
+    x = *(const uint64_t *) a;
+    y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Breadth first from every seed, each joining once the layers get to its
+ * distance. Sets *id to the class of the tile, NO_CLASS when nothing gets
+ * in, and *entry to its entry.
+ */
+int TileSolver_fill(
+    struct TileSolver *solver,
+    uint32_t num_seeds,
+    uint32_t *id,
+    uint32_t *entry
+)
+{
+    uint32_t *distances, *temp, layer_length, next_length, i, j, k;
+    uint32_t plot, neighbour, distance, max_offset;
+    int32_t moves[4];
+
+    *id = NO_CLASS;
+    *entry = 0;
+    if (!num_seeds) return 1;
+    max_offset = 0;
+    distances = solver->distances;
+    moves[0] = -(int32_t) solver->pitch;
+    moves[1] = (int32_t) solver->pitch;
+    moves[2] = -1;
+    moves[3] = 1;
+    qsort(solver->seeds, num_seeds, sizeof(*(solver->seeds)), compare_uint64);
+    *entry = solver->seeds[0] >> 32;
+    memcpy(
+        distances, solver->blank, solver->num_plots * sizeof(*distances)
+    );
+    memset(solver->counts, 0, solver->num_counts * sizeof(*(solver->counts)));
+    layer_length = 0;
+    for (
+        i = 0, distance = solver->seeds[0] >> 32;
+        layer_length || i < num_seeds;
+        ++distance
+    ) {
+        if (!layer_length) distance = solver->seeds[i] >> 32;
+        for (; i < num_seeds && solver->seeds[i] >> 32 == distance; ++i) {
+            plot = solver->seeds[i] & UINT32_MAX;
+            if (distances[plot] != UNREACHED) continue;
+            distances[plot] = distance;
+            solver->layer[layer_length++] = plot;
+        }
+        if (
+            distance - *entry >= solver->num_counts
+            && !TileSolver_widen(solver, distance - *entry)
+        )
+            return 0;
+        solver->counts[distance - *entry] = layer_length;
+        if (layer_length) max_offset = distance - *entry;
+        next_length = 0;
+        for (k = 0; k < layer_length; ++k)
+            for (j = 0; j < 4; ++j) {
+                neighbour = solver->layer[k] + moves[j];
+                if (distances[neighbour] != UNREACHED) continue;
+                distances[neighbour] = distance + 1;
+                solver->next[next_length++] = neighbour;
+            }
+        temp = solver->layer;
+        solver->layer = solver->next;
+        solver->next = temp;
+        layer_length = next_length;
+    }
+
+    for (j = 0; j < 4; ++j)
+        for (k = 0; k < solver->edge_length[j]; ++k) {
+            plot = solver->first_plot[j] + k * solver->plot_step[j];
+            solver->outline[solver->edge_start[j] + k] =
+                distances[plot] >= CLOSED
+                    ? UNREACHED
+                    : distances[plot] - *entry;
+        }
+    if (
+        !VectorSet_add(
+            &solver->profiles, solver->counts, max_offset + 1,
+            solver->outline + solver->perimeter
+        )
+        || !VectorSet_add(
+            &solver->classes, solver->outline, solver->perimeter + 1, id
+        )
+    )
+        return 0;
+    return 8 * *id < solver->side_edges->length
+        || TileSolver_add_sides(solver);
+}
+
+/*
+ * Solves the tile for key: whether it holds the start, then the edges
+ * that face it from the tiles above, below, left and right of it and
+ * when their nearest plots are reached, past the earliest of them, with
+ * NO_CLASS for those not reached. Each distinct key is only ever solved
+ * once.
+ */
+int TileSolver_solve(
+    struct TileSolver *solver,
+    const uint32_t *key,
+    uint32_t *id,
+    uint32_t *entry
+)
+{
+    struct Garden *garden;
+    const uint32_t *edge;
+    uint32_t memo, num_seeds, j, k, plot;
+
+    if (!VectorSet_add(&solver->keys, key, KEY_LENGTH, &memo)) return 0;
+    if (2 * memo < solver->solutions->length) {
+        *id = solver->solutions->vertices[2 * memo];
+        *entry = solver->solutions->vertices[2 * memo + 1];
+        return 1;
+    }
+    garden = solver->garden;
+    num_seeds = 0;
+    if (key[0])
+        solver->seeds[num_seeds++] = (garden->start_line + 1) * solver->pitch
+            + garden->start_col + 1;
+    for (j = 0; j < 4; ++j) {
+        if (key[1 + 2 * j] == NO_CLASS) continue;
+        edge = solver->edges.values + solver->edges.starts[key[1 + 2 * j]];
+        for (k = 0; k < solver->edge_length[j]; ++k) {
+            if (edge[k] == UNREACHED) continue;
+            plot = solver->first_plot[j] + k * solver->plot_step[j];
+            solver->seeds[num_seeds++] =
+                (uint64_t) (key[2 + 2 * j] + edge[k] + 1) << 32 | plot;
+        }
+    }
+    return TileSolver_fill(solver, num_seeds, id, entry)
+        && VertexArray_push(solver->solutions, *id)
+        && VertexArray_push(solver->solutions, *entry);
+}
+
+/* Rings of tiles are diamonds, as far out as the steps to cross them */
+uint32_t TiledSearch_ring(struct TiledSearch *search, uint32_t tile)
+{
+    uint32_t line, col;
+    line = tile / search->side;
+    col = tile % search->side;
+    line = line < search->radius
+        ? search->radius - line
+        : line - search->radius;
+    col = col < search->radius ? search->radius - col : col - search->radius;
+    return line + col;
+}
+
+/*
+ * Rings that fit in the diamond and whose plots all lie within
+ * exact_distance can be trusted
+ */
+int TiledSearch_trust(struct TiledSearch *search)
+{
+    uint64_t *furthest, reach;
+    uint32_t tile, ring;
+    search->trusted_rings = search->radius + 1;
+    if (search->exact_distance == UNREACHED) return 1;
+    furthest = calloc(search->radius + 1, sizeof(*furthest));
+    if (!furthest) {
+        perror("calloc");
+        puts("Failed to allocate ring distances");
+        return 0;
+    }
+    for (tile = 0; tile < search->side * search->side; ++tile) {
+        if (search->entries[tile] == UNREACHED) continue;
+        reach = (uint64_t) search->entries[tile]
+            + search->profiles[search->profile_ids[tile]].max_distance;
+        ring = TiledSearch_ring(search, tile);
+        if (ring <= search->radius && reach > furthest[ring])
+            furthest[ring] = reach;
+    }
+    for (ring = 0; ring <= search->radius; ++ring)
+        if (furthest[ring] > search->exact_distance) break;
+    search->trusted_rings = ring;
+    free(furthest);
+    return 1;
+}
+
+/* The tile above, below, left or right of tile, UNREACHED off the diamond */
+uint32_t TiledSearch_neighbour(
+    struct TiledSearch *search, uint32_t tile, uint32_t side
+)
+{
+    int32_t moves[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+    uint32_t line, col;
+    line = tile / search->side + moves[side][0];
+    col = tile % search->side + moves[side][1];
+    if (line >= search->side || col >= search->side) return UNREACHED;
+    tile = line * search->side + col;
+    return TiledSearch_ring(search, tile) <= search->radius
+        ? tile
+        : UNREACHED;
+}
+
+/*
+ * Gives every reached tile the id of its profile, turning the profiles
+ * that are used into DistanceFields whose source is the first tile with
+ * them
+ */
+int TiledSearch_profile(
+    struct TiledSearch *search,
+    struct TileSolver *solver,
+    const uint32_t *classes
+)
+{
+    uint32_t *field_of, tile, profile, length, d;
+    const uint32_t *counts;
+    struct DistanceField *field;
+
+    field_of = malloc(solver->profiles.length * sizeof(*field_of));
+    search->profiles = malloc(
+        solver->profiles.length * sizeof(*(search->profiles))
+    );
+    if (!field_of || !search->profiles) {
+        perror("malloc");
+        puts("Failed to allocate tile profiles");
+        free(field_of);
+        return 0;
+    }
+    for (profile = 0; profile < solver->profiles.length; ++profile)
+        field_of[profile] = NO_PROFILE;
+    for (tile = 0; tile < search->side * search->side; ++tile) {
+        if (classes[tile] == NO_CLASS) continue;
+        profile = solver->classes.values[
+            solver->classes.starts[classes[tile]] + solver->perimeter
+        ];
+        if (field_of[profile] == NO_PROFILE) {
+            field = search->profiles + search->num_profiles;
+            counts = solver->profiles.values
+                + solver->profiles.starts[profile];
+            length = solver->profiles.lengths[profile];
+            if (!DistanceField_alloc(field, length - 1)) {
+                free(field_of);
+                return 0;
+            }
+            field->source = tile;
+            for (d = 0; d < length; ++d)
+                field->within[d % 2][d] = counts[d];
+            DistanceField_accumulate(field);
+            field_of[profile] = search->num_profiles++;
+        }
+        search->profile_ids[tile] = field_of[profile];
+    }
+    free(field_of);
+    return 1;
+}
+
+/*
+ * Shortest paths over the diamond of tiles radius rings out from the
+ * start tile, a tile at a time. Solving a tile again from the latest
+ * edges of the tiles next to it can only bring its distances down, so
+ * the tiles that change queue up the ones next to them again, earliest
+ * entry first, until nothing does. That leaves the distances within the
+ * diamond, and nothing can have been cut off by its edge before its
+ * outermost ring was entered, so rings of tiles done by then are exact.
+ */
+int TiledSearch_run(
+    struct TiledSearch *search, struct TileSolver *solver, uint32_t radius
+)
+{
+    struct TileHeap heap;
+    uint32_t *classes, num_tiles, centre, tile, base, id, entry;
+    uint32_t neighbours[4], reached[4], key[KEY_LENGTH], j;
+    const uint32_t *side;
+    int ret;
+
+    ret = 0;
+    *search = (struct TiledSearch) {
+        .radius = radius,
+        .side = 2 * radius + 1,
+        .entries = NULL,
+        .profile_ids = NULL,
+        .profiles = NULL,
+        .num_profiles = 0,
+        .exact_distance = UNREACHED,
+        .trusted_rings = 0
+    };
+    heap = (struct TileHeap) { .items = NULL, .length = 0, .capacity = 0 };
+    num_tiles = search->side * search->side;
+    classes = malloc(num_tiles * sizeof(*classes));
+    search->entries = malloc(num_tiles * sizeof(*(search->entries)));
+    search->profile_ids = malloc(
+        num_tiles * sizeof(*(search->profile_ids))
+    );
+    if (!classes || !search->entries || !search->profile_ids) {
+        perror("malloc");
+        puts("Failed to allocate tiled search");
+        goto cleanup;
+    }
+    for (tile = 0; tile < num_tiles; ++tile) {
+        classes[tile] = NO_CLASS;
+        search->entries[tile] = UNREACHED;
+        search->profile_ids[tile] = NO_PROFILE;
+    }
+
+    centre = radius * search->side + radius;
+    if (!TileHeap_push(&heap, 0, centre)) goto cleanup;
+    while (heap.length) {
+        tile = TileHeap_pop(&heap);
+        base = tile == centre ? 0 : UNREACHED;
+        key[0] = tile == centre;
+        for (j = 0; j < 4; ++j) {
+            neighbours[j] = TiledSearch_neighbour(search, tile, j);
+            reached[j] = UNREACHED;
+            key[1 + 2 * j] = NO_CLASS;
+            if (
+                neighbours[j] == UNREACHED
+                || classes[neighbours[j]] == NO_CLASS
+            )
+                continue;
+            side = solver->side_edges->vertices
+                + 8 * classes[neighbours[j]] + 2 * (j ^ 1);
+            if (side[1] == UNREACHED) continue;
+            key[1 + 2 * j] = side[0];
+            reached[j] = search->entries[neighbours[j]] + side[1];
+            if (reached[j] < base) base = reached[j];
+        }
+        if (base == UNREACHED) continue;
+        for (j = 0; j < 4; ++j)
+            key[2 + 2 * j] = reached[j] == UNREACHED ? 0 : reached[j] - base;
+        if (!TileSolver_solve(solver, key, &id, &entry)) goto cleanup;
+        entry += base;
+        if (
+            id == NO_CLASS
+            || (id == classes[tile] && entry == search->entries[tile])
+        )
+            continue;
+        classes[tile] = id;
+        search->entries[tile] = entry;
+        for (j = 0; j < 4; ++j) {
+            side = solver->side_edges->vertices + 8 * id + 2 * j;
+            if (
+                neighbours[j] != UNREACHED
+                && side[1] != UNREACHED
+                && !TileHeap_push(&heap, entry + side[1] + 1, neighbours[j])
+            )
+                goto cleanup;
+        }
+    }
+
+    for (tile = 0; tile < num_tiles; ++tile)
+        if (
+            search->entries[tile] < search->exact_distance
+            && TiledSearch_ring(search, tile) == radius
+        )
+            search->exact_distance = search->entries[tile];
+    ret = TiledSearch_profile(search, solver, classes)
+        && TiledSearch_trust(search);
+cleanup:
+    if (!ret) TiledSearch_free(search);
+    free(heap.items);
+    free(classes);
+    return ret;
+}
+
+/* Plots reachable in exactly total_steps steps over the first rings */
+uint128_t TiledSearch_count(
+    struct TiledSearch *search, uint32_t rings, uint64_t total_steps
+)
+{
+    uint128_t total;
+    uint32_t tile;
+    total = 0;
+    for (tile = 0; tile < search->side * search->side; ++tile)
+        if (
+            search->entries[tile] != UNREACHED
+            && search->entries[tile] <= total_steps
+            && TiledSearch_ring(search, tile) < rings
+        )
+            total += DistanceField_reachable(
+                search->profiles + search->profile_ids[tile],
+                total_steps - search->entries[tile]
+            );
+    return total;
+}
+
+/*
+ * Every ring of tiles splits into eight lines, two per quarter, each
+ * walked from an axis out to the diagonal. Octant 0 starts on the axis
+ * right of the start tile and walks down, octant 1 starts just right of
+ * the axis below it and walks right, and the rest are those turned a
+ * quarter at a time.
+ */
+uint64_t octant_line_length(uint32_t octant, uint64_t ring)
+{
+    return octant % 2 ? ring / 2 : (ring + 1) / 2;
+}
+
+uint32_t TiledSearch_tile(
+    struct TiledSearch *search,
+    uint32_t octant,
+    uint32_t ring,
+    uint32_t position
+)
+{
+    int64_t line, col, temp;
+    uint32_t k;
+    if (octant % 2) {
+        line = (int64_t) ring - 1 - position;
+        col = (int64_t) position + 1;
+    } else {
+        line = position;
+        col = (int64_t) ring - position;
+    }
+    for (k = 0; k < octant / 2; ++k) {
+        temp = line;
+        line = col;
+        col = -temp;
+    }
+    return (line + search->radius) * search->side + col + search->radius;
+}
+
+struct RunArray *RunArray_create(uint32_t start_capacity)
+{
+    struct RunArray *ra;
+    if (start_capacity < MIN_RUNARRAY)
+        start_capacity = MIN_RUNARRAY;
+    ra = malloc(sizeof(*ra));
+    if (!ra) {
+        perror("malloc");
+        puts("Failed to allocate RunArray");
+        return NULL;
+    }
+    ra->runs = malloc(start_capacity * sizeof(*(ra->runs)));
+    if (!ra->runs) {
+        perror("malloc");
+        puts("Failed to allocate RunArray->runs");
+        free(ra);
+        return NULL;
+    }
+    ra->length = 0;
+    ra->capacity = start_capacity;
+    return ra;
+}
+
+void RunArray_free(struct RunArray *ra)
+{
+    if (!ra) return;
+    free(ra->runs);
+    free(ra);
+}
+
+int RunArray_push(struct RunArray *ra, struct TileRun run)
+{
+    uint32_t new_capacity;
+    struct TileRun *temp;
+    if (ra->length + 1 >= ra->capacity) {
+        new_capacity = ra->capacity << 1;
+        temp = realloc(ra->runs, new_capacity * sizeof(*temp));
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow RunArray");
+            return 0;
+        }
+        ra->runs = temp;
+        ra->capacity = new_capacity;
+    }
+    ra->runs[ra->length++] = run;
+    return 1;
+}
+
+/* Splits one line of the octant into runs */
+int RunArray_from_line(
+    struct RunArray *ra,
+    struct TiledSearch *search,
+    uint32_t octant,
+    uint32_t ring
+)
+{
+    struct TileRun *run;
+    uint32_t position, tile, profile;
+    int64_t entry;
+    ra->length = 0;
+    for (
+        position = 0;
+        position < octant_line_length(octant, ring);
+        ++position
+    ) {
+        tile = TiledSearch_tile(search, octant, ring, position);
+        profile = search->profile_ids[tile];
+        entry = search->entries[tile];
+        run = ra->length ? ra->runs + ra->length - 1 : NULL;
+        if (run && run->profile == profile) {
+            /* Unreached tiles all look alike whatever their entry */
+            if (profile == NO_PROFILE) {
+                ++(run->length);
+                continue;
+            }
+            if (run->length == 1) {
+                run->step = entry - run->entry;
+                ++(run->length);
+                continue;
+            }
+            if (entry - run->entry == run->step * run->length) {
+                ++(run->length);
+                continue;
+            }
+        }
+        if (
+            !RunArray_push(ra, (struct TileRun) {
+                .profile = profile,
+                .entry = entry,
+                .step = 0,
+                .start = position,
+                .length = 1,
+                .entry_growth = 0
+            })
+        )
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Plots reachable in exactly total_steps steps over a run of tiles. Tiles
+ * entered long enough before are full and only alternate with the parity
+ * of their entry, so only the last few are looked up one at a time.
+ */
+uint128_t TileRun_reachable(
+    struct DistanceField *field,
+    int64_t entry,
+    int64_t step,
+    int64_t length,
+    uint64_t total_steps
+)
+{
+    uint128_t total;
+    uint64_t full[2];
+    int64_t budget, num_reached, num_full, k;
+    if (step < 0) {
+        entry += step * (length - 1);
+        step = -step;
+    }
+    if (entry > (int64_t) total_steps) return 0;
+    budget = total_steps - entry;
+    if (!step)
+        return (uint128_t) length * DistanceField_reachable(field, budget);
+    num_reached = budget / step + 1;
+    if (num_reached > length) num_reached = length;
+    num_full = budget < field->max_distance
+        ? 0
+        : (budget - field->max_distance) / step + 1;
+    if (num_full > num_reached) num_full = num_reached;
+    full[0] = field->within[budget % 2][field->max_distance];
+    full[1] = field->within[(budget + 1) % 2][field->max_distance];
+    /* An odd step flips the parity of the budget from tile to tile */
+    if (step % 2)
+        total = (uint128_t) ((num_full + 1) / 2) * full[0]
+            + (uint128_t) (num_full / 2) * full[1];
+    else
+        total = (uint128_t) num_full * full[0];
+    for (k = num_full; k < num_reached; ++k)
+        total += DistanceField_reachable(field, budget - k * step);
+    return total;
+}
+
+/*
+ * Index of the only run of the line with that profile and step that is
+ * longer than a tile, NO_RUN if there are none or several
+ */
+uint32_t RunArray_find(
+    const struct RunArray *ra, uint32_t profile, int64_t step
+)
+{
+    const struct TileRun *run;
+    uint32_t i, found;
+    found = NO_RUN;
+    for (i = 0; i < ra->length; ++i) {
+        run = ra->runs + i;
+        if (run->length < 2 || run->profile != profile || run->step != step)
+            continue;
+        if (found != NO_RUN) return NO_RUN;
+        found = i;
+    }
+    return found;
+}
+
+/* What position 0 of the line would be entered at if it were in the run */
+int64_t TileRun_base(const struct TileRun *run)
+{
+    return run->entry - run->step * run->start;
+}
+
+void OctantModel_free(struct OctantModel *model)
+{
+    if (!model) return;
+    free(model->regions);
+    free(model->periods);
+    free(model->bands);
+    RunArray_free(model->runs);
+    free(model);
+}
+
+/* Room for every run of the lines up to ring to be a candidate region */
+struct OctantModel *OctantModel_create(
+    uint32_t octant, uint32_t ring, uint32_t num_runs
+)
+{
+    struct OctantModel *model;
+    model = malloc(sizeof(*model));
+    if (!model) {
+        perror("malloc");
+        puts("Failed to allocate OctantModel");
+        return NULL;
+    }
+    *model = (struct OctantModel) {
+        .octant = octant,
+        .ring = ring,
+        .regions = malloc((num_runs + 1) * sizeof(*(model->regions))),
+        .num_regions = 0,
+        .periods = malloc(2 * (num_runs + 1) * sizeof(*(model->periods))),
+        .first_band = NULL,
+        .bands = NULL,
+        .runs = RunArray_create(0)
+    };
+    if (!model->regions || !model->periods || !model->runs) {
+        perror("malloc");
+        puts("Failed to allocate OctantModel");
+        OctantModel_free(model);
+        return NULL;
+    }
+    model->first_band = model->periods + num_runs + 1;
+    return model;
+}
+
+/*
+ * Finds band k of a line from where the regions are in it, found, as the
+ * runs from *first to *end and the position *start they start at
+ */
+void OctantModel_band(
+    const struct OctantModel *model,
+    const struct RunArray *line,
+    const uint32_t *found,
+    uint32_t k,
+    uint32_t *first,
+    uint32_t *end,
+    int64_t *start
+)
+{
+    const struct TileRun *before;
+    *first = k ? found[k - 1] + 1 : 0;
+    *end = k < model->num_regions ? found[k] : line->length;
+    before = *first ? line->runs + *first - 1 : NULL;
+    *start = before ? before->start + before->length : 0;
+}
+
+/*
+ * Fits the entries of a region to the two outermost lines from ring down
+ * to lowest where it is longer than a tile. Returns 0 if there aren't two
+ * or they don't give a whole number of steps per ring. Unreached tiles
+ * have no entries to fit, one such line is enough.
+ */
+int Region_fit(
+    struct Region *region,
+    struct RunArray **lines,
+    uint32_t ring,
+    uint32_t lowest
+)
+{
+    uint32_t line, index, known, rings[2];
+    int64_t bases[2];
+    for (known = 0, line = ring; line >= lowest && known < 2; --line) {
+        index = RunArray_find(lines[line], region->profile, region->step);
+        if (index == NO_RUN) continue;
+        rings[known] = line;
+        bases[known++] = TileRun_base(lines[line]->runs + index);
+    }
+    if (region->profile == NO_PROFILE) return known > 0;
+    if (known < 2 || (bases[0] - bases[1]) % (rings[0] - rings[1]))
+        return 0;
+    region->entry_growth = (bases[0] - bases[1]) / (rings[0] - rings[1]);
+    region->entry = bases[0] + (int64_t) (ring - rings[0])
+        * region->entry_growth;
+    return 1;
+}
+
+/*
+ * Index of the run of the line that holds the tiles of a region entered
+ * at base plus step per position there, NO_RUN if there's none. A narrow
+ * region can be a single tile on some lines. Unreached tiles have no
+ * entries to go by, so only a lone run of them longer than a tile counts.
+ */
+uint32_t RunArray_match(
+    const struct RunArray *ra, uint32_t profile, int64_t step, int64_t base
+)
+{
+    const struct TileRun *run;
+    uint32_t i;
+    if (profile == NO_PROFILE) return RunArray_find(ra, profile, step);
+    for (i = 0; i < ra->length; ++i) {
+        run = ra->runs + i;
+        if (
+            run->profile == profile
+            && (run->length == 1 || run->step == step)
+            && run->entry - step * run->start == base
+        )
+            return i;
+    }
+    return NO_RUN;
+}
+
+/*
+ * Keeps every profile and step of a run longer than a tile over the lines
+ * from lowest that stays one region over all of them: entered the same
+ * amount later every ring, always there and in the same order along the
+ * outermost line. Row ring - lowest of found gets where each is in that
+ * line, stride apart. order is scratch room for one index per candidate.
+ */
+void OctantModel_regions(
+    struct OctantModel *model,
+    struct RunArray **lines,
+    uint32_t lowest,
+    uint32_t *found,
+    uint32_t stride,
+    uint32_t *order
+)
+{
+    struct Region *candidates, region;
+    const struct TileRun *run;
+    uint32_t num_candidates, num_kept, ring, i, k, index, *row;
+
+    candidates = model->regions;
+    num_candidates = 0;
+    for (ring = model->ring; ring >= lowest; --ring) {
+        for (i = 0; i < lines[ring]->length; ++i) {
+            run = lines[ring]->runs + i;
+            if (run->length < 2) continue;
+            for (
+                k = 0;
+                k < num_candidates
+                && (
+                    candidates[k].profile != run->profile
+                    || candidates[k].step != run->step
+                );
+                ++k
+            );
+            if (k < num_candidates) continue;
+            candidates[num_candidates++] = (struct Region) {
+                .profile = run->profile,
+                .step = run->step,
+                .entry = 0,
+                .entry_growth = 0
+            };
+        }
+    }
+    for (num_kept = k = 0; k < num_candidates; ++k) {
+        region = candidates[k];
+        if (!Region_fit(&region, lines, model->ring, lowest)) continue;
+        index = RunArray_match(
+            lines[model->ring], region.profile, region.step, region.entry
+        );
+        if (index == NO_RUN) continue;
+        for (i = num_kept; i > 0 && order[i - 1] > index; --i) {
+            candidates[i] = candidates[i - 1];
+            order[i] = order[i - 1];
+        }
+        candidates[i] = region;
+        order[i] = index;
+        ++num_kept;
+    }
+    model->num_regions = 0;
+    for (k = 0; k < num_kept; ++k) {
+        region = candidates[k];
+        for (ring = model->ring; ring >= lowest; --ring) {
+            row = found + (size_t) (ring - lowest) * stride;
+            index = RunArray_match(
+                lines[ring], region.profile, region.step,
+                region.entry
+                    - (int64_t) (model->ring - ring) * region.entry_growth
+            );
+            if (
+                index == NO_RUN
+                || (
+                    model->num_regions
+                    && index <= row[model->num_regions - 1]
+                )
+            )
+                break;
+            row[model->num_regions] = index;
+        }
+        if (ring < lowest) model->regions[model->num_regions++] = region;
+    }
+}
+
+/*
+ * Whether band k repeats over the lines ring, ring - period, ... : the
+ * same runs each time, moved along and entered later by the same amounts,
+ * and entered later than they were. The first and last bands never move,
+ * they are the ends of the line.
+ */
+int OctantModel_band_repeats(
+    const struct OctantModel *model,
+    struct RunArray **lines,
+    uint32_t lowest,
+    const uint32_t *found,
+    uint32_t stride,
+    uint32_t k,
+    uint32_t ring,
+    uint32_t period
+)
+{
+    const struct TileRun *runs[STABLE_WINDOWS + 1], *run;
+    uint32_t first, end, num_runs, i, j, line;
+    int64_t start[STABLE_WINDOWS + 1];
+    num_runs = 0;
+    for (i = 0; i <= STABLE_WINDOWS; ++i) {
+        line = ring - i * period;
+        OctantModel_band(
+            model, lines[line], found + (size_t) (line - lowest) * stride,
+            k, &first, &end, start + i
+        );
+        if (i && end - first != num_runs) return 0;
+        num_runs = end - first;
+        runs[i] = lines[line]->runs + first;
+        if (
+            i > 1
+            && k && k < model->num_regions
+            && start[i - 1] - start[i] != start[0] - start[1]
+        )
+            return 0;
+    }
+    for (j = 0; j < num_runs; ++j) {
+        run = runs[0] + j;
+        for (i = 1; i <= STABLE_WINDOWS; ++i)
+            if (
+                runs[i][j].profile != run->profile
+                || runs[i][j].step != run->step
+                || runs[i][j].length != run->length
+                || (
+                    run->profile != NO_PROFILE
+                    && runs[i - 1][j].entry - runs[i][j].entry
+                        != run->entry - runs[1][j].entry
+                )
+            )
+                return 0;
+        if (run->profile != NO_PROFILE && run->entry <= runs[1][j].entry)
+            return 0;
+    }
+    return 1;
+}
+
+/* Keeps how every band looks over the last period of lines */
+int OctantModel_keep_bands(
+    struct OctantModel *model,
+    struct RunArray **lines,
+    uint32_t lowest,
+    const uint32_t *found,
+    uint32_t stride
+)
+{
+    struct TileRun run;
+    struct Band *band;
+    uint32_t num_bands, k, i, j, ring, first, end, before, period;
+    int64_t start, earlier;
+
+    for (num_bands = k = 0; k <= model->num_regions; ++k)
+        num_bands += model->periods[k];
+    model->bands = malloc(num_bands * sizeof(*(model->bands)));
+    if (!model->bands) {
+        perror("malloc");
+        puts("Failed to allocate OctantModel->bands");
+        return 0;
+    }
+    model->runs->length = 0;
+    for (num_bands = k = 0; k <= model->num_regions; ++k) {
+        model->first_band[k] = num_bands;
+        period = model->periods[k];
+        for (i = 0; i < period; ++i) {
+            ring = model->ring - i;
+            band = model->bands + num_bands++;
+            OctantModel_band(
+                model, lines[ring - period],
+                found + (size_t) (ring - period - lowest) * stride,
+                k, &before, &end, &earlier
+            );
+            OctantModel_band(
+                model, lines[ring],
+                found + (size_t) (ring - lowest) * stride,
+                k, &first, &end, &start
+            );
+            *band = (struct Band) {
+                .first_run = model->runs->length,
+                .num_runs = end - first,
+                .start = start,
+                .start_growth = start - earlier
+            };
+            for (j = 0; j < band->num_runs; ++j) {
+                run = lines[ring]->runs[first + j];
+                run.entry_growth =
+                    run.entry - lines[ring - period]->runs[before + j].entry;
+                if (!RunArray_push(model->runs, run)) return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/*
+ * Looks for regions, and for each band between them the shortest period
+ * it repeats with at the outermost trusted lines, allowing longer periods
+ * and so more lines in until every band has one. *stable is cleared if
+ * the trusted lines run out first.
+ */
+int OctantModel_fit(
+    struct OctantModel *model, struct RunArray **lines, int *stable
+)
+{
+    uint32_t *found, *order, stride, num_runs, max_period, lowest, k;
+    uint32_t period, i;
+    int ret;
+
+    *stable = 0;
+    stride = lines[model->ring]->length + 1;
+    for (num_runs = 0, i = 1; i <= model->ring; ++i)
+        num_runs += lines[i]->length;
+    found = malloc(
+        ((size_t) stride * model->ring + num_runs) * sizeof(*found)
+    );
+    if (!found) {
+        perror("malloc");
+        puts("Failed to allocate region indices");
+        return 0;
+    }
+    order = found + (size_t) stride * model->ring;
+    ret = 1;
+    for (
+        max_period = 1;
+        (STABLE_WINDOWS + 1) * max_period <= model->ring;
+        ++max_period
+    ) {
+        lowest = model->ring + 1 - (STABLE_WINDOWS + 1) * max_period;
+        OctantModel_regions(model, lines, lowest, found, stride, order);
+        for (k = 0; k <= model->num_regions; ++k) {
+            for (period = 1; period <= max_period; ++period) {
+                for (i = 0; i < period; ++i)
+                    if (
+                        !OctantModel_band_repeats(
+                            model, lines, lowest, found, stride,
+                            k, model->ring - i, period
+                        )
+                    )
+                        break;
+                if (i == period) break;
+            }
+            if (period > max_period) break;
+            model->periods[k] = period;
+        }
+        if (k > model->num_regions) {
+            *stable = 1;
+            ret = OctantModel_keep_bands(model, lines, lowest, found, stride);
+            break;
+        }
+    }
+    free(found);
+    return ret;
+}
+
+/* Adds a run of a line to *total, setting *reached if it's in time */
+void TileRun_add(
+    struct TiledSearch *search,
+    uint32_t profile,
+    int64_t entry,
+    int64_t step,
+    int64_t length,
+    uint64_t total_steps,
+    uint128_t *total,
+    int *reached
+)
+{
+    if (profile == NO_PROFILE) return;
+    if (entry + (step < 0 ? step * (length - 1) : 0) > (int64_t) total_steps)
+        return;
+    *reached = 1;
+    *total += TileRun_reachable(
+        search->profiles + profile, entry, step, length, total_steps
+    );
+}
+
+/*
+ * Adds up line ring of the octant, past the lines the model was fit on.
+ * Returns 0 if a region would close up, which the model can't follow.
+ */
+int OctantModel_line(
+    const struct OctantModel *model,
+    struct TiledSearch *search,
+    uint64_t ring,
+    uint64_t total_steps,
+    uint128_t *total,
+    int *reached
+)
+{
+    const struct Region *region;
+    const struct Band *band;
+    const struct TileRun *run;
+    int64_t position, start, length, periods, end;
+    uint64_t back;
+    uint32_t k, j;
+
+    position = 0;
+    for (k = 0; k <= model->num_regions; ++k) {
+        back = (ring - model->ring) % model->periods[k];
+        back = back ? model->periods[k] - back : 0;
+        band = model->bands + model->first_band[k] + back;
+        periods = (ring - model->ring + back) / model->periods[k];
+        run = model->runs->runs + band->first_run;
+        if (k == model->num_regions) {
+            end = octant_line_length(model->octant, ring);
+            for (start = end, j = 0; j < band->num_runs; ++j)
+                start -= run[j].length;
+        } else {
+            start = band->start + periods * band->start_growth;
+        }
+        if (k) {
+            region = model->regions + k - 1;
+            length = start - position;
+            if (length < 1) return 0;
+            TileRun_add(
+                search, region->profile,
+                region->entry
+                    + (int64_t) (ring - model->ring) * region->entry_growth
+                    + region->step * position,
+                region->step, length, total_steps, total, reached
+            );
+        }
+        for (j = 0; j < band->num_runs; ++j)
+            TileRun_add(
+                search, run[j].profile,
+                run[j].entry + periods * run[j].entry_growth,
+                run[j].step, run[j].length, total_steps, total, reached
+            );
+        position = start;
+        for (j = 0; j < band->num_runs; ++j)
+            position += run[j].length;
+    }
+    return 1;
+}
+
+/*
+ * Counts the trusted rings tile by tile and every ring past them from
+ * the models of the octants, until a whole ring is out of reach. No ring
+ * is entered before the one inside it, so none further out can be either.
+ */
+int TiledSearch_extrapolate(
+    struct TiledSearch *search,
+    uint64_t total_steps,
+    uint128_t *total,
+    int *stable
+)
+{
+    struct OctantModel *models[NUM_OCTANTS];
+    struct RunArray **lines;
+    uint64_t ring;
+    uint32_t last, octant, i, num_runs;
+    int ret, reached;
+
+    *total = TiledSearch_count(search, search->trusted_rings, total_steps);
+    *stable = 0;
+    if (search->trusted_rings < 2) return 1;
+    ret = 0;
+    last = search->trusted_rings - 1;
+    for (octant = 0; octant < NUM_OCTANTS; ++octant)
+        models[octant] = NULL;
+    lines = calloc(last + 1, sizeof(*lines));
+    if (!lines) {
+        perror("calloc");
+        puts("Failed to allocate octant lines");
+        return 0;
+    }
+    for (i = 1; i <= last; ++i)
+        if (!(lines[i] = RunArray_create(0))) goto cleanup;
+    for (octant = 0; octant < NUM_OCTANTS; ++octant) {
+        for (num_runs = 0, i = 1; i <= last; ++i) {
+            if (!RunArray_from_line(lines[i], search, octant, i))
+                goto cleanup;
+            num_runs += lines[i]->length;
+        }
+        models[octant] = OctantModel_create(octant, last, num_runs);
+        if (
+            !models[octant]
+            || !OctantModel_fit(models[octant], lines, stable)
+        )
+            goto cleanup;
+        if (!*stable) {
+            ret = 1;
+            goto cleanup;
+        }
+    }
+    for (ring = last + 1, reached = 1; reached; ++ring) {
+        reached = 0;
+        for (octant = 0; octant < NUM_OCTANTS; ++octant)
+            if (
+                !OctantModel_line(
+                    models[octant], search, ring, total_steps, total,
+                    &reached
+                )
+            ) {
+                *stable = 0;
+                break;
+            }
+        if (!*stable) break;
+    }
+    ret = 1;
+cleanup:
+    for (octant = 0; octant < NUM_OCTANTS; ++octant)
+        OctantModel_free(models[octant]);
+    for (i = 1; i <= last; ++i)
+        RunArray_free(lines[i]);
+    free(lines);
+    return ret;
+}
+
+/*
+ * Ball sizes on a periodic graph settle into rings of tiles that repeat,
+ * but rocks can tilt the boundaries between them so that they only repeat
+ * every few rings and only well away from the start. The diamond of tiles
+ * searched keeps doubling until that shows, unless it already covers
+ * total_steps.
+ */
+int solve_tiled(
+    struct Garden *garden, uint64_t total_steps, uint128_t *total
+)
+{
+    struct TiledSearch search;
+    struct TileSolver solver;
+    uint64_t radius, needed, size;
+    int ret, stable;
+    size = garden->num_lines < garden->num_cols
+        ? garden->num_lines
+        : garden->num_cols;
+    /* Never has to step off a diamond that many rings out */
+    needed = total_steps / size + 3;
+    if (!TileSolver_init(&solver, garden)) return 0;
+    ret = 0;
+    for (radius = INITIAL_RINGS;; radius *= 2) {
+        if (radius > needed) radius = needed;
+        if (radius > MAX_RINGS) radius = MAX_RINGS;
+        if (!TiledSearch_run(&search, &solver, radius)) goto cleanup;
+        if (total_steps <= search.exact_distance) {
+            *total = TiledSearch_count(&search, radius + 1, total_steps);
+            stable = 1;
+        } else if (
+            !TiledSearch_extrapolate(&search, total_steps, total, &stable)
+        ) {
+            TiledSearch_free(&search);
+            goto cleanup;
+        }
+        TiledSearch_free(&search);
+        if (stable) {
+            ret = 1;
+            goto cleanup;
+        }
+        if (radius == needed || radius == MAX_RINGS) break;
+    }
+    puts("Tiles never settled into repeating rings");
+cleanup:
+    TileSolver_free(&solver);
+    return ret;
+}
+
+/*
+ * The tile classes only add up when the garden is an odd square with the
+ * start in the middle, clear midlines and edges, and total_steps ending
+ * on the edge of a tile. Rocks can still force detours the classes don't
+ * see, so they are also checked against the tiled simulation on two
+ * small step counts of the same shape and the same number of tiles
+ * across mod 2, which the odd and even tile counts depend on.
+ */
+int Garden_is_centred_tiling(
+    struct FieldCache *cache, uint64_t total_steps
+)
+{
+    struct Garden *garden;
+    struct DistanceField field;
+    uint32_t size, k, num_steps, sources[MAX_FIELDS], num_sources;
+    int matches;
+    garden = cache->garden;
+    size = garden->num_cols;
+    if (
+        garden->num_lines != size
+        || size % 2 == 0
+        || garden->start_line != size / 2
+        || garden->start_col != size / 2
+        || total_steps % size != size / 2
+        || total_steps / size < 2
+        || !Garden_is_open_line(garden, 0)
+        || !Garden_is_open_line(garden, size / 2)
+        || !Garden_is_open_line(garden, size - 1)
+        || !Garden_is_open_col(garden, 0)
+        || !Garden_is_open_col(garden, size / 2)
+        || !Garden_is_open_col(garden, size - 1)
+    )
+        return 0;
+    num_sources = tile_class_sources(garden, sources);
+    if (!FieldCache_prefetch(cache, sources, num_sources))
+        return 0;
+    for (k = 4 + total_steps / size % 2; k <= 7; k += 2) {
+        num_steps = k * size + size / 2;
+        if (2 * num_steps + 1 > MAX_TILED_SIDE) return 0;
+        field.within[0] = NULL;
+        if (!tiled_field(garden, num_steps, &field)) return 0;
+        matches = tile_classes_total(cache, num_steps)
+            == DistanceField_reachable(&field, num_steps);
+        free(field.within[0]);
+        if (!matches) return 0;
+    }
+    return 1;
+}
+
+/* Reads a step count made only of digits */
+int parse_steps(const char *text, uint64_t *num_steps)
+{
+    uint64_t value;
+    const char *c;
+    value = 0;
+    for (c = text; *c >= '0' && *c <= '9'; ++c) {
+        if (value > (UINT64_MAX - (uint64_t) (*c - '0')) / 10) break;
+        value = value * 10 + (uint64_t) (*c - '0');
+    }
+    if (c == text || *c) {
+        printf("Invalid step count: %s\n", text);
+        return 0;
+    }
+    *num_steps = value;
+    return 1;
+}
+
+int run(uint64_t num_steps)
+{
+    struct Garden *garden;
+    struct FieldCache *cache;
+    uint128_t total;
+    char total_str[UINT128_STRING_LEN];
+    int ret;
+    garden = gen_garden();
+    if (!garden) return 0;
+    cache = FieldCache_create(garden);
+    if (!cache) {
+        Garden_free(garden);
+        return 0;
+    }
+    ret = 1;
+    if (Garden_is_centred_tiling(cache, num_steps)) {
+        total = tile_classes_total(cache, num_steps);
+    } else {
+        puts("Garden is not a centred tiling, extrapolating");
+        ret = solve_tiled(garden, num_steps, &total);
+    }
+    if (ret) printf("Total: %s\n", uint128_to_string(total, total_str));
+    FieldCache_free(cache);
+    Garden_free(garden);
+    return ret;
+}
+
+/* The step count defaults to the puzzle's but can be given instead */
+int main(int argc, char **argv)
 {
-    if (!run()) return 1;
+    uint64_t num_steps;
+    num_steps = NUM_STEPS;
+    if (argc > 1 && !parse_steps(argv[1], &num_steps)) return 1;
+    if (!run(num_steps)) return 1;
     return 0;
 }
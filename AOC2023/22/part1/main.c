@@ -6,6 +6,8 @@
 #define MIN_CHARBUFFER 32U
 #define MIN_BRICKARRAY 4U
 
+#define NO_BRICK UINT32_MAX
+
 struct CharBuffer {
     char *buffer;
     uint32_t length;
@@ -29,6 +31,25 @@ struct BrickArray {
     uint32_t capacity;
 };
 
+/* Tallest settled brick over one x/y column so far */
+struct HeightCell {
+    uint32_t height;
+    uint32_t top;
+};
+
+/*
+ * The bricks directly under brick i are
+ * supporters[supporter_start[i]..supporter_start[i + 1]),
+ * and the ones directly on top of it are laid out the same way
+ */
+struct SupportGraph {
+    uint32_t *supporter_start;
+    uint32_t *supporters;
+    uint32_t *dependant_start;
+    uint32_t *dependants;
+    uint32_t length;
+};
+
 uint32_t min(uint32_t number, uint32_t other)
 {
     return (number < other) * number + !(number < other) * other;
@@ -137,24 +158,6 @@ uint32_t CharBuffer_get_line(struct CharBuffer *cb)
     return i;
 }
 
-int Brick_overlap_xy(struct Brick brick, struct Brick other)
-{
-    int overlaps_x, overlaps_y;
-    uint32_t x, y;
-
-    overlaps_x = 0;
-    for (x = brick.start.x; x <= brick.end.x; ++x)
-        if (other.start.x <= x && x <= other.end.x)
-            overlaps_x = 1;
-
-    overlaps_y = 0;
-    for (y = brick.start.y; y <= brick.end.y; ++y)
-        if (other.start.y <= y && y <= other.end.y)
-            overlaps_y = 1;
-
-    return overlaps_x && overlaps_y;
-}
-
 int Brick_from_str(const char *str, struct Brick *brick)
 {
     int result;
@@ -250,99 +253,138 @@ int BrickArray_load(struct BrickArray *ba)
     return 1;
 }
 
-uint32_t BrickArray_num_supports(struct BrickArray *ba, uint32_t index)
+uint32_t SupportGraph_num_supports(struct SupportGraph *sg, uint32_t index)
 {
-    uint32_t num, i;
-    assert(index < ba->length);
-
-    num = 0;
-    for (i = index; i; --i)
-        if (
-            Brick_overlap_xy(ba->bricks[index], ba->bricks[i - 1])
-            && ba->bricks[i - 1].end.z == ba->bricks[index].start.z - 1
-        )
-            ++num;
-    return num;
+    assert(index < sg->length);
+    return sg->supporter_start[index + 1] - sg->supporter_start[index];
 }
 
-int BrickArray_could_destroy(struct BrickArray *ba, uint32_t index)
+int SupportGraph_could_destroy(struct SupportGraph *sg, uint32_t index)
 {
     uint32_t i;
-    assert(index < ba->length);
+    assert(index < sg->length);
 
-    for (i = index; i < ba->length; ++i)
-        if (ba->bricks[i].start.z == ba->bricks[index].end.z + 1)
-            break;
-
-    while (
-        i < ba->length
-        && ba->bricks[i].start.z == ba->bricks[index].end.z + 1
-    ) {
-        if (Brick_overlap_xy(ba->bricks[index], ba->bricks[i])) {
-            if (BrickArray_num_supports(ba, i) <= 1)
-                return 0;
-        }
-        ++i;
-    }
+    for (
+        i = sg->dependant_start[index];
+        i < sg->dependant_start[index + 1];
+        ++i
+    )
+        if (SupportGraph_num_supports(sg, sg->dependants[i]) <= 1)
+            return 0;
     return 1;
 }
 
-void BrickArray_zsort_end(struct BrickArray *ba)
+void SupportGraph_free(struct SupportGraph *sg)
 {
-    uint32_t i;
-    int sorted;
-    struct Brick temp;
-    sorted = 0;
-    while (!sorted) {
-        sorted = 1;
-        for (i = 1; i < ba->length; ++i) {
-            if (ba->bricks[i - 1].end.z > ba->bricks[i].end.z) {
-                temp = ba->bricks[i - 1];
-                ba->bricks[i - 1] = ba->bricks[i];
-                ba->bricks[i] = temp;
-                sorted = 0;
-            }
-        }
-    }
+    if (!sg) return;
+    free(sg->supporter_start);
+    free(sg->supporters);
+    free(sg->dependant_start);
+    free(sg->dependants);
+    free(sg);
+}
+
+int Brick_compare_start_z(const void *brick, const void *other)
+{
+    uint32_t z, other_z;
+    z = ((const struct Brick *) brick)->start.z;
+    other_z = ((const struct Brick *) other)->start.z;
+    return (z > other_z) - (z < other_z);
 }
 
 void BrickArray_zsort_start(struct BrickArray *ba)
 {
-    uint32_t i;
-    int sorted;
-    struct Brick temp;
-    sorted = 0;
-    while (!sorted) {
-        sorted = 1;
-        for (i = 1; i < ba->length; ++i) {
-            if (ba->bricks[i - 1].start.z > ba->bricks[i].start.z) {
-                temp = ba->bricks[i - 1];
-                ba->bricks[i - 1] = ba->bricks[i];
-                ba->bricks[i] = temp;
-                sorted = 0;
-            }
-        }
-    }
+    qsort(
+        ba->bricks, ba->length, sizeof(*(ba->bricks)), Brick_compare_start_z
+    );
 }
 
-void BrickArray_layer(struct BrickArray *ba)
+/*
+ * Drops the bricks lowest first onto a height map of the x/y plane.
+ * Each brick lands one above the tallest column under its footprint,
+ * and whichever bricks top the columns at exactly that height are
+ * its supporters.
+ */
+struct SupportGraph *BrickArray_settle(struct BrickArray *ba)
 {
-    uint32_t i, j, zlength, max_z;
+    struct SupportGraph *sg;
+    struct HeightCell *cells, *cell;
+    struct Brick *brick;
+    uint32_t width, depth, i, x, y, ground, zlength, edges, *seen;
+    size_t footprints;
 
-    BrickArray_zsort_end(ba);
+    BrickArray_zsort_start(ba);
+    width = depth = 0;
+    footprints = 0;
     for (i = 0; i < ba->length; ++i) {
-        max_z = 0;
-        for (j = 0; j < i; ++j) {
-            if (Brick_overlap_xy(ba->bricks[i], ba->bricks[j])) {
-                if (ba->bricks[j].end.z > max_z)
-                    max_z = ba->bricks[j].end.z;
+        brick = ba->bricks + i;
+        width = max(width, brick->end.x + 1);
+        depth = max(depth, brick->end.y + 1);
+        footprints += (size_t) (brick->end.x - brick->start.x + 1)
+            * (brick->end.y - brick->start.y + 1);
+    }
+    cells = malloc(((size_t) width * depth + 1) * sizeof(*cells));
+    assert(cells);
+    for (i = 0; i < width * depth; ++i)
+        cells[i] = (struct HeightCell) { .height = 0, .top = NO_BRICK };
+    seen = malloc((ba->length + 1) * sizeof(*seen));
+    assert(seen);
+    for (i = 0; i < ba->length; ++i)
+        seen[i] = NO_BRICK;
+
+    sg = malloc(sizeof(*sg));
+    assert(sg);
+    *sg = (struct SupportGraph) {
+        .supporter_start = malloc((ba->length + 1) * sizeof(uint32_t)),
+        .supporters = malloc((footprints + 1) * sizeof(uint32_t)),
+        .dependant_start = calloc(ba->length + 2, sizeof(uint32_t)),
+        .dependants = NULL,
+        .length = ba->length
+    };
+    assert(sg->supporter_start && sg->supporters && sg->dependant_start);
+
+    for (i = edges = 0; i < ba->length; ++i) {
+        brick = ba->bricks + i;
+        ground = 0;
+        for (y = brick->start.y; y <= brick->end.y; ++y)
+            for (x = brick->start.x; x <= brick->end.x; ++x)
+                ground = max(ground, cells[y * width + x].height);
+        sg->supporter_start[i] = edges;
+        for (y = brick->start.y; y <= brick->end.y && ground; ++y) {
+            for (x = brick->start.x; x <= brick->end.x; ++x) {
+                cell = cells + y * width + x;
+                if (cell->height != ground || seen[cell->top] == i)
+                    continue;
+                seen[cell->top] = i;
+                sg->supporters[edges++] = cell->top;
+                ++(sg->dependant_start[cell->top + 2]);
             }
         }
-        zlength = ba->bricks[i].end.z - ba->bricks[i].start.z;
-        ba->bricks[i].start.z = max_z + 1;
-        ba->bricks[i].end.z = max_z + 1 + zlength;
+        zlength = brick->end.z - brick->start.z;
+        brick->start.z = ground + 1;
+        brick->end.z = ground + 1 + zlength;
+        for (y = brick->start.y; y <= brick->end.y; ++y)
+            for (x = brick->start.x; x <= brick->end.x; ++x)
+                cells[y * width + x] = (struct HeightCell) {
+                    .height = brick->end.z,
+                    .top = i
+                };
     }
-    BrickArray_zsort_start(ba);
+    sg->supporter_start[ba->length] = edges;
+    free(cells);
+    free(seen);
+
+    /* Counting sort the edges by supporter to get the dependants */
+    sg->dependants = malloc((edges + 1) * sizeof(*(sg->dependants)));
+    assert(sg->dependants);
+    for (i = 0; i < ba->length; ++i)
+        sg->dependant_start[i + 2] += sg->dependant_start[i + 1];
+    for (i = 0; i < ba->length; ++i)
+        for (x = sg->supporter_start[i]; x < sg->supporter_start[i + 1]; ++x)
+            sg->dependants[
+                sg->dependant_start[sg->supporters[x] + 1]++
+            ] = i;
+    return sg;
 }
 
 void BrickArray_print(struct BrickArray *ba)
@@ -360,11 +402,11 @@ void BrickArray_print(struct BrickArray *ba)
     }
 }
 
-uint32_t BrickArray_count_destroyable(struct BrickArray *ba)
+uint32_t SupportGraph_count_destroyable(struct SupportGraph *sg)
 {
     uint32_t i, count;
-    for (i = count = 0; i < ba->length; ++i)
-        if (BrickArray_could_destroy(ba, i))
+    for (i = count = 0; i < sg->length; ++i)
+        if (SupportGraph_could_destroy(sg, i))
             ++count;
     return count;
 }
@@ -372,14 +414,16 @@ uint32_t BrickArray_count_destroyable(struct BrickArray *ba)
 int main(void)
 {
     struct BrickArray *ba;
+    struct SupportGraph *sg;
     
     ba = BrickArray_create(0);
     if (!BrickArray_load(ba)) {
         BrickArray_free(ba);
         return 1;
     }
-    BrickArray_layer(ba);
-    printf("Destroyable: %u\n", BrickArray_count_destroyable(ba));
+    sg = BrickArray_settle(ba);
+    printf("Destroyable: %u\n", SupportGraph_count_destroyable(sg));
+    SupportGraph_free(sg);
     BrickArray_free(ba);
     return 0;
 }
@@ -4,10 +4,17 @@
 #include <assert.h>
 #include <limits.h>
 #include <string.h>
+#include <pthread.h>
 
 #define MIN_CHARBUFFER  32U
 #define MIN_BRICKARRAY  4U
 
+#define NO_BRICK UINT32_MAX
+
+#define NUM_THREADS 8
+
+#define SIMULATE_FLAG "--simulate"
+
 struct CharBuffer {
     char *buffer;
     uint32_t length;
@@ -31,14 +38,61 @@ struct BrickArray {
     uint32_t capacity;
 };
 
-struct QueueNode {
-    struct QueueNode *next;
-    uint32_t index;
+/* Tallest settled brick over one x/y column so far */
+struct HeightCell {
+    uint32_t height;
+    uint32_t top;
+};
+
+/*
+ * The bricks directly under brick i are
+ * supporters[supporter_start[i]..supporter_start[i + 1]),
+ * and the ones directly on top of it are laid out the same way
+ */
+struct SupportGraph {
+    uint32_t *supporter_start;
+    uint32_t *supporters;
+    uint32_t *dependant_start;
+    uint32_t *dependants;
+    uint32_t length;
+};
+
+/*
+ * parent[i] is the immediate dominator of brick i, the last brick every
+ * path from the ground to i goes through, or the ground itself which
+ * has index length. up holds levels rows of length + 1 ancestors,
+ * row k jumping 2^k levels at once.
+ */
+struct DominatorTree {
+    uint32_t *parent;
+    uint32_t *depth;
+    uint32_t *size;
+    uint32_t *up;
+    uint32_t levels;
+    uint32_t length;
 };
 
-struct Queue {
-    struct QueueNode *head;
-    struct QueueNode *tail;
+/* Fixed capacity FIFO, each brick is pushed at most once per chain */
+struct RingQueue {
+    uint32_t *items;
+    uint32_t head;
+    uint32_t length;
+    uint32_t capacity;
+};
+
+/*
+ * fallen[i] == epoch marks brick i as fallen in the current chain. Each
+ * chain uses its own epoch so the array never needs clearing.
+ */
+struct ChainWorker {
+    struct SupportGraph *sg;
+    uint32_t offset;
+    uint32_t stride;
+    uint32_t *fallen;
+    struct RingQueue queue;
+    unsigned long total;
+    pthread_t thread;
+    int started;
 };
 
 uint32_t min(uint32_t number, uint32_t other)
@@ -51,64 +105,6 @@ uint32_t max(uint32_t number, uint32_t other)
     return (number > other) * number + !(number > other) * other;
 }
 
-void QueueNode_free(struct QueueNode *node)
-{
-    if (!node) return;
-    struct QueueNode *next;
-    next = node->next;
-    free(node);
-    QueueNode_free(next);
-}
-
-struct Queue *Queue_create(void)
-{
-    struct Queue *queue;
-    queue = malloc(sizeof(*queue));
-    assert(queue);
-    *queue = (struct Queue) {
-        .head = NULL,
-        .tail = NULL
-    };
-    return queue;
-}
-
-void Queue_free(struct Queue *queue)
-{
-    if (!queue) return;
-    QueueNode_free(queue->head);
-    free(queue);
-}
-
-void Queue_enqueue(struct Queue *queue, uint32_t index)
-{
-    struct QueueNode *node;
-    node = malloc(sizeof(*node));
-    assert(node);
-    *node = (struct QueueNode) {
-        .next = NULL,
-        .index = index
-    };
-    if (!queue->tail) {
-        queue->head = queue->tail = node;
-    } else {
-        queue->tail->next = node;
-        queue->tail = node;
-    }
-}
-
-int Queue_dequeue(struct Queue *queue, uint32_t *dest)
-{
-    struct QueueNode *old_head;
-    if (!queue->head) return 0;
-    old_head = queue->head;
-    *dest = old_head->index;
-    queue->head = old_head->next;
-    free(old_head);
-    if (!queue->head)
-        queue->tail = NULL;
-    return 1;
-}
-
 struct CharBuffer *CharBuffer_create(uint32_t start_capacity)
 {
     struct CharBuffer *cb;
@@ -207,24 +203,6 @@ uint32_t CharBuffer_get_line(struct CharBuffer *cb)
     return i;
 }
 
-int Brick_overlap_xy(struct Brick brick, struct Brick other)
-{
-    int overlaps_x, overlaps_y;
-    uint32_t x, y;
-
-    overlaps_x = 0;
-    for (x = brick.start.x; x <= brick.end.x; ++x)
-        if (other.start.x <= x && x <= other.end.x)
-            overlaps_x = 1;
-
-    overlaps_y = 0;
-    for (y = brick.start.y; y <= brick.end.y; ++y)
-        if (other.start.y <= y && y <= other.end.y)
-            overlaps_y = 1;
-
-    return overlaps_x && overlaps_y;
-}
-
 int Brick_from_str(const char *str, struct Brick *brick)
 {
     int result;
@@ -320,150 +298,307 @@ int BrickArray_load(struct BrickArray *ba)
     return 1;
 }
 
-uint32_t BrickArray_num_supports(struct BrickArray *ba, uint32_t index)
+void SupportGraph_free(struct SupportGraph *sg)
 {
-    uint32_t num, i;
-    assert(index < ba->length);
-
-    num = 0;
-    for (i = index; i; --i)
-        if (
-            Brick_overlap_xy(ba->bricks[index], ba->bricks[i - 1])
-            && ba->bricks[i - 1].end.z == ba->bricks[index].start.z - 1
-        )
-            ++num;
-    return num;
+    if (!sg) return;
+    free(sg->supporter_start);
+    free(sg->supporters);
+    free(sg->dependant_start);
+    free(sg->dependants);
+    free(sg);
 }
 
-int BrickArray_count_chain_rec(
-    struct BrickArray *ba,
-    struct Queue *queue,
-    uint32_t *fallen,
-    uint32_t *chain
-)
+int Brick_compare_start_z(const void *brick, const void *other)
 {
-    uint32_t index, i, is_supported;
+    uint32_t z, other_z;
+    z = ((const struct Brick *) brick)->start.z;
+    other_z = ((const struct Brick *) other)->start.z;
+    return (z > other_z) - (z < other_z);
+}
 
-    if (!Queue_dequeue(queue, &index))
-        return 1;
+void BrickArray_zsort_start(struct BrickArray *ba)
+{
+    qsort(
+        ba->bricks, ba->length, sizeof(*(ba->bricks)), Brick_compare_start_z
+    );
+}
 
-    if (fallen[index])
-        return BrickArray_count_chain_rec(ba, queue, fallen, chain);
-
-    is_supported = 0;
-    for (i = index; i; --i) {
-        if (
-            ba->bricks[i - 1].end.z == ba->bricks[index].start.z - 1
-            && Brick_overlap_xy(ba->bricks[index], ba->bricks[i - 1])
-            && !fallen[i - 1]
-        )
-            is_supported = 1;
+/*
+ * Drops the bricks lowest first onto a height map of the x/y plane.
+ * Each brick lands one above the tallest column under its footprint,
+ * and whichever bricks top the columns at exactly that height are
+ * its supporters.
+ */
+struct SupportGraph *BrickArray_settle(struct BrickArray *ba)
+{
+    struct SupportGraph *sg;
+    struct HeightCell *cells, *cell;
+    struct Brick *brick;
+    uint32_t width, depth, i, x, y, ground, zlength, edges, *seen;
+    size_t footprints;
+
+    BrickArray_zsort_start(ba);
+    width = depth = 0;
+    footprints = 0;
+    for (i = 0; i < ba->length; ++i) {
+        brick = ba->bricks + i;
+        width = max(width, brick->end.x + 1);
+        depth = max(depth, brick->end.y + 1);
+        footprints += (size_t) (brick->end.x - brick->start.x + 1)
+            * (brick->end.y - brick->start.y + 1);
     }
-    if (is_supported)
-        return BrickArray_count_chain_rec(ba, queue, fallen, chain);
-    fallen[index] = 1;
-    ++(*chain);
-
-    for (i = index; i < ba->length; ++i)
-        if (ba->bricks[i].start.z == ba->bricks[index].end.z + 1)
-            break;
-
-    while (
-        i < ba->length
-        && ba->bricks[i].start.z == ba->bricks[index].end.z + 1
-    ) {
-        if (Brick_overlap_xy(ba->bricks[index], ba->bricks[i]))
-            Queue_enqueue(queue, i);
-        ++i;
+    cells = malloc(((size_t) width * depth + 1) * sizeof(*cells));
+    assert(cells);
+    for (i = 0; i < width * depth; ++i)
+        cells[i] = (struct HeightCell) { .height = 0, .top = NO_BRICK };
+    seen = malloc((ba->length + 1) * sizeof(*seen));
+    assert(seen);
+    for (i = 0; i < ba->length; ++i)
+        seen[i] = NO_BRICK;
+
+    sg = malloc(sizeof(*sg));
+    assert(sg);
+    *sg = (struct SupportGraph) {
+        .supporter_start = malloc((ba->length + 1) * sizeof(uint32_t)),
+        .supporters = malloc((footprints + 1) * sizeof(uint32_t)),
+        .dependant_start = calloc(ba->length + 2, sizeof(uint32_t)),
+        .dependants = NULL,
+        .length = ba->length
+    };
+    assert(sg->supporter_start && sg->supporters && sg->dependant_start);
+
+    for (i = edges = 0; i < ba->length; ++i) {
+        brick = ba->bricks + i;
+        ground = 0;
+        for (y = brick->start.y; y <= brick->end.y; ++y)
+            for (x = brick->start.x; x <= brick->end.x; ++x)
+                ground = max(ground, cells[y * width + x].height);
+        sg->supporter_start[i] = edges;
+        for (y = brick->start.y; y <= brick->end.y && ground; ++y) {
+            for (x = brick->start.x; x <= brick->end.x; ++x) {
+                cell = cells + y * width + x;
+                if (cell->height != ground || seen[cell->top] == i)
+                    continue;
+                seen[cell->top] = i;
+                sg->supporters[edges++] = cell->top;
+                ++(sg->dependant_start[cell->top + 2]);
+            }
+        }
+        zlength = brick->end.z - brick->start.z;
+        brick->start.z = ground + 1;
+        brick->end.z = ground + 1 + zlength;
+        for (y = brick->start.y; y <= brick->end.y; ++y)
+            for (x = brick->start.x; x <= brick->end.x; ++x)
+                cells[y * width + x] = (struct HeightCell) {
+                    .height = brick->end.z,
+                    .top = i
+                };
     }
-    return BrickArray_count_chain_rec(ba, queue, fallen, chain);
+    sg->supporter_start[ba->length] = edges;
+    free(cells);
+    free(seen);
+
+    /* Counting sort the edges by supporter to get the dependants */
+    sg->dependants = malloc((edges + 1) * sizeof(*(sg->dependants)));
+    assert(sg->dependants);
+    for (i = 0; i < ba->length; ++i)
+        sg->dependant_start[i + 2] += sg->dependant_start[i + 1];
+    for (i = 0; i < ba->length; ++i)
+        for (x = sg->supporter_start[i]; x < sg->supporter_start[i + 1]; ++x)
+            sg->dependants[
+                sg->dependant_start[sg->supporters[x] + 1]++
+            ] = i;
+    return sg;
 }
 
-uint32_t BrickArray_count_chain(struct BrickArray *ba, uint32_t index)
+void DominatorTree_free(struct DominatorTree *dt)
 {
-    uint32_t chain, *fallen, i;
-    struct Queue *queue;
-    fallen = malloc(ba->length * sizeof(*fallen));
-    assert(fallen);
-    memset(fallen, 0, ba->length * sizeof(*fallen));
-    fallen[index] = 1;
-    queue = Queue_create();
-    for (i = index; i < ba->length; ++i)
-        if (ba->bricks[i].start.z == ba->bricks[index].end.z + 1)
-            break;
-
-    while (
-        i < ba->length
-        && ba->bricks[i].start.z == ba->bricks[index].end.z + 1
-    ) {
-        if (Brick_overlap_xy(ba->bricks[index], ba->bricks[i]))
-            Queue_enqueue(queue, i);
-        ++i;
-    }
-    chain = 0;
-    if (!BrickArray_count_chain_rec(ba, queue, fallen, &chain))
-        assert(0);
-    free(fallen);
-    Queue_free(queue);
-    return chain;
+    if (!dt) return;
+    free(dt->parent);
+    free(dt->depth);
+    free(dt->size);
+    free(dt->up);
+    free(dt);
 }
 
-void BrickArray_zsort_end(struct BrickArray *ba)
+uint32_t DominatorTree_lca(
+    struct DominatorTree *dt, uint32_t node, uint32_t other
+)
 {
-    uint32_t i;
-    int sorted;
-    struct Brick temp;
-    sorted = 0;
-    while (!sorted) {
-        sorted = 1;
-        for (i = 1; i < ba->length; ++i) {
-            if (ba->bricks[i - 1].end.z > ba->bricks[i].end.z) {
-                temp = ba->bricks[i - 1];
-                ba->bricks[i - 1] = ba->bricks[i];
-                ba->bricks[i] = temp;
-                sorted = 0;
-            }
+    uint32_t k, temp, *row;
+    if (dt->depth[node] < dt->depth[other]) {
+        temp = node;
+        node = other;
+        other = temp;
+    }
+    for (k = dt->levels; k; --k) {
+        row = dt->up + (size_t) (k - 1) * (dt->length + 1);
+        if (dt->depth[node] - dt->depth[other] >= 1U << (k - 1))
+            node = row[node];
+    }
+    if (node == other) return node;
+    for (k = dt->levels; k; --k) {
+        row = dt->up + (size_t) (k - 1) * (dt->length + 1);
+        if (row[node] != row[other]) {
+            node = row[node];
+            other = row[other];
         }
     }
+    return dt->parent[node];
 }
 
-void BrickArray_zsort_start(struct BrickArray *ba)
+/*
+ * Settled bricks only rest on bricks settled before them, so index
+ * order is a topological order of the support graph. That makes the
+ * immediate dominator of a brick the lowest common ancestor of its
+ * supporters in the tree built so far. Removing a brick drops exactly
+ * the bricks it dominates, so its chain is its subtree size minus one.
+ */
+struct DominatorTree *SupportGraph_dominators(struct SupportGraph *sg)
 {
-    uint32_t i;
-    int sorted;
-    struct Brick temp;
-    sorted = 0;
-    while (!sorted) {
-        sorted = 1;
-        for (i = 1; i < ba->length; ++i) {
-            if (ba->bricks[i - 1].start.z > ba->bricks[i].start.z) {
-                temp = ba->bricks[i - 1];
-                ba->bricks[i - 1] = ba->bricks[i];
-                ba->bricks[i] = temp;
-                sorted = 0;
-            }
-        }
+    struct DominatorTree *dt;
+    uint32_t ground, stride, i, j, k, idom;
+
+    dt = malloc(sizeof(*dt));
+    assert(dt);
+    ground = sg->length;
+    stride = sg->length + 1;
+    for (dt->levels = 1; (1U << dt->levels) < stride; ++(dt->levels));
+    dt->length = sg->length;
+    dt->parent = malloc(stride * sizeof(*(dt->parent)));
+    dt->depth = malloc(stride * sizeof(*(dt->depth)));
+    dt->size = malloc(stride * sizeof(*(dt->size)));
+    dt->up = malloc((size_t) dt->levels * stride * sizeof(*(dt->up)));
+    assert(dt->parent && dt->depth && dt->size && dt->up);
+
+    dt->parent[ground] = ground;
+    dt->depth[ground] = 0;
+    for (k = 0; k < dt->levels; ++k)
+        dt->up[k * stride + ground] = ground;
+    for (i = 0; i < sg->length; ++i) {
+        j = sg->supporter_start[i];
+        idom = j < sg->supporter_start[i + 1] ? sg->supporters[j++] : ground;
+        for (; j < sg->supporter_start[i + 1]; ++j)
+            idom = DominatorTree_lca(dt, idom, sg->supporters[j]);
+        dt->parent[i] = idom;
+        dt->depth[i] = dt->depth[idom] + 1;
+        dt->up[i] = idom;
+        for (k = 1; k < dt->levels; ++k)
+            dt->up[k * stride + i] = dt->up[
+                (k - 1) * stride + dt->up[(k - 1) * stride + i]
+            ];
     }
+
+    for (i = 0; i <= sg->length; ++i)
+        dt->size[i] = 1;
+    for (i = sg->length; i; --i)
+        if (dt->parent[i - 1] != ground)
+            dt->size[dt->parent[i - 1]] += dt->size[i - 1];
+    return dt;
 }
 
-void BrickArray_layer(struct BrickArray *ba)
+void RingQueue_push(struct RingQueue *queue, uint32_t index)
 {
-    uint32_t i, j, zlength, max_z;
+    assert(queue->length < queue->capacity);
+    queue->items[(queue->head + queue->length) % queue->capacity] = index;
+    ++(queue->length);
+}
 
-    BrickArray_zsort_end(ba);
-    for (i = 0; i < ba->length; ++i) {
-        max_z = 0;
-        for (j = 0; j < i; ++j) {
-            if (Brick_overlap_xy(ba->bricks[i], ba->bricks[j])) {
-                if (ba->bricks[j].end.z > max_z)
-                    max_z = ba->bricks[j].end.z;
-            }
+int RingQueue_pop(struct RingQueue *queue, uint32_t *dest)
+{
+    if (!queue->length) return 0;
+    *dest = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    --(queue->length);
+    return 1;
+}
+
+/* Number of other bricks that fall if brick index is disintegrated */
+uint32_t ChainWorker_simulate(struct ChainWorker *worker, uint32_t index)
+{
+    struct SupportGraph *sg;
+    uint32_t epoch, chain, current, dependant, i, j;
+    sg = worker->sg;
+    epoch = index + 1;
+    worker->fallen[index] = epoch;
+    RingQueue_push(&(worker->queue), index);
+    chain = 0;
+    while (RingQueue_pop(&(worker->queue), &current)) {
+        for (
+            i = sg->dependant_start[current];
+            i < sg->dependant_start[current + 1];
+            ++i
+        ) {
+            dependant = sg->dependants[i];
+            if (worker->fallen[dependant] == epoch) continue;
+            for (
+                j = sg->supporter_start[dependant];
+                j < sg->supporter_start[dependant + 1];
+                ++j
+            )
+                if (worker->fallen[sg->supporters[j]] != epoch) break;
+            if (j < sg->supporter_start[dependant + 1]) continue;
+            worker->fallen[dependant] = epoch;
+            ++chain;
+            RingQueue_push(&(worker->queue), dependant);
         }
-        zlength = ba->bricks[i].end.z - ba->bricks[i].start.z;
-        ba->bricks[i].start.z = max_z + 1;
-        ba->bricks[i].end.z = max_z + 1 + zlength;
     }
-    BrickArray_zsort_start(ba);
+    return chain;
+}
+
+void *ChainWorker_run(void *arg)
+{
+    struct ChainWorker *worker;
+    uint32_t i;
+    worker = arg;
+    for (i = worker->offset; i < worker->sg->length; i += worker->stride)
+        worker->total += ChainWorker_simulate(worker, i);
+    return NULL;
+}
+
+/*
+ * Disintegrates every brick in turn and lets the rest fall, spread over
+ * NUM_THREADS workers. Every worker allocates its scratch space once.
+ */
+unsigned long SupportGraph_simulate_chains(struct SupportGraph *sg)
+{
+    struct ChainWorker workers[NUM_THREADS];
+    uint32_t i, num_workers;
+    unsigned long total;
+
+    num_workers = sg->length < NUM_THREADS ? sg->length : NUM_THREADS;
+    for (i = 0; i < num_workers; ++i) {
+        workers[i] = (struct ChainWorker) {
+            .sg = sg,
+            .offset = i,
+            .stride = num_workers,
+            .fallen = calloc(sg->length, sizeof(*(workers[i].fallen))),
+            .queue = (struct RingQueue) {
+                .items = malloc(sg->length * sizeof(uint32_t)),
+                .head = 0,
+                .length = 0,
+                .capacity = sg->length
+            },
+            .total = 0,
+            .started = 0
+        };
+        assert(workers[i].fallen && workers[i].queue.items);
+        workers[i].started = pthread_create(
+            &(workers[i].thread), NULL, ChainWorker_run, workers + i
+        ) == 0;
+        /* Not fatal, just lose the parallelism for this one */
+        if (!workers[i].started)
+            ChainWorker_run(workers + i);
+    }
+    total = 0;
+    for (i = 0; i < num_workers; ++i) {
+        if (workers[i].started)
+            pthread_join(workers[i].thread, NULL);
+        total += workers[i].total;
+        free(workers[i].fallen);
+        free(workers[i].queue.items);
+    }
+    return total;
 }
 
 void BrickArray_print(struct BrickArray *ba)
@@ -481,21 +616,37 @@ void BrickArray_print(struct BrickArray *ba)
     }
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
     struct BrickArray *ba;
-    uint32_t total, i;
+    struct SupportGraph *sg;
+    struct DominatorTree *dt;
+    unsigned long total, simulated;
+    uint32_t i;
+    int ret;
     
     ba = BrickArray_create(0);
     if (!BrickArray_load(ba)) {
         BrickArray_free(ba);
         return 1;
     }
-    BrickArray_layer(ba);
-    for (i = total = 0; i < ba->length; ++i) {
-        total = total + BrickArray_count_chain(ba, i);
+    sg = BrickArray_settle(ba);
+    dt = SupportGraph_dominators(sg);
+    for (i = total = 0; i < dt->length; ++i)
+        total = total + dt->size[i] - 1;
+    printf("Total chain: %lu\n", total);
+    ret = 0;
+    /* Cross check the dominator tree against brute force */
+    if (argc > 1 && strcmp(argv[1], SIMULATE_FLAG) == 0) {
+        simulated = SupportGraph_simulate_chains(sg);
+        printf("Simulated chain: %lu\n", simulated);
+        if (simulated != total) {
+            puts("Simulation does not match the dominator tree");
+            ret = 1;
+        }
     }
-    printf("Total chain: %u\n", total);
+    DominatorTree_free(dt);
+    SupportGraph_free(sg);
     BrickArray_free(ba);
-    return 0;
+    return ret;
 }
@@ -1,146 +1,202 @@
 #include <stdio.h>
+#include <stdlib.h>
+
+#define MIN_SPANS   16U
+#define MIN_SYMBOLS 16U
+
+/* Number occupying columns [start, end) of its row */
+struct Span {
+    size_t start;
+    size_t end;
+    size_t value;
+};
+
+/* A row is kept only as its numbers and symbol columns, both sorted */
+struct Row {
+    struct Span *spans;
+    size_t num_spans;
+    size_t spans_capacity;
+    size_t *symbols;
+    size_t num_symbols;
+    size_t symbols_capacity;
+};
+
+int is_digit(int c)
+{
+    return c >= '0' && c <= '9';
+}
 
-#define MAX_ROW 140
-#define MAX_LINE MAX_ROW
+int is_symbol(int c)
+{
+    return c != '.' && !is_digit(c);
+}
 
-void load_file(char file[MAX_ROW][MAX_LINE])
+void Row_free(struct Row *row)
 {
-    size_t i, j;
+    free(row->spans);
+    free(row->symbols);
+}
 
-    for (i = 0; i < MAX_ROW; ++i) {
-        for (j = 0; j < MAX_LINE; ++j)
-            file[i][j] = getchar();
-        getchar();
+int Row_push_span(struct Row *row, struct Span span)
+{
+    struct Span *tmp;
+    size_t capacity;
+
+    if (row->num_spans == row->spans_capacity) {
+        capacity = row->spans_capacity ? row->spans_capacity * 2 : MIN_SPANS;
+        tmp = realloc(row->spans, capacity * sizeof(*tmp));
+        if (tmp == NULL) {
+            perror("realloc");
+            puts("Failed to grow spans");
+            return 0;
+        }
+        row->spans = tmp;
+        row->spans_capacity = capacity;
     }
+    row->spans[row->num_spans++] = span;
+    return 1;
 }
 
-int check_row(
-    char file[MAX_ROW][MAX_LINE],
-    size_t row,
-    size_t line_start,
-    size_t number_length
-)
+int Row_push_symbol(struct Row *row, size_t column)
 {
-    size_t i;
-
-    if (!line_start)
-        i = 0;
-    else
-        i = line_start - 1;
-    
-    while (i < MAX_LINE && i <= line_start + number_length) {
-        if (file[row][i] != '.')
-            return 1;
-        ++i;
+    size_t *tmp, capacity;
+
+    if (row->num_symbols == row->symbols_capacity) {
+        capacity = row->symbols_capacity
+            ? row->symbols_capacity * 2
+            : MIN_SYMBOLS;
+        tmp = realloc(row->symbols, capacity * sizeof(*tmp));
+        if (tmp == NULL) {
+            perror("realloc");
+            puts("Failed to grow symbols");
+            return 0;
+        }
+        row->symbols = tmp;
+        row->symbols_capacity = capacity;
     }
-    return 0;
+    row->symbols[row->num_symbols++] = column;
+    return 1;
 }
 
-int check_for_symbols(
-    char file[MAX_ROW][MAX_LINE],
-    size_t row,
-    size_t line_start,
-    size_t number_length
-)
+/*
+ * Tokenizes the next line of input into the row, reusing its storage.
+ * *more is cleared once the input is exhausted, which leaves the row empty.
+ */
+int Row_read(struct Row *row, int *more)
 {
-    int result;
-
-    result = 0;
-    if (line_start) {
-        result = result || file[row][line_start - 1] != '.';
-        if (result)
-            return result;
-    }
-    if (line_start + number_length < MAX_LINE) {
-        result = result || file[row][line_start + number_length] != '.';
-        if (result)
-            return result;
-    }
-    if (row) {
-        result = result || check_row(
-            file, row - 1, line_start, number_length
-        );
-        if (result)
-            return result;
+    struct Span span;
+    size_t column;
+    int c, in_number;
+
+    row->num_spans = row->num_symbols = 0;
+    span.start = span.value = 0;
+    in_number = 0;
+    for (column = 0; (c = getchar()) != EOF && c != '\n'; ++column) {
+        if (is_digit(c)) {
+            if (!in_number) {
+                span.start = column;
+                span.value = 0;
+                in_number = 1;
+            }
+            span.value = span.value * 10 + (size_t)(c - '0');
+            continue;
+        }
+        if (in_number) {
+            span.end = column;
+            if (!Row_push_span(row, span))
+                return 0;
+            in_number = 0;
+        }
+        if (is_symbol(c) && !Row_push_symbol(row, column))
+            return 0;
     }
-    if (row < MAX_ROW - 1) {
-        result = result || check_row(
-            file, row + 1, line_start, number_length
-        );
-        if (result)
-            return result;
+    if (in_number) {
+        span.end = column;
+        if (!Row_push_span(row, span))
+            return 0;
     }
-    return result;
+    *more = c != EOF || column > 0;
+    return 1;
 }
 
-size_t convert_number(
-    char file[MAX_ROW][MAX_LINE],
-    size_t row,
-    size_t line_start,
-    size_t number_length
+/*
+ * Moves the cursor past the symbols left of first and reports whether the
+ * next one falls within [first, last]. Queries must come in column order.
+ */
+int Row_has_symbol(
+    const struct Row *row,
+    size_t *cursor,
+    size_t first,
+    size_t last
 )
 {
-    size_t number, multiplier;
-    int i;
-
-    number = 0;
-    multiplier = 1;
-    for (i = line_start + number_length - 1; i >= (int)line_start; --i) {
-        number = number + multiplier * (size_t)(
-            file[row][i] - '0'
-        );
-        multiplier = multiplier * 10;
-    }
-    return number;
+    while (*cursor < row->num_symbols && row->symbols[*cursor] < first)
+        ++(*cursor);
+    return *cursor < row->num_symbols && row->symbols[*cursor] <= last;
 }
 
-size_t get_number(
-    char file[MAX_ROW][MAX_LINE],
-    size_t row, 
-    size_t line_start,
-    size_t *number
+size_t sum_part_numbers(
+    const struct Row *above,
+    const struct Row *row,
+    const struct Row *below
 )
 {
-    size_t number_length;
-
-    number_length = 0;
-    while (
-        line_start + number_length < MAX_LINE
-        && file[row][line_start + number_length] >= '0'
-        && file[row][line_start + number_length] <= '9'
-    )
-        ++number_length;
-
-    if (check_for_symbols(file, row, line_start, number_length)) {
-        *number = convert_number(file, row, line_start, number_length);
-    } else {
-        *number = 0;
+    size_t i, first, total, cursors[3];
+    const struct Span *span;
+
+    total = cursors[0] = cursors[1] = cursors[2] = 0;
+    for (i = 0; i < row->num_spans; ++i) {
+        span = row->spans + i;
+        first = span->start ? span->start - 1 : 0;
+        if (
+            Row_has_symbol(above, cursors, first, span->end)
+            || Row_has_symbol(row, cursors + 1, first, span->end)
+            || Row_has_symbol(below, cursors + 2, first, span->end)
+        )
+            total += span->value;
     }
-    return number_length;
+    return total;
 }
 
 int main(void)
 {
-    char file[MAX_ROW][MAX_LINE];
-    size_t total, i, j, number;
-    
-    load_file(file);
-
-    i = j = total = number = 0;
-
-    while (i < MAX_ROW) {
-        j = 0;
-        while (j < MAX_LINE) {
-            if (file[i][j] >= '0' && file[i][j] <= '9') {
-                j = j + get_number(file, i, j, &number);
-                total = total + number;
-            } else {
-                ++j;
-            }
-        }
-        ++i;
+    struct Row rows[3], *above, *row, *below, *tmp;
+    size_t i, total;
+    int more, ret;
+
+    for (i = 0; i < 3; ++i)
+        rows[i] = (struct Row) {
+            .spans = NULL,
+            .num_spans = 0,
+            .spans_capacity = 0,
+            .symbols = NULL,
+            .num_symbols = 0,
+            .symbols_capacity = 0
+        };
+    above = rows;
+    row = rows + 1;
+    below = rows + 2;
+
+    /* Only three rows are ever held, the one being summed and its sides */
+    ret = 1;
+    total = 0;
+    if (!Row_read(row, &more))
+        goto cleanup;
+    while (more) {
+        if (!Row_read(below, &more))
+            goto cleanup;
+        total += sum_part_numbers(above, row, below);
+        tmp = above;
+        above = row;
+        row = below;
+        below = tmp;
     }
-
     printf("Total = %zu\n", total);
-    return 0;
+    ret = 0;
+
+cleanup:
+    Row_free(rows);
+    Row_free(rows + 1);
+    Row_free(rows + 2);
+    return ret;
 }
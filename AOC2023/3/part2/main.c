@@ -1,196 +1,209 @@
 #include <stdio.h>
-
-#define MAX_ROW 140
-#define MAX_LINE MAX_ROW
-
-int is_digit(char c)
+#include <stdlib.h>
+
+#define MIN_SPANS   16U
+#define MIN_SYMBOLS 16U
+
+/* Number occupying columns [start, end) of its row */
+struct Span {
+    size_t start;
+    size_t end;
+    size_t value;
+};
+
+/* A row is kept only as its numbers and gear columns, both sorted */
+struct Row {
+    struct Span *spans;
+    size_t num_spans;
+    size_t spans_capacity;
+    size_t *symbols;
+    size_t num_symbols;
+    size_t symbols_capacity;
+};
+
+int is_digit(int c)
 {
-    return (c >= '0' && c <= '9');
+    return c >= '0' && c <= '9';
 }
 
-void load_file(char file[MAX_ROW][MAX_LINE])
+int is_gear(int c)
 {
-    size_t i, j;
-
-    for (i = 0; i < MAX_ROW; ++i) {
-        for (j = 0; j < MAX_LINE; ++j)
-            file[i][j] = getchar();
-        getchar();
-    }
+    return c == '*';
 }
 
-size_t convert_number(
-    char file[MAX_ROW][MAX_LINE],
-    size_t row,
-    size_t line_start,
-    size_t number_length
-)
+void Row_free(struct Row *row)
 {
-    size_t number, multiplier;
-    int i;
-
-    number = 0;
-    multiplier = 1;
-    for (i = line_start + number_length - 1; i >= (int)line_start; --i) {
-        number = number + multiplier * (size_t)(
-            file[row][i] - '0'
-        );
-        multiplier = multiplier * 10;
-    }
-    return number;
+    free(row->spans);
+    free(row->symbols);
 }
 
-size_t get_number(
-    char file[MAX_ROW][MAX_LINE],
-    size_t row, 
-    size_t line_start
-)
+int Row_push_span(struct Row *row, struct Span span)
 {
-    size_t number_length;
-
-    number_length = 0;
-    while (
-        line_start + number_length < MAX_LINE
-        && is_digit(file[row][line_start + number_length])
-    )
-        ++number_length;
-
-    return convert_number(file, row, line_start, number_length);
+    struct Span *tmp;
+    size_t capacity;
+
+    if (row->num_spans == row->spans_capacity) {
+        capacity = row->spans_capacity ? row->spans_capacity * 2 : MIN_SPANS;
+        tmp = realloc(row->spans, capacity * sizeof(*tmp));
+        if (tmp == NULL) {
+            perror("realloc");
+            puts("Failed to grow spans");
+            return 0;
+        }
+        row->spans = tmp;
+        row->spans_capacity = capacity;
+    }
+    row->spans[row->num_spans++] = span;
+    return 1;
 }
 
-size_t check_gear(char file[MAX_ROW][MAX_LINE], size_t row, size_t line_start)
+int Row_push_symbol(struct Row *row, size_t column)
 {
-    size_t num1, num2, number, start;
-
-    num1 = num2 = number = 0;
-    if (row) {
-        if (line_start && is_digit(file[row - 1][line_start - 1])) {
-            start = line_start - 1;
-            while (start && is_digit(file[row - 1][start])) {
-                --start;
-            }
-            if (!is_digit(file[row - 1][start]))
-                ++start;
-
-            number = get_number(file, row - 1, start);
-            if (!num1)
-                num1 = number;
-            else if (!num2)
-                num2 = number;
-            else
-                return 0;
-        }
-        if (is_digit(file[row - 1][line_start])) {
-            if (!(line_start && is_digit(file[row - 1][line_start - 1]))) {
-                number = get_number(file, row - 1, line_start);
-                if (!num1)
-                    num1 = number;
-                else if (!num2)
-                    num2 = number;
-                else
-                    return 0;
-            }
-        }
-        if (line_start < MAX_LINE - 1 && is_digit(file[row - 1][line_start + 1])) {
-            if (!is_digit(file[row - 1][line_start])) {
-                number = get_number(file, row - 1, line_start + 1);
-                if (!num1)
-                    num1 = number;
-                else if (!num2)
-                    num2 = number;
-                else
-                    return 0;
-            }
+    size_t *tmp, capacity;
+
+    if (row->num_symbols == row->symbols_capacity) {
+        capacity = row->symbols_capacity
+            ? row->symbols_capacity * 2
+            : MIN_SYMBOLS;
+        tmp = realloc(row->symbols, capacity * sizeof(*tmp));
+        if (tmp == NULL) {
+            perror("realloc");
+            puts("Failed to grow symbols");
+            return 0;
         }
+        row->symbols = tmp;
+        row->symbols_capacity = capacity;
     }
-    if (row < MAX_ROW - 1) {
-        if (line_start && is_digit(file[row + 1][line_start - 1])) {
-            start = line_start - 1;
-            while (start && is_digit(file[row + 1][start])) {
-                --start;
-            }
-            if (!is_digit(file[row + 1][start]))
-                ++start;
-
-            number = get_number(file, row + 1, start);
-            if (!num1)
-                num1 = number;
-            else if (!num2)
-                num2 = number;
-            else
-                return 0;
-        }
-        if (is_digit(file[row + 1][line_start])) {
-            if (!(line_start && is_digit(file[row + 1][line_start - 1]))) {
-                number = get_number(file, row + 1, line_start);
-                if (!num1)
-                    num1 = number;
-                else if (!num2)
-                    num2 = number;
-                else
-                    return 0;
-            }
-        }
-        if (line_start < MAX_LINE - 1 && is_digit(file[row + 1][line_start + 1])) {
-            if (!is_digit(file[row + 1][line_start])) {
-                number = get_number(file, row + 1, line_start + 1);
-                if (!num1)
-                    num1 = number;
-                else if (!num2)
-                    num2 = number;
-                else
-                    return 0;
+    row->symbols[row->num_symbols++] = column;
+    return 1;
+}
+
+/*
+ * Tokenizes the next line of input into the row, reusing its storage.
+ * *more is cleared once the input is exhausted, which leaves the row empty.
+ */
+int Row_read(struct Row *row, int *more)
+{
+    struct Span span;
+    size_t column;
+    int c, in_number;
+
+    row->num_spans = row->num_symbols = 0;
+    span.start = span.value = 0;
+    in_number = 0;
+    for (column = 0; (c = getchar()) != EOF && c != '\n'; ++column) {
+        if (is_digit(c)) {
+            if (!in_number) {
+                span.start = column;
+                span.value = 0;
+                in_number = 1;
             }
+            span.value = span.value * 10 + (size_t)(c - '0');
+            continue;
         }
-    }
-    if (line_start) {
-        if (is_digit(file[row][line_start - 1])) {
-            start = line_start - 1;
-            while (start && is_digit(file[row][start])) {
-                --start;
-            }
-            if (!is_digit(file[row][start]))
-                ++start;
-
-            number = get_number(file, row, start);
-            if (!num1)
-                num1 = number;
-            else if (!num2)
-                num2 = number;
-            else
+        if (in_number) {
+            span.end = column;
+            if (!Row_push_span(row, span))
                 return 0;
+            in_number = 0;
         }
+        if (is_gear(c) && !Row_push_symbol(row, column))
+            return 0;
     }
-    if (line_start < MAX_LINE - 1) {
-        if (is_digit(file[row][line_start + 1])) {
-            number = get_number(file, row, line_start + 1);
-            if (!num1)
-                num1 = number;
-            else if (!num2)
-                num2 = number;
-            else
-                return 0;
-        }
+    if (in_number) {
+        span.end = column;
+        if (!Row_push_span(row, span))
+            return 0;
     }
-    return num1 * num2;
+    *more = c != EOF || column > 0;
+    return 1;
 }
 
-int main(void)
+/*
+ * Moves the cursor past the numbers ending left of first, then counts the
+ * numbers touching [first, last] and multiplies them into *product. Queries
+ * must come in column order.
+ */
+size_t Row_touching_spans(
+    const struct Row *row,
+    size_t *cursor,
+    size_t first,
+    size_t last,
+    size_t *product
+)
 {
-    char file[MAX_ROW][MAX_LINE];
-    size_t total, i, j;
-    
-    load_file(file);
+    size_t i;
 
-    total = 0;
+    while (*cursor < row->num_spans && row->spans[*cursor].end <= first)
+        ++(*cursor);
+    for (i = *cursor; i < row->num_spans && row->spans[i].start <= last; ++i)
+        *product *= row->spans[i].value;
+    return i - *cursor;
+}
 
-    for (i = 0; i < MAX_ROW; ++i) {
-        for (j = 0; j < MAX_LINE; ++j) {
-            if (file[i][j] == '*')
-                total = total + check_gear(file, i, j);
-        }
+size_t sum_gear_ratios(
+    const struct Row *above,
+    const struct Row *row,
+    const struct Row *below
+)
+{
+    size_t i, first, last, total, touching, ratio, cursors[3];
+
+    total = cursors[0] = cursors[1] = cursors[2] = 0;
+    for (i = 0; i < row->num_symbols; ++i) {
+        first = row->symbols[i] ? row->symbols[i] - 1 : 0;
+        last = row->symbols[i] + 1;
+        ratio = 1;
+        touching = Row_touching_spans(above, cursors, first, last, &ratio);
+        touching += Row_touching_spans(row, cursors + 1, first, last, &ratio);
+        touching += Row_touching_spans(
+            below, cursors + 2, first, last, &ratio
+        );
+        if (touching == 2)
+            total += ratio;
     }
+    return total;
+}
 
+int main(void)
+{
+    struct Row rows[3], *above, *row, *below, *tmp;
+    size_t i, total;
+    int more, ret;
+
+    for (i = 0; i < 3; ++i)
+        rows[i] = (struct Row) {
+            .spans = NULL,
+            .num_spans = 0,
+            .spans_capacity = 0,
+            .symbols = NULL,
+            .num_symbols = 0,
+            .symbols_capacity = 0
+        };
+    above = rows;
+    row = rows + 1;
+    below = rows + 2;
+
+    /* Only three rows are ever held, the one being summed and its sides */
+    ret = 1;
+    total = 0;
+    if (!Row_read(row, &more))
+        goto cleanup;
+    while (more) {
+        if (!Row_read(below, &more))
+            goto cleanup;
+        total += sum_gear_ratios(above, row, below);
+        tmp = above;
+        above = row;
+        row = below;
+        below = tmp;
+    }
     printf("Total = %zu\n", total);
-    return 0;
+    ret = 0;
+
+cleanup:
+    Row_free(rows);
+    Row_free(rows + 1);
+    Row_free(rows + 2);
+    return ret;
 }
@@ -1,128 +1,108 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 
-#define MAX_LINE 200
-#define WINNING_NUMBERS 10
+/* Card numbers are below 100, so two words hold any set of them */
+#define MAX_NUMBER      128U
+#define NUMBER_WORDS    (MAX_NUMBER / 64U)
 
-int is_digit(char c)
-{
-    return c >= '0' && c <= '9';
-}
+#define NO_CARD     SIZE_MAX
+#define SCORE_BITS  (sizeof(unsigned long) * 8U)
 
-int is_winning(int number, int winning[WINNING_NUMBERS])
-{
-    size_t i;
+struct Card {
+    uint64_t winning[NUMBER_WORDS];
+    uint64_t have[NUMBER_WORDS];
+};
 
-    for (i = 0; i < WINNING_NUMBERS; ++i)
-        if (number == winning[i])
-            return 1;
-    return 0;
-}
-
-size_t get_line(char line[], size_t max_line)
+int is_digit(int c)
 {
-    int c;
-    size_t i;
-
-    for (
-        i = 0;
-        (c = getchar()) != EOF && c != '\n' && i < max_line - 1;
-        ++i
-    ) {
-        line[i] = c;
-    }
-
-    line[i] = '\0';
-    return i;
+    return c >= '0' && c <= '9';
 }
 
-int seek_first_number(char **p_line)
+int NumberSet_add(uint64_t set[NUMBER_WORDS], size_t number)
 {
-    while (**p_line && **p_line != ':')
-        ++(*p_line);
-    
-    while (**p_line && !is_digit(**p_line))
-        ++(*p_line);
-
-    if (!**p_line) {
-        puts("ERROR: Could not seek first number!");
+    if (number >= MAX_NUMBER) {
+        printf("Card number %zu is out of range\n", number);
         return 0;
     }
+    set[number / 64U] |= (uint64_t)1 << (number % 64U);
     return 1;
 }
 
-int get_number(char **p_line)
+size_t Card_matches(const struct Card *card)
 {
-    char *base, *end;
-    int number, multiplier;
+    size_t i, matches;
 
-    base = *p_line;
-    while (**p_line && is_digit(**p_line))
-        ++(*p_line);
+    for (i = matches = 0; i < NUMBER_WORDS; ++i)
+        matches += (size_t)__builtin_popcountll(
+            card->winning[i] & card->have[i]
+        );
+    return matches;
+}
 
-    end = *p_line;
-    --(*p_line);
+/*
+ * Reads the next line straight into the card's bitsets and stores its match
+ * count, or NO_CARD for a line without a card. *more is cleared once the
+ * input is exhausted.
+ */
+int Card_read(size_t *matches, int *more)
+{
+    struct Card card;
+    uint64_t *set;
+    size_t number, column;
+    int c, in_number;
 
+    memset(&card, 0, sizeof(card));
+    set = NULL;
     number = 0;
-    multiplier = 1;
-
-    while (*p_line != base) {
-        number = number + multiplier * (int)(**p_line - '0');
-        multiplier = multiplier * 10;
-        --(*p_line);
+    in_number = 0;
+    for (column = 0; (c = getchar()) != EOF && c != '\n'; ++column) {
+        /* Digits before the ':' are the card id */
+        if (set != NULL && is_digit(c)) {
+            /* Saturates so that overlong numbers still get reported */
+            if (number < MAX_NUMBER)
+                number = number * 10 + (size_t)(c - '0');
+            in_number = 1;
+            continue;
+        }
+        if (in_number) {
+            if (!NumberSet_add(set, number))
+                return 0;
+            number = 0;
+            in_number = 0;
+        }
+        if (c == ':')
+            set = card.winning;
+        else if (c == '|')
+            set = card.have;
     }
-    number = number + multiplier * (int)(**p_line - '0');
-    *p_line = end;
-    return number;
-}
+    if (in_number && !NumberSet_add(set, number))
+        return 0;
 
-int seek_next_number(char **p_line)
-{
-    if (!**p_line) return 0;
-    while (**p_line && !is_digit(**p_line) && **p_line != '|')
-        ++(*p_line);
-    
-    if (**p_line == '|') {
-        ++(*p_line);
-        return -1;
-    } else {
-        return 1;
-    }
+    *matches = set == NULL ? NO_CARD : Card_matches(&card);
+    *more = c != EOF;
+    return 1;
 }
 
 int main(void)
 {
-    char line[MAX_LINE];
-    int winning[WINNING_NUMBERS], number, score, total;
-    char *line_pointer;
-    size_t i;
+    unsigned long total;
+    size_t matches;
+    int more;
 
     total = 0;
-    while (get_line(line, MAX_LINE) != 0) {
-        line_pointer = line;
-        if (!seek_first_number(&line_pointer)) return 1;
-        number = get_number(&line_pointer);
-        winning[0] = number;
-        i = 1;
-        while (seek_next_number(&line_pointer) != -1) {
-            winning[i] = get_number(&line_pointer);
-            ++i;
-        }
-        if (i != WINNING_NUMBERS) {
-            puts("Failed to parse winning numbers!");
+    more = 1;
+    while (more) {
+        if (!Card_read(&matches, &more))
+            return 1;
+        if (matches == NO_CARD || matches == 0)
+            continue;
+        if (matches > SCORE_BITS) {
+            printf("Score of a card with %zu matches overflows\n", matches);
             return 1;
         }
-        score = 0;
-        while (seek_next_number(&line_pointer)) {
-            number = get_number(&line_pointer);
-            if (is_winning(number, winning)) {
-                if (!score)
-                    score = 1;
-                else
-                    score = 2 * score;
-            }
-        }
-        total = total + score;
+        total += 1UL << (matches - 1);
     }
-    printf("total = %d\n", total);
+    printf("total = %lu\n", total);
     return 0;
 }
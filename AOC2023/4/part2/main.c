@@ -1,135 +1,220 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 
-#define MAX_LINE 200
-#define WINNING_NUMBERS 10
-#define NUM_CARDS 204
+#include "numtheory.h"
 
-int is_digit(char c)
+/* Card numbers are below 100, so two words hold any set of them */
+#define MAX_NUMBER      128U
+#define NUMBER_WORDS    (MAX_NUMBER / 64U)
+
+#define NO_CARD         SIZE_MAX
+#define MIN_MATCHARRAY  256U
+
+struct Card {
+    uint64_t winning[NUMBER_WORDS];
+    uint64_t have[NUMBER_WORDS];
+};
+
+/* Match count of every card, in input order */
+struct MatchArray {
+    size_t *matches;
+    size_t length;
+    size_t capacity;
+};
+
+int is_digit(int c)
 {
     return c >= '0' && c <= '9';
 }
 
-int is_winning(int number, int winning[WINNING_NUMBERS])
+int NumberSet_add(uint64_t set[NUMBER_WORDS], size_t number)
 {
-    size_t i;
-
-    for (i = 0; i < WINNING_NUMBERS; ++i)
-        if (number == winning[i])
-            return 1;
-    return 0;
+    if (number >= MAX_NUMBER) {
+        printf("Card number %zu is out of range\n", number);
+        return 0;
+    }
+    set[number / 64U] |= (uint64_t)1 << (number % 64U);
+    return 1;
 }
 
-size_t get_line(char line[], size_t max_line)
+size_t Card_matches(const struct Card *card)
 {
-    int c;
-    size_t i;
-
-    for (
-        i = 0;
-        (c = getchar()) != EOF && c != '\n' && i < max_line - 1;
-        ++i
-    ) {
-        line[i] = c;
-    }
+    size_t i, matches;
 
-    line[i] = '\0';
-    return i;
+    for (i = matches = 0; i < NUMBER_WORDS; ++i)
+        matches += (size_t)__builtin_popcountll(
+            card->winning[i] & card->have[i]
+        );
+    return matches;
 }
 
-int seek_first_number(char **p_line)
+/*
+ * Reads the next line straight into the card's bitsets and stores its match
+ * count, or NO_CARD for a line without a card. *more is cleared once the
+ * input is exhausted.
+ */
+int Card_read(size_t *matches, int *more)
 {
-    while (**p_line && **p_line != ':')
-        ++(*p_line);
-    
-    while (**p_line && !is_digit(**p_line))
-        ++(*p_line);
-
-    if (!**p_line) {
-        puts("ERROR: Could not seek first number!");
-        return 0;
+    struct Card card;
+    uint64_t *set;
+    size_t number, column;
+    int c, in_number;
+
+    memset(&card, 0, sizeof(card));
+    set = NULL;
+    number = 0;
+    in_number = 0;
+    for (column = 0; (c = getchar()) != EOF && c != '\n'; ++column) {
+        /* Digits before the ':' are the card id */
+        if (set != NULL && is_digit(c)) {
+            /* Saturates so that overlong numbers still get reported */
+            if (number < MAX_NUMBER)
+                number = number * 10 + (size_t)(c - '0');
+            in_number = 1;
+            continue;
+        }
+        if (in_number) {
+            if (!NumberSet_add(set, number))
+                return 0;
+            number = 0;
+            in_number = 0;
+        }
+        if (c == ':')
+            set = card.winning;
+        else if (c == '|')
+            set = card.have;
     }
+    if (in_number && !NumberSet_add(set, number))
+        return 0;
+
+    *matches = set == NULL ? NO_CARD : Card_matches(&card);
+    *more = c != EOF;
     return 1;
 }
 
-int get_number(char **p_line)
+struct MatchArray *MatchArray_create(size_t start_capacity)
 {
-    char *base, *end;
-    int number, multiplier;
-
-    base = *p_line;
-    while (**p_line && is_digit(**p_line))
-        ++(*p_line);
-
-    end = *p_line;
-    --(*p_line);
+    struct MatchArray *ma;
+    if (start_capacity < MIN_MATCHARRAY)
+        start_capacity = MIN_MATCHARRAY;
+    ma = malloc(sizeof(*ma));
+    if (!ma) {
+        perror("malloc");
+        puts("Failed to allocate MatchArray");
+        return NULL;
+    }
+    ma->matches = malloc(start_capacity * sizeof(*(ma->matches)));
+    if (!ma->matches) {
+        perror("malloc");
+        puts("Failed to allocate MatchArray->matches");
+        free(ma);
+        return NULL;
+    }
+    ma->length = 0;
+    ma->capacity = start_capacity;
+    return ma;
+}
 
-    number = 0;
-    multiplier = 1;
+void MatchArray_free(struct MatchArray *ma)
+{
+    if (!ma) return;
+    free(ma->matches);
+    free(ma);
+}
 
-    while (*p_line != base) {
-        number = number + multiplier * (int)(**p_line - '0');
-        multiplier = multiplier * 10;
-        --(*p_line);
+int MatchArray_push(struct MatchArray *ma, size_t matches)
+{
+    size_t *tmp;
+    if (ma->length == ma->capacity) {
+        tmp = realloc(ma->matches, ma->capacity * 2 * sizeof(*tmp));
+        if (!tmp) {
+            perror("realloc");
+            puts("Failed to grow MatchArray");
+            return 0;
+        }
+        ma->matches = tmp;
+        ma->capacity *= 2;
     }
-    number = number + multiplier * (int)(**p_line - '0');
-    *p_line = end;
-    return number;
+    ma->matches[ma->length++] = matches;
+    return 1;
 }
 
-int seek_next_number(char **p_line)
+/*
+ * Every card hands its copies to each of the next matches cards. Instead of
+ * touching them one by one the copies join a running sum and are recorded
+ * where that run ends, so taking them off there yields each card's count.
+ * Runs are clamped at the last card. Returns 0 if a count overflows.
+ */
+int MatchArray_count_cards(const struct MatchArray *ma, uint128_t *total)
 {
-    if (!**p_line) return 0;
-    while (**p_line && !is_digit(**p_line) && **p_line != '|')
-        ++(*p_line);
-    
-    if (**p_line == '|') {
-        ++(*p_line);
-        return -1;
-    } else {
-        return 1;
+    uint128_t *ends, running, copies;
+    size_t i, end;
+    int ret;
+
+    ends = calloc(ma->length + 1, sizeof(*ends));
+    if (!ends) {
+        perror("calloc");
+        puts("Failed to allocate card run ends");
+        return 0;
     }
+    ret = 0;
+    *total = running = 0;
+    for (i = 0; i < ma->length; ++i) {
+        running -= ends[i];
+        if (
+            __builtin_add_overflow(running, 1, &copies)
+            || __builtin_add_overflow(*total, copies, total)
+        )
+            goto overflow;
+        end = ma->matches[i] < ma->length - i
+            ? i + 1 + ma->matches[i]
+            : ma->length;
+        if (end == i + 1)
+            continue;
+        if (__builtin_add_overflow(running, copies, &running))
+            goto overflow;
+        /* Never more than running, so this cannot overflow either */
+        ends[end] += copies;
+    }
+    ret = 1;
+    goto cleanup;
+
+overflow:
+    puts("Card count does not fit in 128 bits");
+cleanup:
+    free(ends);
+    return ret;
 }
 
 int main(void)
 {
-    char line[MAX_LINE];
-    int winning[WINNING_NUMBERS], cards[NUM_CARDS], matches, number, total;
-    char *line_pointer;
-    size_t i, card, start;
-
-    for (i = 0; i < NUM_CARDS; ++i)
-        cards[i] = 1;
-
-    total = card = 0;
-    while (get_line(line, MAX_LINE) != 0) {
-        line_pointer = line;
-        total = total + cards[card];
-        if (!seek_first_number(&line_pointer)) return 1;
-        number = get_number(&line_pointer);
-        winning[0] = number;
-        i = 1;
-        while (seek_next_number(&line_pointer) != -1) {
-            winning[i] = get_number(&line_pointer);
-            ++i;
-        }
-        if (i != WINNING_NUMBERS) {
-            puts("Failed to parse winning numbers!");
+    struct MatchArray *ma;
+    char total_str[UINT128_STRING_LEN];
+    uint128_t total;
+    size_t matches;
+    int more;
+
+    ma = MatchArray_create(0);
+    if (!ma)
+        return 1;
+    more = 1;
+    while (more) {
+        if (!Card_read(&matches, &more)) {
+            MatchArray_free(ma);
             return 1;
         }
-        matches = 0;
-        while (seek_next_number(&line_pointer)) {
-            number = get_number(&line_pointer);
-            if (is_winning(number, winning)) {
-                ++matches;
-            }
+        if (matches != NO_CARD && !MatchArray_push(ma, matches)) {
+            MatchArray_free(ma);
+            return 1;
         }
-        start = card + matches;
-        if (start >= NUM_CARDS)
-            start = NUM_CARDS - 1;
-        for (i = start; i > card; --i)
-            cards[i] = cards[i] + cards[card];
-        ++card;
     }
-    printf("total = %d\n", total);
+    if (!MatchArray_count_cards(ma, &total)) {
+        MatchArray_free(ma);
+        return 1;
+    }
+    printf("total = %s\n", uint128_to_string(total, total_str));
+    MatchArray_free(ma);
     return 0;
 }
@@ -1,131 +1,537 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
 
-#define MAX_SIZE 65536
-#define NUM_SEEDS 20
+#define BATCH_SIZE 4096 * 16
+#define MIN_RANGEARRAY 16
+#define MIN_INTERVALMAP 16
+
+struct Range {
+    long min;
+    long max;
+};
+
+struct Map {
+    struct Range source;
+    struct Range destination;
+};
+
+struct RangeArray {
+    struct Range *ranges;
+    size_t length;
+    size_t capacity;
+};
+
+/* Piecewise linear map sorted by source, once normalized the sources
+ * cover 0..LONG_MAX without gaps or overlaps
+ */
+struct IntervalMap {
+    struct Map *maps;
+    size_t length;
+    size_t capacity;
+};
+
+long min(long number, long other)
+{
+    if (number <= other)
+        return number;
+    return other;
+}
+
+long max(long number, long other)
+{
+    if (number >= other)
+        return number;
+    return other;
+}
 
 int is_digit(char c)
 {
     return c >= '0' && c <= '9';
 }
 
-int load_file(char buf[], size_t max_size)
+/* Skips past the next target character, returns 0 at EOF */
+int skip_past(FILE *file, int target)
 {
-    size_t i;
     int c;
-    for (i = 0; (c = getchar()) != EOF && i < max_size - 1; ++i)
-        buf[i] = c;
-    buf[i] = '\0';
-    if (c != EOF) {
-        puts("Could not load entire file into memory!");
+    while ((c = getc(file)) != EOF)
+        if (c == target)
+            return 1;
+    return 0;
+}
+
+/* Reads the next number on the current line
+ * Returns 0 without consuming anything if the line has no more numbers
+ */
+int read_number(FILE *file, long *number)
+{
+    int c;
+    while ((c = getc(file)) == ' ');
+    if (!is_digit(c)) {
+        if (c != EOF) ungetc(c, file);
         return 0;
     }
+    for (*number = 0; is_digit(c); c = getc(file))
+        *number = *number * 10 + (c - '0');
+    if (c != EOF) ungetc(c, file);
     return 1;
 }
 
-int seek_next_colon(char **p_file)
+struct RangeArray *RangeArray_create(size_t start_capacity)
 {
-    while (**p_file && **p_file != ':')
-        ++(*p_file);
-    return **p_file != '\0';
+    struct RangeArray *ra;
+    if (start_capacity < MIN_RANGEARRAY)
+        start_capacity = MIN_RANGEARRAY;
+    ra = malloc(sizeof(*ra));
+    if (!ra) {
+        perror("malloc");
+        puts("Failed to allocate RangeArray");
+        return NULL;
+    }
+    ra->ranges = malloc(start_capacity * sizeof(*(ra->ranges)));
+    if (!ra->ranges) {
+        perror("malloc");
+        puts("Failed to allocate RangeArray->ranges");
+        free(ra);
+        return NULL;
+    }
+    ra->length = 0;
+    ra->capacity = start_capacity;
+    return ra;
 }
 
-long get_number(char **p_file)
+void RangeArray_free(struct RangeArray *ra)
 {
-    long number, multiplier;
-    char *start, *end;
+    if (!ra) return;
+    free(ra->ranges);
+    ra->ranges = NULL;
+    free(ra);
+}
 
-    start = *p_file;
-    while (**p_file && is_digit(**p_file))
-        ++(*p_file);
+int RangeArray_push(struct RangeArray *ra, struct Range range)
+{
+    struct Range *temp;
+    if (ra->length >= ra->capacity) {
+        temp = realloc(ra->ranges, 2 * ra->capacity * sizeof(*temp));
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow RangeArray");
+            return 0;
+        }
+        ra->ranges = temp;
+        ra->capacity *= 2;
+    }
+    ra->ranges[(ra->length)++] = range;
+    return 1;
+}
 
-    end = *p_file;
-    if (!is_digit(**p_file))
-        --(*p_file);
+struct IntervalMap *IntervalMap_create(size_t start_capacity)
+{
+    struct IntervalMap *im;
+    if (start_capacity < MIN_INTERVALMAP)
+        start_capacity = MIN_INTERVALMAP;
+    im = malloc(sizeof(*im));
+    if (!im) {
+        perror("malloc");
+        puts("Failed to allocate IntervalMap");
+        return NULL;
+    }
+    im->maps = malloc(start_capacity * sizeof(*(im->maps)));
+    if (!im->maps) {
+        perror("malloc");
+        puts("Failed to allocate IntervalMap->maps");
+        free(im);
+        return NULL;
+    }
+    im->length = 0;
+    im->capacity = start_capacity;
+    return im;
+}
+
+void IntervalMap_free(struct IntervalMap *im)
+{
+    if (!im) return;
+    free(im->maps);
+    im->maps = NULL;
+    free(im);
+}
+
+int IntervalMap_push(struct IntervalMap *im, long min, long max, long offset)
+{
+    struct Map *temp, *last;
+    /* Merge with the previous piece if it continues it exactly */
+    if (im->length) {
+        last = im->maps + im->length - 1;
+        if (
+            last->source.max + 1 == min
+            && last->destination.min - last->source.min == offset
+        ) {
+            last->source.max = max;
+            last->destination.max = max + offset;
+            return 1;
+        }
+    }
+    if (im->length >= im->capacity) {
+        temp = realloc(im->maps, 2 * im->capacity * sizeof(*temp));
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow IntervalMap");
+            return 0;
+        }
+        im->maps = temp;
+        im->capacity *= 2;
+    }
+    im->maps[(im->length)++] = (struct Map) {
+        .source = (struct Range) { .min = min, .max = max },
+        .destination = (struct Range) { .min = min + offset, .max = max + offset }
+    };
+    return 1;
+}
 
-    number = 0;
-    multiplier = 1;
-    while (*p_file != start) {
-        number = number + multiplier * (long)(**p_file - '0');
-        multiplier = multiplier * 10;
-        --(*p_file);
+struct IntervalMap *IntervalMap_identity(void)
+{
+    struct IntervalMap *im;
+    im = IntervalMap_create(0);
+    if (!im) return NULL;
+    if (!IntervalMap_push(im, 0, LONG_MAX, 0)) {
+        IntervalMap_free(im);
+        return NULL;
     }
-    number = number + multiplier * (long)(**p_file - '0');
+    return im;
+}
 
-    *p_file = end;
-    return number;
+int Map_compare_source(const void *map, const void *other)
+{
+    const struct Map *a = map, *b = other;
+    if (a->source.min < b->source.min) return -1;
+    return a->source.min > b->source.min;
 }
 
-int load_seeds(char **p_file, long seeds[], size_t num_seeds)
+/* Sorts the lines of a map and fills the gaps with identity pieces
+ * Overlapping lines are clipped to start after the previous one
+ */
+struct IntervalMap *IntervalMap_normalize(struct IntervalMap *raw)
 {
+    struct IntervalMap *im;
+    struct Map *map;
+    long next, offset;
     size_t i;
-    seek_next_colon(p_file);
-    if (*(*p_file + 1))
-        ++(*p_file);
-    else {
-        puts("ERROR: Reached EOF while parsing");
-        return 1;
+
+    qsort(raw->maps, raw->length, sizeof(*(raw->maps)), Map_compare_source);
+    im = IntervalMap_create(2 * raw->length + 1);
+    if (!im) return NULL;
+    next = 0;
+    for (i = 0; i < raw->length; ++i) {
+        map = raw->maps + i;
+        if (map->source.max < next) continue;
+        offset = map->destination.min - map->source.min;
+        if (
+            (map->source.min > next
+            && !IntervalMap_push(im, next, map->source.min - 1, 0))
+            || !IntervalMap_push(
+                im, max(map->source.min, next), map->source.max, offset
+            )
+        ) {
+            IntervalMap_free(im);
+            return NULL;
+        }
+        if (map->source.max == LONG_MAX) return im;
+        next = map->source.max + 1;
     }
-    
-    i = 0;
-    while (is_digit(*(++(*p_file))) && i < num_seeds) {
-        seeds[i] = get_number(p_file);
-        ++i;
+    if (!IntervalMap_push(im, next, LONG_MAX, 0)) {
+        IntervalMap_free(im);
+        return NULL;
     }
-    return !is_digit(**p_file);
+    return im;
 }
 
-int convert_numbers(char **p_file, long numbers[], size_t max_num)
+/* Loads the lines following a map header */
+struct IntervalMap *IntervalMap_load(void)
 {
-    long destination, source, range;
-    int converted[max_num];
-    size_t i;
+    struct IntervalMap *raw, *im;
+    long min, length, destination;
+
+    raw = IntervalMap_create(0);
+    if (!raw) return NULL;
+    skip_past(stdin, '\n');
+    while (read_number(stdin, &destination)) {
+        if (!read_number(stdin, &min) || !read_number(stdin, &length)) {
+            puts("ERROR: Malformed map line");
+            IntervalMap_free(raw);
+            return NULL;
+        }
+        if (
+            length > 0
+            && !IntervalMap_push(raw, min, min + length - 1, destination - min)
+        ) {
+            IntervalMap_free(raw);
+            return NULL;
+        }
+        if (!skip_past(stdin, '\n')) break;
+    }
+    im = IntervalMap_normalize(raw);
+    IntervalMap_free(raw);
+    return im;
+}
 
-    for (i = 0; i < max_num; ++i)
-        converted[i] = 0;
+/* Index of the piece whose source contains value */
+size_t IntervalMap_find(struct IntervalMap *im, long value)
+{
+    size_t low, high, mid;
+    low = 0;
+    high = im->length - 1;
+    while (low < high) {
+        mid = low + (high - low + 1) / 2;
+        if (im->maps[mid].source.min <= value) low = mid;
+        else high = mid - 1;
+    }
+    return low;
+}
+
+/* Builds the map equivalent to applying first then second */
+struct IntervalMap *IntervalMap_compose(
+    struct IntervalMap *first, struct IntervalMap *second
+)
+{
+    struct IntervalMap *im;
+    struct Map *map, *next;
+    long start, end, offset;
+    size_t i, j;
 
-    while (*(++(*p_file)) && is_digit(**p_file)) {
-        destination = get_number(p_file);
-        if (!**p_file || !*(++(*p_file))) return 0;
-        source = get_number(p_file);
-        if (!**p_file || !*(++(*p_file))) return 0;
-        range = get_number(p_file);
-        for (i = 0; i < max_num; ++i) {
+    im = IntervalMap_create(first->length + second->length);
+    if (!im) return NULL;
+    for (i = 0; i < first->length; ++i) {
+        map = first->maps + i;
+        offset = map->destination.min - map->source.min;
+        start = map->source.min;
+        j = IntervalMap_find(second, map->destination.min);
+        for (; j < second->length; ++j) {
+            next = second->maps + j;
+            if (next->source.min > map->destination.max) break;
+            end = start + (
+                min(next->source.max, map->destination.max)
+                - max(next->source.min, map->destination.min)
+            );
             if (
-                !converted[i]
-                && numbers[i] - source < range
-                && numbers[i] - source >= 0
+                !IntervalMap_push(
+                    im,
+                    start,
+                    end,
+                    offset + next->destination.min - next->source.min
+                )
             ) {
-                numbers[i] = destination + numbers[i] - source;
-                converted[i] = 1;
+                IntervalMap_free(im);
+                return NULL;
             }
+            if (end == map->source.max) break;
+            start = end + 1;
+        }
+    }
+    return im;
+}
+
+int Range_compare(const void *range, const void *other)
+{
+    const struct Range *a = range, *b = other;
+    if (a->min < b->min) return -1;
+    return a->min > b->min;
+}
+
+/* Sorts ranges and merges the overlapping or adjacent ones in place
+ * Returns the new number of ranges
+ */
+size_t Range_sort_merge(struct Range ranges[], size_t length)
+{
+    size_t i, merged;
+    if (!length) return 0;
+    qsort(ranges, length, sizeof(*ranges), Range_compare);
+    for (i = 1, merged = 0; i < length; ++i) {
+        if (ranges[i].min <= ranges[merged].max + 1) {
+            ranges[merged].max = max(ranges[merged].max, ranges[i].max);
+        } else {
+            ranges[++merged] = ranges[i];
+        }
+    }
+    return merged + 1;
+}
+
+/* Splits sorted, disjoint ranges across the pieces of the map and
+ * appends their images to out
+ */
+int IntervalMap_apply(
+    struct IntervalMap *im,
+    struct Range ranges[],
+    size_t length,
+    struct RangeArray *out
+)
+{
+    size_t i, j;
+    long start, end, offset;
+
+    j = 0;
+    for (i = 0; i < length; ++i) {
+        /* Inputs are sorted so the search only moves forward */
+        if (im->maps[j].source.max < ranges[i].min)
+            j = IntervalMap_find(im, ranges[i].min);
+        for (
+            start = ranges[i].min;
+            j < im->length && im->maps[j].source.min <= ranges[i].max;
+            ++j
+        ) {
+            end = min(im->maps[j].source.max, ranges[i].max);
+            offset = im->maps[j].destination.min - im->maps[j].source.min;
+            if (
+                !RangeArray_push(
+                    out,
+                    (struct Range) {
+                        .min = start + offset, .max = end + offset
+                    }
+                )
+            ) return 0;
+            if (end == ranges[i].max) break;
+            start = end + 1;
         }
     }
     return 1;
 }
 
+/* Pushes one batch of seeds through the almanac and folds the
+ * lowest location into min_location
+ */
+int process_batch(
+    struct IntervalMap *almanac,
+    struct RangeArray *batch,
+    struct RangeArray *out,
+    long *min_location
+)
+{
+    batch->length = Range_sort_merge(batch->ranges, batch->length);
+    out->length = 0;
+    if (!IntervalMap_apply(almanac, batch->ranges, batch->length, out))
+        return 0;
+    out->length = Range_sort_merge(out->ranges, out->length);
+    if (out->length && out->ranges[0].min < *min_location)
+        *min_location = out->ranges[0].min;
+    batch->length = 0;
+    return 1;
+}
+
+/* Single seeds are ranges of one so they share the range engine */
+int read_seed(FILE *seeds, struct Range *range)
+{
+    if (!read_number(seeds, &(range->min))) return 0;
+    range->max = range->min;
+    return 1;
+}
+
+/* Copies the rest of the seeds line to a temporary file, so that input
+ * which cannot seek can still be replayed in batches
+ */
+FILE *copy_seeds(void)
+{
+    FILE *seeds;
+    int c;
+    seeds = tmpfile();
+    if (!seeds) {
+        perror("tmpfile");
+        puts("Failed to create a file for the seeds");
+        return NULL;
+    }
+    while ((c = getchar()) != EOF && c != '\n') {
+        if (putc(c, seeds) == EOF) {
+            perror("putc");
+            puts("Failed to copy the seeds");
+            fclose(seeds);
+            return NULL;
+        }
+    }
+    return seeds;
+}
+
 int main(void)
 {
-    char buf[MAX_SIZE];
-    char *file_pointer;
-    size_t i;
+    struct RangeArray *batch, *out;
+    struct IntervalMap *almanac, *stage, *composed;
+    struct Range range;
+    size_t num_stages, num_seeds, num_batches;
+    long seeds_offset, min_location;
+    FILE *seeds;
+    int ret;
+
+    ret = 1;
+    almanac = NULL;
+    out = NULL;
+    seeds = NULL;
+    batch = RangeArray_create(BATCH_SIZE);
+    if (!batch) return 1;
+    if (!skip_past(stdin, ':')) {
+        puts("ERROR: Reached EOF while parsing");
+        goto cleanup;
+    }
+    /* The seeds come before the maps, so remember where they are and
+     * stream them once the almanac is built
+     * If stdin cannot seek they are replayed from a copy instead
+     */
+    seeds_offset = ftell(stdin);
+    if (seeds_offset >= 0) {
+        seeds = stdin;
+        skip_past(stdin, '\n');
+    } else {
+        seeds = copy_seeds();
+        if (!seeds) goto cleanup;
+        seeds_offset = 0;
+    }
 
-    long numbers[NUM_SEEDS], min_location;
-    
-    if (!load_file(buf, MAX_SIZE)) return 1;
-    file_pointer = buf;
-    load_seeds(&file_pointer, numbers, NUM_SEEDS);
-    while (seek_next_colon(&file_pointer)) {
-        puts("converted!");
-        if (!*(++file_pointer)) return 1;
-        convert_numbers(&file_pointer, numbers, NUM_SEEDS);
-    }
-    for (i = 0; i < NUM_SEEDS; ++i)
-        printf("%ld ", numbers[i]);
-    putchar('\n');
-    min_location = numbers[0];
-    for (i = 1; i < NUM_SEEDS; ++i)
-        if (numbers[i] < min_location)
-            min_location = numbers[i];
+    almanac = IntervalMap_identity();
+    if (!almanac) goto cleanup;
+    /* Fold every stage into a single seed to location map */
+    for (num_stages = 0; skip_past(stdin, ':'); ++num_stages) {
+        stage = IntervalMap_load();
+        if (!stage) goto cleanup;
+        composed = IntervalMap_compose(almanac, stage);
+        IntervalMap_free(stage);
+        if (!composed) goto cleanup;
+        IntervalMap_free(almanac);
+        almanac = composed;
+    }
+    printf(
+        "Composed %zu stages into %zu pieces\n", num_stages, almanac->length
+    );
+
+    out = RangeArray_create(BATCH_SIZE);
+    if (!out) goto cleanup;
+    min_location = LONG_MAX;
+    num_seeds = 0;
+    num_batches = 0;
+    if (fseek(seeds, seeds_offset, SEEK_SET)) {
+        perror("fseek");
+        puts("Failed to seek back to the seeds");
+        goto cleanup;
+    }
+    while (read_seed(seeds, &range)) {
+        ++num_seeds;
+        if (!RangeArray_push(batch, range)) goto cleanup;
+        if (batch->length < BATCH_SIZE) continue;
+        if (!process_batch(almanac, batch, out, &min_location))
+            goto cleanup;
+        ++num_batches;
+    }
+    if (batch->length) {
+        if (!process_batch(almanac, batch, out, &min_location))
+            goto cleanup;
+        ++num_batches;
+    }
+    printf(
+        "Processed %zu seeds in %zu batches\n\n",
+        num_seeds,
+        num_batches
+    );
     printf("Minimum location: %ld\n", min_location);
-    return 0;
+    ret = 0;
+cleanup:
+    if (seeds && seeds != stdin) fclose(seeds);
+    IntervalMap_free(almanac);
+    RangeArray_free(out);
+    RangeArray_free(batch);
+    return ret;
 }
@@ -1,9 +1,10 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <limits.h>
 
-#define MAX_SIZE 65536
-#define MAX_MAPS 50
-#define NUM_SEED_RANGES 10
+#define BATCH_SIZE 4096 * 16
+#define MIN_RANGEARRAY 16
+#define MIN_INTERVALMAP 16
 
 struct Range {
     long min;
@@ -15,6 +16,21 @@ struct Map {
     struct Range destination;
 };
 
+struct RangeArray {
+    struct Range *ranges;
+    size_t length;
+    size_t capacity;
+};
+
+/* Piecewise linear map sorted by source, once normalized the sources
+ * cover 0..LONG_MAX without gaps or overlaps
+ */
+struct IntervalMap {
+    struct Map *maps;
+    size_t length;
+    size_t capacity;
+};
+
 long min(long number, long other)
 {
     if (number <= other)
@@ -29,754 +45,498 @@ long max(long number, long other)
     return other;
 }
 
-int Range_is_overlapping(struct Range range, struct Range other)
+int is_digit(char c)
 {
-    return (
-        (range.min <= other.max && range.max >= other.min)
-        || (other.min <= range.max && other.max >= range.min)
-    );
+    return c >= '0' && c <= '9';
 }
 
-void Range_bubble_sort(struct Range ranges[], size_t ranges_count)
+/* Skips past the next target character, returns 0 at EOF */
+int skip_past(FILE *file, int target)
 {
-    size_t swaps, i;
-    struct Range temp;
-
-    do {
-        swaps = 0;
-        for (i = 0; i < ranges_count - 1; ++i) {
-            if (ranges[i].min > ranges[i + 1].min) {
-                temp = ranges[i + 1];
-                ranges[i + 1] = ranges[i];
-                ranges[i] = temp;
-                ++swaps;
-            }
-        }
-    } while (swaps);
+    int c;
+    while ((c = getc(file)) != EOF)
+        if (c == target)
+            return 1;
+    return 0;
 }
 
-void Map_bubble_sort(struct Map maps[], size_t maps_count)
+/* Reads the next number on the current line
+ * Returns 0 without consuming anything if the line has no more numbers
+ */
+int read_number(FILE *file, long *number)
 {
-    size_t swaps, i;
-    struct Map temp;
-
-    do {
-        swaps = 0;
-        for (i = 0; i < maps_count - 1; ++i) {
-            if (maps[i].destination.min > maps[i + 1].destination.min) {
-                temp = maps[i + 1];
-                maps[i + 1] = maps[i];
-                maps[i] = temp;
-                ++swaps;
-            }
-        }
-    } while (swaps);
+    int c;
+    while ((c = getc(file)) == ' ');
+    if (!is_digit(c)) {
+        if (c != EOF) ungetc(c, file);
+        return 0;
+    }
+    for (*number = 0; is_digit(c); c = getc(file))
+        *number = *number * 10 + (c - '0');
+    if (c != EOF) ungetc(c, file);
+    return 1;
 }
 
-int is_digit(char c)
+struct RangeArray *RangeArray_create(size_t start_capacity)
 {
-    return c >= '0' && c <= '9';
+    struct RangeArray *ra;
+    if (start_capacity < MIN_RANGEARRAY)
+        start_capacity = MIN_RANGEARRAY;
+    ra = malloc(sizeof(*ra));
+    if (!ra) {
+        perror("malloc");
+        puts("Failed to allocate RangeArray");
+        return NULL;
+    }
+    ra->ranges = malloc(start_capacity * sizeof(*(ra->ranges)));
+    if (!ra->ranges) {
+        perror("malloc");
+        puts("Failed to allocate RangeArray->ranges");
+        free(ra);
+        return NULL;
+    }
+    ra->length = 0;
+    ra->capacity = start_capacity;
+    return ra;
 }
 
-int load_file(char buf[], size_t max_size)
+void RangeArray_free(struct RangeArray *ra)
 {
-    size_t i;
-    int c;
-    for (i = 0; (c = getchar()) != EOF && i < max_size - 1; ++i)
-        buf[i] = c;
-    buf[i] = '\0';
-    if (c != EOF) {
-        puts("Could not load entire file into memory!");
-        return 0;
+    if (!ra) return;
+    free(ra->ranges);
+    ra->ranges = NULL;
+    free(ra);
+}
+
+int RangeArray_push(struct RangeArray *ra, struct Range range)
+{
+    struct Range *temp;
+    if (ra->length >= ra->capacity) {
+        temp = realloc(ra->ranges, 2 * ra->capacity * sizeof(*temp));
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow RangeArray");
+            return 0;
+        }
+        ra->ranges = temp;
+        ra->capacity *= 2;
     }
+    ra->ranges[(ra->length)++] = range;
     return 1;
 }
 
-int seek_next_colon(char **p_file)
+struct IntervalMap *IntervalMap_create(size_t start_capacity)
+{
+    struct IntervalMap *im;
+    if (start_capacity < MIN_INTERVALMAP)
+        start_capacity = MIN_INTERVALMAP;
+    im = malloc(sizeof(*im));
+    if (!im) {
+        perror("malloc");
+        puts("Failed to allocate IntervalMap");
+        return NULL;
+    }
+    im->maps = malloc(start_capacity * sizeof(*(im->maps)));
+    if (!im->maps) {
+        perror("malloc");
+        puts("Failed to allocate IntervalMap->maps");
+        free(im);
+        return NULL;
+    }
+    im->length = 0;
+    im->capacity = start_capacity;
+    return im;
+}
+
+void IntervalMap_free(struct IntervalMap *im)
+{
+    if (!im) return;
+    free(im->maps);
+    im->maps = NULL;
+    free(im);
+}
+
+int IntervalMap_push(struct IntervalMap *im, long min, long max, long offset)
 {
-    while (**p_file && **p_file != ':')
-        ++(*p_file);
-    return **p_file != '\0';
+    struct Map *temp, *last;
+    /* Merge with the previous piece if it continues it exactly */
+    if (im->length) {
+        last = im->maps + im->length - 1;
+        if (
+            last->source.max + 1 == min
+            && last->destination.min - last->source.min == offset
+        ) {
+            last->source.max = max;
+            last->destination.max = max + offset;
+            return 1;
+        }
+    }
+    if (im->length >= im->capacity) {
+        temp = realloc(im->maps, 2 * im->capacity * sizeof(*temp));
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow IntervalMap");
+            return 0;
+        }
+        im->maps = temp;
+        im->capacity *= 2;
+    }
+    im->maps[(im->length)++] = (struct Map) {
+        .source = (struct Range) { .min = min, .max = max },
+        .destination = (struct Range) { .min = min + offset, .max = max + offset }
+    };
+    return 1;
 }
 
-long get_number(char **p_file)
+struct IntervalMap *IntervalMap_identity(void)
 {
-    long number, multiplier;
-    char *start, *end;
-
-    start = *p_file;
-    while (**p_file && is_digit(**p_file))
-        ++(*p_file);
-
-    end = *p_file;
-    if (!is_digit(**p_file))
-        --(*p_file);
-
-    number = 0;
-    multiplier = 1;
-    while (*p_file != start) {
-        number = number + multiplier * (long)(**p_file - '0');
-        multiplier = multiplier * 10;
-        --(*p_file);
+    struct IntervalMap *im;
+    im = IntervalMap_create(0);
+    if (!im) return NULL;
+    if (!IntervalMap_push(im, 0, LONG_MAX, 0)) {
+        IntervalMap_free(im);
+        return NULL;
     }
-    number = number + multiplier * (long)(**p_file - '0');
+    return im;
+}
 
-    *p_file = end;
-    return number;
+int Map_compare_source(const void *map, const void *other)
+{
+    const struct Map *a = map, *b = other;
+    if (a->source.min < b->source.min) return -1;
+    return a->source.min > b->source.min;
 }
 
-int load_seed_ranges(
-    char **p_file, struct Range seed_ranges[], size_t num_ranges
-)
+/* Sorts the lines of a map and fills the gaps with identity pieces
+ * Overlapping lines are clipped to start after the previous one
+ */
+struct IntervalMap *IntervalMap_normalize(struct IntervalMap *raw)
 {
+    struct IntervalMap *im;
+    struct Map *map;
+    long next, offset;
     size_t i;
-    long min, max;
-    seek_next_colon(p_file);
-    if (!*(++(*p_file))) {
-        puts("ERROR: Reached EOF while parsing");
-        return 1;
+
+    qsort(raw->maps, raw->length, sizeof(*(raw->maps)), Map_compare_source);
+    im = IntervalMap_create(2 * raw->length + 1);
+    if (!im) return NULL;
+    next = 0;
+    for (i = 0; i < raw->length; ++i) {
+        map = raw->maps + i;
+        if (map->source.max < next) continue;
+        offset = map->destination.min - map->source.min;
+        if (
+            (map->source.min > next
+            && !IntervalMap_push(im, next, map->source.min - 1, 0))
+            || !IntervalMap_push(
+                im, max(map->source.min, next), map->source.max, offset
+            )
+        ) {
+            IntervalMap_free(im);
+            return NULL;
+        }
+        if (map->source.max == LONG_MAX) return im;
+        next = map->source.max + 1;
     }
-    
-    i = 0;
-    while (is_digit(*(++(*p_file))) && i < num_ranges) {
-        min = get_number(p_file);
-        if (!**p_file || !*(++(*p_file))) return 0;
-        max = min + get_number(p_file) - 1;
-        seed_ranges[i] = (struct Range){.min = min, .max = max};
-        ++i;
+    if (!IntervalMap_push(im, next, LONG_MAX, 0)) {
+        IntervalMap_free(im);
+        return NULL;
     }
-    return !is_digit(**p_file);
+    return im;
 }
 
-size_t load_next_map(char **p_file, struct Map map[], size_t max_size)
+/* Loads the lines following a map header */
+struct IntervalMap *IntervalMap_load(void)
 {
-    long min, max, destination;
-    size_t i;
-
-    seek_next_colon(p_file);
-    if (!*(++(*p_file))) {
-        puts("ERROR: Reached EOF while parsing");
-        return 0;
+    struct IntervalMap *raw, *im;
+    long min, length, destination;
+
+    raw = IntervalMap_create(0);
+    if (!raw) return NULL;
+    skip_past(stdin, '\n');
+    while (read_number(stdin, &destination)) {
+        if (!read_number(stdin, &min) || !read_number(stdin, &length)) {
+            puts("ERROR: Malformed map line");
+            IntervalMap_free(raw);
+            return NULL;
+        }
+        if (
+            length > 0
+            && !IntervalMap_push(raw, min, min + length - 1, destination - min)
+        ) {
+            IntervalMap_free(raw);
+            return NULL;
+        }
+        if (!skip_past(stdin, '\n')) break;
     }
+    im = IntervalMap_normalize(raw);
+    IntervalMap_free(raw);
+    return im;
+}
 
-    i = 0;
-    while (*(++(*p_file)) && is_digit(**p_file) && i < max_size) {
-        destination = get_number(p_file);
-        if (!**p_file || !*(++(*p_file))) return 0;
-        min = get_number(p_file);
-        if (!**p_file || !*(++(*p_file))) return 0;
-        max = min + get_number(p_file) - 1;
-        map[i] = (struct Map){
-            .source = (struct Range) {
-                .min = min,
-                .max = max,
-            },
-            .destination = (struct Range) {
-                .min = destination,
-                .max = destination + max - min
-            }
-        };
-        ++i;
+/* Index of the piece whose source contains value */
+size_t IntervalMap_find(struct IntervalMap *im, long value)
+{
+    size_t low, high, mid;
+    low = 0;
+    high = im->length - 1;
+    while (low < high) {
+        mid = low + (high - low + 1) / 2;
+        if (im->maps[mid].source.min <= value) low = mid;
+        else high = mid - 1;
     }
-    return i;
+    return low;
 }
 
-size_t patch_map_holes(struct Map maps[], size_t maps_count)
+/* Builds the map equivalent to applying first then second */
+struct IntervalMap *IntervalMap_compose(
+    struct IntervalMap *first, struct IntervalMap *second
+)
 {
-    struct Map temp;
+    struct IntervalMap *im;
+    struct Map *map, *next;
+    long start, end, offset;
     size_t i, j;
 
-    if (maps_count && maps[0].destination.min != 0) {
-        temp = (struct Map) {
-            .source = (struct Range) {
-                .min = 0,
-                .max = maps[0].destination.min - 1
-            },
-            .destination = (struct Range) {
-                .min = 0,
-                .max = maps[0].destination.min - 1
+    im = IntervalMap_create(first->length + second->length);
+    if (!im) return NULL;
+    for (i = 0; i < first->length; ++i) {
+        map = first->maps + i;
+        offset = map->destination.min - map->source.min;
+        start = map->source.min;
+        j = IntervalMap_find(second, map->destination.min);
+        for (; j < second->length; ++j) {
+            next = second->maps + j;
+            if (next->source.min > map->destination.max) break;
+            end = start + (
+                min(next->source.max, map->destination.max)
+                - max(next->source.min, map->destination.min)
+            );
+            if (
+                !IntervalMap_push(
+                    im,
+                    start,
+                    end,
+                    offset + next->destination.min - next->source.min
+                )
+            ) {
+                IntervalMap_free(im);
+                return NULL;
             }
-        };
-        for (j = maps_count - 1; j > 0; --j)
-            maps[j + 1] = maps[j];
-        maps[1] = maps[0];
-        maps[0] = temp;
-        ++maps_count;
+            if (end == map->source.max) break;
+            start = end + 1;
+        }
     }
+    return im;
+}
 
-    for (i = 0; i < maps_count - 1; ++i) {
-        if (maps[i].destination.max != maps[i + 1].destination.min - 1) {
-            temp = (struct Map) {
-                .source = (struct Range) {
-                    .min = maps[i].destination.max + 1,
-                    .max = maps[i + 1].destination.min - 1
-                },
-                .destination = (struct Range) {
-                    .min = maps[i].destination.max + 1,
-                    .max = maps[i + 1].destination.min - 1
-                }
-            };
-            for (j = maps_count - 1; j > i; --j) {
-                maps[j + 1] = maps[j];
-            }
-            maps[i + 1] = temp;
-            ++maps_count;
+int Range_compare(const void *range, const void *other)
+{
+    const struct Range *a = range, *b = other;
+    if (a->min < b->min) return -1;
+    return a->min > b->min;
+}
+
+/* Sorts ranges and merges the overlapping or adjacent ones in place
+ * Returns the new number of ranges
+ */
+size_t Range_sort_merge(struct Range ranges[], size_t length)
+{
+    size_t i, merged;
+    if (!length) return 0;
+    qsort(ranges, length, sizeof(*ranges), Range_compare);
+    for (i = 1, merged = 0; i < length; ++i) {
+        if (ranges[i].min <= ranges[merged].max + 1) {
+            ranges[merged].max = max(ranges[merged].max, ranges[i].max);
+        } else {
+            ranges[++merged] = ranges[i];
         }
     }
-    return maps_count;
+    return merged + 1;
 }
 
-int convert_number(char **p_file, long *number)
+/* Splits sorted, disjoint ranges across the pieces of the map and
+ * appends their images to out
+ */
+int IntervalMap_apply(
+    struct IntervalMap *im,
+    struct Range ranges[],
+    size_t length,
+    struct RangeArray *out
+)
 {
-    long destination, source, range;
-    int converted;
-
-    converted = 0;
-
-    while (*(++(*p_file)) && is_digit(**p_file) && !converted) {
-        destination = get_number(p_file);
-        if (!**p_file || !*(++(*p_file))) return 0;
-        source = get_number(p_file);
-        if (!**p_file || !*(++(*p_file))) return 0;
-        range = get_number(p_file);
-        if (*number - source < range && *number - source >= 0) {
-            *number = destination + *number - source;
-            converted = 1;
+    size_t i, j;
+    long start, end, offset;
+
+    j = 0;
+    for (i = 0; i < length; ++i) {
+        /* Inputs are sorted so the search only moves forward */
+        if (im->maps[j].source.max < ranges[i].min)
+            j = IntervalMap_find(im, ranges[i].min);
+        for (
+            start = ranges[i].min;
+            j < im->length && im->maps[j].source.min <= ranges[i].max;
+            ++j
+        ) {
+            end = min(im->maps[j].source.max, ranges[i].max);
+            offset = im->maps[j].destination.min - im->maps[j].source.min;
+            if (
+                !RangeArray_push(
+                    out,
+                    (struct Range) {
+                        .min = start + offset, .max = end + offset
+                    }
+                )
+            ) return 0;
+            if (end == ranges[i].max) break;
+            start = end + 1;
         }
     }
     return 1;
 }
 
-size_t check_upstream_map(
-    struct Range range,
-    struct Map upstream[],
-    size_t upstream_count,
-    struct Range ranges[]
-) {
-    size_t i, ranges_len;
+/* Pushes one batch of seed ranges through the almanac and folds the
+ * lowest location into min_location
+ */
+int process_batch(
+    struct IntervalMap *almanac,
+    struct RangeArray *batch,
+    struct RangeArray *out,
+    long *min_location
+)
+{
+    batch->length = Range_sort_merge(batch->ranges, batch->length);
+    out->length = 0;
+    if (!IntervalMap_apply(almanac, batch->ranges, batch->length, out))
+        return 0;
+    out->length = Range_sort_merge(out->ranges, out->length);
+    if (out->length && out->ranges[0].min < *min_location)
+        *min_location = out->ranges[0].min;
+    batch->length = 0;
+    return 1;
+}
 
-    for (i = ranges_len = 0; i < upstream_count; ++i) {
-        if (
-            Range_is_overlapping(
-                range,
-                upstream[i].destination
-            )
-        ) {
-            ranges[ranges_len] = (struct Range) {
-                .min = max(
-                    upstream[i].source.min,
-                    upstream[i].source.min + range.min - upstream[i].destination.min
-                ),
-                .max = min(
-                    upstream[i].source.max,
-                    upstream[i].source.min + range.max - upstream[i].destination.min
-                )
-            };
-            ++ranges_len;
-        }
+int read_seed_range(FILE *seeds, struct Range *range)
+{
+    long length;
+    if (!read_number(seeds, &(range->min))) return 0;
+    if (!read_number(seeds, &length)) {
+        puts("ERROR: Seed range without a length");
+        return 0;
     }
+    range->max = range->min + length - 1;
+    return 1;
+}
 
-    if (
-        Range_is_overlapping(
-            range, upstream[upstream_count - 1].destination
-        )
-        && upstream[upstream_count - 1].destination.max < range.max
-    ) {
-        ranges[ranges_len] = (struct Range) {
-            .min = max(
-                upstream[upstream_count - 1].destination.max + 1,
-                range.min
-            ),
-            .max = range.max,
-        };
-        ++ranges_len;
+/* Copies the rest of the seeds line to a temporary file, so that input
+ * which cannot seek can still be replayed in batches
+ */
+FILE *copy_seeds(void)
+{
+    FILE *seeds;
+    int c;
+    seeds = tmpfile();
+    if (!seeds) {
+        perror("tmpfile");
+        puts("Failed to create a file for the seeds");
+        return NULL;
+    }
+    while ((c = getchar()) != EOF && c != '\n') {
+        if (putc(c, seeds) == EOF) {
+            perror("putc");
+            puts("Failed to copy the seeds");
+            fclose(seeds);
+            return NULL;
+        }
     }
-    return ranges_len;
+    return seeds;
 }
 
 int main(void)
 {
-    char buf[MAX_SIZE];
-    char *file_pointer;
-    size_t i1, i2, i3, i4, i5, i6, i7, i8;
-    size_t j;
-    int converted[2] = {0, 0};
-
-    long min_location, location_min_seed, location_max_seed, min_seed, max_seed;
-    
-    struct Range ranges[MAX_MAPS];
-    size_t ranges_len;
-    struct Range ranges1[MAX_MAPS];
-    size_t ranges1_len;
-    struct Range ranges2[MAX_MAPS];
-    size_t ranges2_len;
-    struct Range ranges3[MAX_MAPS];
-    size_t ranges3_len;
-    struct Range ranges4[MAX_MAPS];
-    size_t ranges4_len;
-    struct Range ranges5[MAX_MAPS];
-    size_t ranges5_len;
-    struct Range ranges6[MAX_MAPS];
-    size_t ranges6_len;
-
-    struct Range seed_ranges[NUM_SEED_RANGES];
-
-    struct Map seed_to_soil[MAX_MAPS];
-    size_t seed_to_soil_len;
-
-    struct Map soil_to_fertilizer[MAX_MAPS];
-    size_t soil_to_fertilizer_len;
-
-    struct Map fertilizer_to_water[MAX_MAPS];
-    size_t fertilizer_to_water_len;
-
-    struct Map water_to_light[MAX_MAPS];
-    size_t water_to_light_len;
-
-    struct Map light_to_temperature[MAX_MAPS];
-    size_t light_to_temperature_len;
-
-    struct Map temperature_to_humidity[MAX_MAPS];
-    size_t temperature_to_humidity_len;
-
-    struct Map humidity_to_location[MAX_MAPS];
-    size_t humidity_to_location_len;
-    
-    if (!load_file(buf, MAX_SIZE)) return 1;
-    file_pointer = buf;
-
-    if (!load_seed_ranges(&file_pointer, seed_ranges, NUM_SEED_RANGES))
-        return 1;
-    if (
-        !(
-            seed_to_soil_len = load_next_map(
-                &file_pointer, seed_to_soil, MAX_MAPS
-            )
-        )
-    ) return 1;
-    if (
-        !(
-            soil_to_fertilizer_len = load_next_map(
-                &file_pointer, soil_to_fertilizer, MAX_MAPS
-            )
-        )
-    ) return 1;
-    if (
-        !(
-            fertilizer_to_water_len = load_next_map(
-                &file_pointer, fertilizer_to_water, MAX_MAPS
-            )
-        )
-    ) return 1;
-    if (
-        !(
-            water_to_light_len = load_next_map(
-                &file_pointer, water_to_light, MAX_MAPS
-            )
-        )
-    ) return 1;
-    if (
-        !(
-            light_to_temperature_len = load_next_map(
-                &file_pointer, light_to_temperature, MAX_MAPS
-            )
-        )
-    ) return 1;
-    if (
-        !(
-            temperature_to_humidity_len = load_next_map(
-                &file_pointer, temperature_to_humidity, MAX_MAPS
-            )
-        )
-    ) return 1;
-    if (
-        !(
-            humidity_to_location_len = load_next_map(
-                &file_pointer, humidity_to_location, MAX_MAPS
-            )
-        )
-    ) return 1;
-
-    Range_bubble_sort(seed_ranges, NUM_SEED_RANGES);
-    Map_bubble_sort(seed_to_soil, seed_to_soil_len);
-    Map_bubble_sort(soil_to_fertilizer, soil_to_fertilizer_len);
-    Map_bubble_sort(fertilizer_to_water, fertilizer_to_water_len);
-    Map_bubble_sort(water_to_light, water_to_light_len);
-    Map_bubble_sort(light_to_temperature, light_to_temperature_len);
-    Map_bubble_sort(temperature_to_humidity, temperature_to_humidity_len);
-    Map_bubble_sort(humidity_to_location, humidity_to_location_len);
-    seed_to_soil_len = patch_map_holes(
-        seed_to_soil, seed_to_soil_len
-    );
-    soil_to_fertilizer_len = patch_map_holes(
-        soil_to_fertilizer, soil_to_fertilizer_len
-    );
-    fertilizer_to_water_len = patch_map_holes(
-        fertilizer_to_water, fertilizer_to_water_len
-    );
-    water_to_light_len = patch_map_holes(
-        water_to_light, water_to_light_len
-    );
-    light_to_temperature_len = patch_map_holes(
-        light_to_temperature, light_to_temperature_len
-    );
-    temperature_to_humidity_len = patch_map_holes(
-        temperature_to_humidity, temperature_to_humidity_len
-    );
-    humidity_to_location_len = patch_map_holes(
-        humidity_to_location, humidity_to_location_len
+    struct RangeArray *batch, *out;
+    struct IntervalMap *almanac, *stage, *composed;
+    struct Range range;
+    size_t num_stages, num_seed_ranges, num_batches;
+    long seeds_offset, min_location;
+    FILE *seeds;
+    int ret;
+
+    ret = 1;
+    almanac = NULL;
+    out = NULL;
+    seeds = NULL;
+    batch = RangeArray_create(BATCH_SIZE);
+    if (!batch) return 1;
+    if (!skip_past(stdin, ':')) {
+        puts("ERROR: Reached EOF while parsing");
+        goto cleanup;
+    }
+    /* The seeds come before the maps, so remember where they are and
+     * stream them once the almanac is built
+     * If stdin cannot seek they are replayed from a copy instead
+     */
+    seeds_offset = ftell(stdin);
+    if (seeds_offset >= 0) {
+        seeds = stdin;
+        skip_past(stdin, '\n');
+    } else {
+        seeds = copy_seeds();
+        if (!seeds) goto cleanup;
+        seeds_offset = 0;
+    }
+
+    almanac = IntervalMap_identity();
+    if (!almanac) goto cleanup;
+    /* Fold every stage into a single seed to location map */
+    for (num_stages = 0; skip_past(stdin, ':'); ++num_stages) {
+        stage = IntervalMap_load();
+        if (!stage) goto cleanup;
+        composed = IntervalMap_compose(almanac, stage);
+        IntervalMap_free(stage);
+        if (!composed) goto cleanup;
+        IntervalMap_free(almanac);
+        almanac = composed;
+    }
+    printf(
+        "Composed %zu stages into %zu pieces\n", num_stages, almanac->length
     );
-    for (i1 = 0; i1 < NUM_SEED_RANGES; ++i1)
-        printf(
-            "Seed Range %2zu: min: %10ld, max: %10ld\n",
-            i1 + 1,
-            seed_ranges[i1].min,
-            seed_ranges[i1].max
-        );
-    putchar('\n');
-    for (i1 = 0; i1 < seed_to_soil_len; ++i1)
-        printf(
-            "Seed To Soil Map %2zu: source min: %10ld, source max: %10ld, destination min: %10ld, destination max: %10ld\n",
-            i1 + 1,
-            seed_to_soil[i1].source.min,
-            seed_to_soil[i1].source.max,
-            seed_to_soil[i1].destination.min,
-            seed_to_soil[i1].destination.max
-        );
-    putchar('\n');
-    for (i1 = 0; i1 < soil_to_fertilizer_len; ++i1)
-        printf(
-            "Soil To Fertilizer Map %2zu: source min: %10ld, source max: %10ld, destination min: %10ld, destination max: %10ld\n",
-            i1 + 1,
-            soil_to_fertilizer[i1].source.min,
-            soil_to_fertilizer[i1].source.max,
-            soil_to_fertilizer[i1].destination.min,
-            soil_to_fertilizer[i1].destination.max
-        );
-    putchar('\n');
-    for (i1 = 0; i1 < fertilizer_to_water_len; ++i1)
-        printf(
-            "Fertilizer To Water Map %2zu: source min: %10ld, source max: %10ld, destination min: %10ld, destination max: %10ld\n",
-            i1 + 1,
-            fertilizer_to_water[i1].source.min,
-            fertilizer_to_water[i1].source.max,
-            fertilizer_to_water[i1].destination.min,
-            fertilizer_to_water[i1].destination.max
-        );
-    putchar('\n');
-    for (i1 = 0; i1 < water_to_light_len; ++i1)
-        printf(
-            "Water To Light Map %2zu: source min: %10ld, source max: %10ld, destination min: %10ld, destination max: %10ld\n",
-            i1 + 1,
-            water_to_light[i1].source.min,
-            water_to_light[i1].source.max,
-            water_to_light[i1].destination.min,
-            water_to_light[i1].destination.max
-        );
-    putchar('\n');
-    for (i1 = 0; i1 < light_to_temperature_len; ++i1)
-        printf(
-            "Light To Temperature Map %2zu: source min: %10ld, source max: %10ld, destination min: %10ld, destination max: %10ld\n",
-            i1 + 1,
-            light_to_temperature[i1].source.min,
-            light_to_temperature[i1].source.max,
-            light_to_temperature[i1].destination.min,
-            light_to_temperature[i1].destination.max
-        );
-    putchar('\n');
-    for (i1 = 0; i1 < temperature_to_humidity_len; ++i1)
-        printf(
-            "Temperature To Humidity Map %2zu: source min: %10ld, source max: %10ld, destination min: %10ld, destination max: %10ld\n",
-            i1 + 1,
-            temperature_to_humidity[i1].source.min,
-            temperature_to_humidity[i1].source.max,
-            temperature_to_humidity[i1].destination.min,
-            temperature_to_humidity[i1].destination.max
-        );
-    putchar('\n');
-    for (i1 = 0; i1 < humidity_to_location_len; ++i1)
-        printf(
-            "Humidity To Location Map %2zu: source min: %10ld, source max: %10ld, destination min: %10ld, destination max: %10ld\n",
-            i1 + 1,
-            humidity_to_location[i1].source.min,
-            humidity_to_location[i1].source.max,
-            humidity_to_location[i1].destination.min,
-            humidity_to_location[i1].destination.max
-        );
-    putchar('\n');
-    min_location = 0;
-    
-    for (i1 = 0; i1 < humidity_to_location_len; ++i1)
-        ranges[i1] = humidity_to_location[i1].source;
-    ranges_len = humidity_to_location_len;
-
-    for (i1 = 0; i1 < ranges_len; i1++) {
-        ranges1_len = check_upstream_map(
-            ranges[i1],
-            temperature_to_humidity,
-            temperature_to_humidity_len,
-            ranges1
-        );
-        for (i2 = 0; i2 < ranges1_len; i2++) {
-            ranges2_len = check_upstream_map(
-                ranges1[i2],
-                light_to_temperature,
-                light_to_temperature_len,
-                ranges2
-            );
-            for (i3 = 0; i3 < ranges2_len; i3++) {
-                ranges3_len = check_upstream_map(
-                    ranges2[i3],
-                    water_to_light,
-                    water_to_light_len,
-                    ranges3
-                );
-                for (i4 = 0; i4 < ranges3_len; i4++) {
-                    ranges4_len = check_upstream_map(
-                        ranges3[i4],
-                        fertilizer_to_water,
-                        fertilizer_to_water_len,
-                        ranges4
-                    );
-                    for (i5 = 0; i5 < ranges4_len; i5++) {
-                        ranges5_len = check_upstream_map(
-                            ranges4[i5],
-                            soil_to_fertilizer,
-                            soil_to_fertilizer_len,
-                            ranges5
-                        );
-                        for (i6 = 0; i6 < ranges5_len; i6++) {
-                            ranges6_len = check_upstream_map(
-                                ranges5[i6],
-                                seed_to_soil,
-                                seed_to_soil_len,
-                                ranges6
-                            );
-                            for (i7 = 0; i7 < ranges6_len; ++i7) {
-                                for (i8 = 0; i8 < NUM_SEED_RANGES; ++i8) {
-                                    if (Range_is_overlapping(ranges6[i7], seed_ranges[i8])) {
-                                        min_seed = max(ranges6[i7].min, seed_ranges[i8].min);
-                                        max_seed = min(ranges6[i7].max, seed_ranges[i8].max);
-                                        location_min_seed = min_seed;
-                                        location_max_seed = max_seed;
-                                        for (j = 0; j < seed_to_soil_len; ++j) {
-                                            converted[0] = converted[1] = 0;
-                                            if (
-                                                !converted[0]
-                                                && location_min_seed >= seed_to_soil[j].source.min
-                                                && location_min_seed <= seed_to_soil[j].source.max
-                                            ) {
-                                                location_min_seed = (
-                                                    seed_to_soil[j].destination.min
-                                                    + location_min_seed
-                                                    - seed_to_soil[j].source.min
-                                                );
-                                                converted[0] = 1;
-                                            }
-                                            if (
-                                                !converted[1]
-                                                && location_max_seed >= seed_to_soil[j].source.min
-                                                && location_max_seed <= seed_to_soil[j].source.max
-                                            ) {
-                                                location_max_seed = (
-                                                    seed_to_soil[j].destination.min
-                                                    + location_max_seed
-                                                    - seed_to_soil[j].source.min
-                                                );
-                                                converted[1] = 1;
-                                            }
-                                            if (converted[0] && converted[1])
-                                                break;
-                                        }
-                                        for (j = 0; j < soil_to_fertilizer_len; ++j) {
-                                            converted[0] = converted[1] = 0;
-                                            if (
-                                                !converted[0]
-                                                && location_min_seed >= soil_to_fertilizer[j].source.min
-                                                && location_min_seed <= soil_to_fertilizer[j].source.max
-                                            ) {
-                                                location_min_seed = (
-                                                    soil_to_fertilizer[j].destination.min
-                                                    + location_min_seed
-                                                    - soil_to_fertilizer[j].source.min
-                                                );
-                                                converted[0] = 1;
-                                            }
-                                            if (
-                                                !converted[1]
-                                                && location_max_seed >= soil_to_fertilizer[j].source.min
-                                                && location_max_seed <= soil_to_fertilizer[j].source.max
-                                            ) {
-                                                location_max_seed = (
-                                                    soil_to_fertilizer[j].destination.min
-                                                    + location_max_seed
-                                                    - soil_to_fertilizer[j].source.min
-                                                );
-                                                converted[1] = 1;
-                                            }
-                                            if (converted[0] && converted[1])
-                                                break;
-                                        }
-                                        for (j = 0; j < fertilizer_to_water_len; ++j) {
-                                            converted[0] = converted[1] = 0;
-                                            if (
-                                                !converted[0]
-                                                && location_min_seed >= fertilizer_to_water[j].source.min
-                                                && location_min_seed <= fertilizer_to_water[j].source.max
-                                            ) {
-                                                location_min_seed = (
-                                                    fertilizer_to_water[j].destination.min
-                                                    + location_min_seed
-                                                    - fertilizer_to_water[j].source.min
-                                                );
-                                                converted[0] = 1;
-                                            }
-                                            if (
-                                                !converted[1]
-                                                && location_max_seed >= fertilizer_to_water[j].source.min
-                                                && location_max_seed <= fertilizer_to_water[j].source.max
-                                            ) {
-                                                location_max_seed = (
-                                                    fertilizer_to_water[j].destination.min
-                                                    + location_max_seed
-                                                    - fertilizer_to_water[j].source.min
-                                                );
-                                                converted[1] = 1;
-                                            }
-                                            if (converted[0] && converted[1])
-                                                break;
-                                        }
-                                        for (j = 0; j < water_to_light_len; ++j) {
-                                            converted[0] = converted[1] = 0;
-                                            if (
-                                                !converted[0]
-                                                && location_min_seed >= water_to_light[j].source.min
-                                                && location_min_seed <= water_to_light[j].source.max
-                                            ) {
-                                                location_min_seed = (
-                                                    water_to_light[j].destination.min
-                                                    + location_min_seed
-                                                    - water_to_light[j].source.min
-                                                );
-                                                converted[0] = 1;
-                                            }
-                                            if (
-                                                !converted[1]
-                                                && location_max_seed >= water_to_light[j].source.min
-                                                && location_max_seed <= water_to_light[j].source.max
-                                            ) {
-                                                location_max_seed = (
-                                                    water_to_light[j].destination.min
-                                                    + location_max_seed
-                                                    - water_to_light[j].source.min
-                                                );
-                                                converted[1] = 1;
-                                            }
-                                            if (converted[0] && converted[1])
-                                                break;
-                                        }
-                                        for (j = 0; j < light_to_temperature_len; ++j) {
-                                            converted[0] = converted[1] = 0;
-                                            if (
-                                                !converted[0]
-                                                && location_min_seed >= light_to_temperature[j].source.min
-                                                && location_min_seed <= light_to_temperature[j].source.max
-                                            ) {
-                                                location_min_seed = (
-                                                    light_to_temperature[j].destination.min
-                                                    + location_min_seed
-                                                    - light_to_temperature[j].source.min
-                                                );
-                                                converted[0] = 1;
-                                            }
-                                            if (
-                                                !converted[1]
-                                                && location_max_seed >= light_to_temperature[j].source.min
-                                                && location_max_seed <= light_to_temperature[j].source.max
-                                            ) {
-                                                location_max_seed = (
-                                                    light_to_temperature[j].destination.min
-                                                    + location_max_seed
-                                                    - light_to_temperature[j].source.min
-                                                );
-                                                converted[1] = 1;
-                                            }
-                                            if (converted[0] && converted[1])
-                                                break;
-                                        }
-                                        for (j = 0; j < temperature_to_humidity_len; ++j) {
-                                            converted[0] = converted[1] = 0;
-                                            if (
-                                                !converted[0]
-                                                && location_min_seed >= temperature_to_humidity[j].source.min
-                                                && location_min_seed <= temperature_to_humidity[j].source.max
-                                            ) {
-                                                location_min_seed = (
-                                                    temperature_to_humidity[j].destination.min
-                                                    + location_min_seed
-                                                    - temperature_to_humidity[j].source.min
-                                                );
-                                                converted[0] = 1;
-                                            }
-                                            if (
-                                                !converted[1]
-                                                && location_max_seed >= temperature_to_humidity[j].source.min
-                                                && location_max_seed <= temperature_to_humidity[j].source.max
-                                            ) {
-                                                location_max_seed = (
-                                                    temperature_to_humidity[j].destination.min
-                                                    + location_max_seed
-                                                    - temperature_to_humidity[j].source.min
-                                                );
-                                                converted[1] = 1;
-                                            }
-                                            if (converted[0] && converted[1])
-                                                break;
-                                        }
-                                        for (j = 0; j < humidity_to_location_len; ++j) {
-                                            converted[0] = converted[1] = 0;
-                                            if (
-                                                !converted[0]
-                                                && location_min_seed >= humidity_to_location[j].source.min
-                                                && location_min_seed <= humidity_to_location[j].source.max
-                                            ) {
-                                                location_min_seed = (
-                                                    humidity_to_location[j].destination.min
-                                                    + location_min_seed
-                                                    - humidity_to_location[j].source.min
-                                                );
-                                                converted[0] = 1;
-                                            }
-                                            if (
-                                                !converted[1]
-                                                && location_max_seed >= humidity_to_location[j].source.min
-                                                && location_max_seed <= humidity_to_location[j].source.max
-                                            ) {
-                                                location_max_seed = (
-                                                    humidity_to_location[j].destination.min
-                                                    + location_max_seed
-                                                    - humidity_to_location[j].source.min
-                                                );
-                                                converted[1] = 1;
-                                            }
-                                            if (converted[0] && converted[1])
-                                                break;
-                                        }
-                                        if (min_location == 0) {
-                                            min_location = min(location_min_seed, location_max_seed);
-                                        } else {
-                                            if (min(location_min_seed, location_max_seed) < min_location)
-                                                min_location = min(location_min_seed, location_max_seed);
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
+
+    out = RangeArray_create(BATCH_SIZE);
+    if (!out) goto cleanup;
+    min_location = LONG_MAX;
+    num_seed_ranges = 0;
+    num_batches = 0;
+    if (fseek(seeds, seeds_offset, SEEK_SET)) {
+        perror("fseek");
+        puts("Failed to seek back to the seeds");
+        goto cleanup;
+    }
+    while (read_seed_range(seeds, &range)) {
+        if (range.max < range.min) continue;
+        ++num_seed_ranges;
+        if (!RangeArray_push(batch, range)) goto cleanup;
+        if (batch->length < BATCH_SIZE) continue;
+        if (!process_batch(almanac, batch, out, &min_location))
+            goto cleanup;
+        ++num_batches;
     }
+    if (batch->length) {
+        if (!process_batch(almanac, batch, out, &min_location))
+            goto cleanup;
+        ++num_batches;
+    }
+    printf(
+        "Processed %zu seed ranges in %zu batches\n\n",
+        num_seed_ranges,
+        num_batches
+    );
     printf("min location = %ld\n", min_location);
-    return 0;
+    ret = 0;
+cleanup:
+    if (seeds && seeds != stdin) fclose(seeds);
+    IntervalMap_free(almanac);
+    RangeArray_free(out);
+    RangeArray_free(batch);
+    return ret;
 }
@@ -1,14 +1,50 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 
-#define MAX_HANDS 1024
+#define MIN_HANDARRAY 1024
+#define RADIX_BITS 8
 #define CARDS_COUNT 5
 #define NUM_UNIQUE_CARDS 13
 #define MAX_LINE 16
+#define MAX_SQUARES CARDS_COUNT * CARDS_COUNT + 1
 #define JOKER 'J'
 
 struct Hand {
     char cards[CARDS_COUNT + 1];
     unsigned int bid;
+    uint32_t key;
+};
+
+struct HandArray {
+    struct Hand *hands;
+    size_t length;
+    size_t capacity;
+};
+
+/* The sum of the squared counts of the non joker cards identifies
+ * their count signature for a given number of jokers, and the jokers
+ * always join the largest group, so the promoted type is a lookup
+ */
+const int TYPE_BY_JOKERS_SQUARES[CARDS_COUNT + 1][MAX_SQUARES] = {
+    /* 11111: 5, 2111: 7, 221: 9, 311: 11, 32: 13, 41: 17, 5: 25 */
+    { -1, -1, -1, -1, -1, 0, -1, 1, -1, 2, -1, 3, -1, 4,
+      -1, -1, -1, 5, -1, -1, -1, -1, -1, -1, -1, 6 },
+    /* 1111: 4, 211: 6, 22: 8, 31: 10, 4: 16 */
+    { -1, -1, -1, -1, 1, -1, 3, -1, 4, -1, 5, -1, -1, -1,
+      -1, -1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    /* 111: 3, 21: 5, 3: 9 */
+    { -1, -1, -1, 3, -1, 5, -1, -1, -1, 6, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    /* 11: 2, 2: 4 */
+    { -1, -1, 5, -1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    /* 1: 1 */
+    { -1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+    /* none: 0 */
+    { 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 }
 };
 
 int is_digit(char c)
@@ -51,227 +87,135 @@ int get_card_strength(char card)
     }
 }
 
-void count_cards(char *cards, size_t counts[], size_t counts_len)
+/* One pass over the cards, no branching on the counts */
+int get_type_strength(char *cards)
 {
-    size_t i;
-    char **p_cards;
+    unsigned char counts[NUM_UNIQUE_CARDS] = { 0 };
+    unsigned int i, squares, jokers;
 
-    for (i = 0; i < counts_len; ++i)
-        counts[i] = 0;
-
-    p_cards = &cards;
-    while (**p_cards) {
-        ++(counts[get_card_strength(**p_cards)]);
-        ++(*p_cards);
-    }
+    squares = 0;
+    for (i = 0; i < CARDS_COUNT; ++i)
+        squares += 2 * counts[get_card_strength(cards[i])]++ + 1;
+    jokers = counts[get_card_strength(JOKER)];
+    return TYPE_BY_JOKERS_SQUARES[jokers][squares - jokers * jokers];
 }
 
-int is_n_of_a_kind(size_t counts[], size_t num_unique, size_t n)
+/* Type strength followed by the five card strengths in base 13
+ * so comparing keys compares hands
+ */
+int Hand_encode(struct Hand *hand, size_t num_unique)
 {
-    size_t i, num_jokers;
-    int joker_strength;
+    size_t i;
+    int type_strength, card_strength;
 
-    joker_strength = get_card_strength(JOKER);
-    num_jokers = counts[joker_strength];
-    if (!num_jokers) {
-        for (i = 0; i < num_unique; ++i) {
-            if (counts[i] == n)
-                return 1;
+    for (i = 0; i < CARDS_COUNT; ++i) {
+        if (get_card_strength(hand->cards[i]) < 0) {
+            printf("Invalid card in hand: %s\n", hand->cards);
+            return 0;
         }
-    } else {
-        if (num_jokers >= n)
-            return 1;
-        for (i = 0; i < num_unique; ++i)
-            if (i != (size_t)joker_strength && counts[i] + num_jokers >= n)
-                return 1;
     }
-    return 0;
-}
-
-int is_five_of_a_kind(size_t counts[], size_t num_unique)
-{
-    return is_n_of_a_kind(counts, num_unique, 5);
-}
-
-int is_four_of_a_kind(size_t counts[], size_t num_unique)
-{
-    return is_n_of_a_kind(counts, num_unique, 4);
-}
-
-int is_full_house(size_t counts[], size_t num_unique)
-{
-    size_t i, count_triple, count_double, num_jokers;
-    int joker_strength;
-
-    joker_strength = get_card_strength(JOKER);
-    num_jokers = counts[joker_strength];
-
-    count_double = count_triple = 0;
-    for (i = 0; i < num_unique; ++i) {
-        if (i != (size_t)joker_strength && counts[i] == 2)
-            ++count_double;
-        else if (i != (size_t)joker_strength && counts[i] == 3)
-            ++count_triple;
-    }
-
-    switch (num_jokers) {
-    case 0:
-        return count_double == 1 && count_triple == 1;
-    case 1:
-        return count_double == 2;
-    case 2:
-        return count_double == 1;
-    case 3:
-    case 4:
-    case 5:
-        return 1;
-    default:
-        return 0;
+    type_strength = get_type_strength(hand->cards);
+    if (type_strength < 0) return 0;
+    hand->key = type_strength;
+    for (i = 0; i < CARDS_COUNT; ++i) {
+        card_strength = get_card_strength(hand->cards[i]);
+        hand->key = hand->key * num_unique + card_strength;
     }
+    return 1;
 }
 
-int is_three_of_a_kind(size_t counts[], size_t num_unique)
+/* LSD radix sort on the keys, only as many passes as the keys need */
+int radix_sort_hands(struct Hand hands[], size_t num_hands)
 {
-    return is_n_of_a_kind(counts, num_unique, 3);
-}
-
-int is_two_pairs(size_t counts[], size_t num_unique)
-{
-    size_t i, count_double, num_jokers;
-    int joker_strength;
-
-    joker_strength = get_card_strength(JOKER);
-    num_jokers = counts[joker_strength];
-
-    count_double = 0;
-    for (i = 0; i < num_unique; ++i)
-        if (i != (size_t)joker_strength && counts[i] == 2)
-            ++count_double;
-
-    switch (num_jokers) {
-    case 0:
-        return count_double == 2;
-    case 1:
-        return count_double == 1;
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-        return 1;
-    default:
+    size_t counts[1 << RADIX_BITS], i, sum, temp_count;
+    struct Hand *buffer, *from, *to, *temp;
+    uint32_t max_key, digit;
+    unsigned int shift;
+
+    if (num_hands < 2) return 1;
+    buffer = malloc(num_hands * sizeof(*buffer));
+    if (!buffer) {
+        perror("malloc");
+        puts("Failed to allocate radix sort buffer");
         return 0;
     }
-
-    return count_double == 2;
-}
-
-int is_one_pair(size_t counts[], size_t num_unique)
-{
-    return is_n_of_a_kind(counts, num_unique, 2);
+    max_key = 0;
+    for (i = 0; i < num_hands; ++i)
+        if (hands[i].key > max_key)
+            max_key = hands[i].key;
+    from = hands;
+    to = buffer;
+    for (shift = 0; shift < 32 && (max_key >> shift); shift += RADIX_BITS) {
+        for (i = 0; i < 1 << RADIX_BITS; ++i)
+            counts[i] = 0;
+        for (i = 0; i < num_hands; ++i)
+            ++(counts[(from[i].key >> shift) & ((1 << RADIX_BITS) - 1)]);
+        for (i = sum = 0; i < 1 << RADIX_BITS; ++i) {
+            temp_count = counts[i];
+            counts[i] = sum;
+            sum = sum + temp_count;
+        }
+        for (i = 0; i < num_hands; ++i) {
+            digit = (from[i].key >> shift) & ((1 << RADIX_BITS) - 1);
+            to[(counts[digit])++] = from[i];
+        }
+        temp = from;
+        from = to;
+        to = temp;
+    }
+    if (from != hands)
+        for (i = 0; i < num_hands; ++i)
+            hands[i] = from[i];
+    free(buffer);
+    return 1;
 }
 
-int is_high_card(size_t counts[], size_t num_unique)
+struct HandArray *HandArray_create(size_t start_capacity)
 {
-    size_t i, count, num_jokers;
-    int joker_strength;
-
-    joker_strength = get_card_strength(JOKER);
-    num_jokers = counts[joker_strength];
-
-    count = 0;
-    for (i = 0; i < num_unique; ++i)
-        if (i != (size_t)joker_strength && counts[i] > 1)
-            ++count;
-
-    return !count && !num_jokers;
+    struct HandArray *ha;
+    if (start_capacity < MIN_HANDARRAY)
+        start_capacity = MIN_HANDARRAY;
+    ha = malloc(sizeof(*ha));
+    if (!ha) {
+        perror("malloc");
+        puts("Failed to allocate HandArray");
+        return NULL;
+    }
+    ha->hands = malloc(start_capacity * sizeof(*(ha->hands)));
+    if (!ha->hands) {
+        perror("malloc");
+        puts("Failed to allocate HandArray->hands");
+        free(ha);
+        return NULL;
+    }
+    ha->length = 0;
+    ha->capacity = start_capacity;
+    return ha;
 }
 
-int get_type_strength(size_t counts[], size_t num_unique)
+void HandArray_free(struct HandArray *ha)
 {
-    if (is_five_of_a_kind(counts, num_unique))
-        return 6;
-    else if (is_four_of_a_kind(counts, num_unique))
-        return 5;
-    else if (is_full_house(counts, num_unique))
-        return 4;
-    else if (is_three_of_a_kind(counts, num_unique))
-        return 3;
-    else if (is_two_pairs(counts, num_unique))
-        return 2;
-    else if (is_one_pair(counts, num_unique))
-        return 1;
-    else if (is_high_card(counts, num_unique))
-        return 0;
-    return -1;
+    if (!ha) return;
+    free(ha->hands);
+    ha->hands = NULL;
+    free(ha);
 }
 
-int cmp_same_type(char *cards, char *other)
+int HandArray_push(struct HandArray *ha, struct Hand hand)
 {
-    char **p_cards, **p_other;
-    int cards_strength, other_strength;
-
-    p_cards = &cards;
-    p_other = &other;
-
-    while (
-        **p_cards && **p_other
-        && **p_cards == **p_other
-    ) {
-        ++(*p_cards);
-        ++(*p_other);
-    }
-
-    if (**p_cards && **p_other) {
-        cards_strength = get_card_strength(**p_cards);
-        other_strength = get_card_strength(**p_other);
-        if (cards_strength > other_strength)
-            return 1;
-        else if (cards_strength < other_strength)
-            return -1;
-        else
+    struct Hand *temp;
+    if (ha->length >= ha->capacity) {
+        temp = realloc(ha->hands, 2 * ha->capacity * sizeof(*temp));
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow HandArray");
             return 0;
-    } else if (**p_cards && !**p_other) {
-        return 1;
-    } else if (!**p_cards && **p_other) {
-        return -1;
-    } else {
-        return 0;
-    }
-}
-
-void bubble_sort_hands(
-    struct Hand hands[], size_t num_hands, size_t num_unique
-)
-{
-    if (!num_hands) return;
-    size_t swaps, i, counts[num_unique];
-    struct Hand temp;
-    int this_hand_type_strength, last_hand_type_strength;
-
-    do {
-        swaps = 0;
-        count_cards(hands[0].cards, counts, num_unique);
-        last_hand_type_strength = get_type_strength(counts, num_unique);
-        for (i = 1; i < num_hands; ++i) {
-            count_cards(hands[i].cards, counts, num_unique);
-            this_hand_type_strength = get_type_strength(counts, num_unique);
-            if (last_hand_type_strength > this_hand_type_strength) {
-                temp = hands[i - 1];
-                hands[i - 1] = hands[i];
-                hands[i] = temp;
-                ++swaps;
-            } else if (this_hand_type_strength == last_hand_type_strength) {
-                if (cmp_same_type(hands[i - 1].cards, hands[i].cards) > 0) {
-                    temp = hands[i - 1];
-                    hands[i - 1] = hands[i];
-                    hands[i] = temp;
-                    ++swaps;
-                }
-            } else {
-                last_hand_type_strength = this_hand_type_strength;
-            }
         }
-    } while (swaps);
+        ha->hands = temp;
+        ha->capacity *= 2;
+    }
+    ha->hands[(ha->length)++] = hand;
+    return 1;
 }
 
 size_t get_line(char line[], size_t max_line)
@@ -331,20 +275,34 @@ struct Hand parse_line(char line[], size_t line_length)
 int main(void)
 {
     char line[MAX_LINE];
-    size_t line_length, num_hands, i, total;
-    struct Hand hands[MAX_HANDS];
-
-    num_hands = 0;
-    while ((line_length = get_line(line, MAX_LINE)))
-        hands[num_hands++] = parse_line(line, line_length);
+    size_t line_length, i, total;
+    struct HandArray *ha;
+    struct Hand hand;
+
+    ha = HandArray_create(0);
+    if (!ha) return 1;
+    while ((line_length = get_line(line, MAX_LINE))) {
+        hand = parse_line(line, line_length);
+        if (
+            !Hand_encode(&hand, NUM_UNIQUE_CARDS)
+            || !HandArray_push(ha, hand)
+        ) {
+            HandArray_free(ha);
+            return 1;
+        }
+    }
 
-    bubble_sort_hands(hands, num_hands, NUM_UNIQUE_CARDS);
+    if (!radix_sort_hands(ha->hands, ha->length)) {
+        HandArray_free(ha);
+        return 1;
+    }
 
     total = 0;
-    for (i = 0; i < num_hands; ++i)
-        total = total + (i + 1) * hands[i].bid;
+    for (i = 0; i < ha->length; ++i)
+        total = total + (i + 1) * ha->hands[i].bid;
 
     printf("total = %zu\n", total);
+    HandArray_free(ha);
     
     return 0;
 }
@@ -15,6 +15,15 @@ struct Node {
     char right[NODE_CODE_LEN];
 };
 
+/* The hash map compiled down to dense ids so a step is one array load */
+struct NodeTable {
+    size_t ids[MAX_NODES];  /* hash map slot -> dense id */
+    size_t left[MAX_NODES];
+    size_t right[MAX_NODES];
+    char codes[MAX_NODES][NODE_CODE_LEN];
+    size_t length;
+};
+
 size_t get_line(char line[], size_t max_line)
 {
     size_t i;
@@ -84,7 +93,7 @@ size_t hash(const char *word, size_t array_length)
     return hash % array_length;
 }
 
-struct Node find_node(
+size_t find_node_slot(
     struct Node nodes[], size_t nodes_max_len, char code[NODE_CODE_LEN]
 )
 {
@@ -92,25 +101,73 @@ struct Node find_node(
 
     start = hash(code, nodes_max_len);
     if (!strncmp(nodes[start].self, code, NODE_CODE_LEN))
-        return nodes[start];
+        return start;
     
     if (start + 1 >= nodes_max_len) i = 0;
     else i = start + 1;
     while (i != start) {
         if (!strncmp(nodes[i].self, code, NODE_CODE_LEN))
-            return nodes[i];
+            return i;
         if (++i >= nodes_max_len)
             i = 0;
     }
     puts("Could not find node!");
-    return nodes[0];
+    return nodes_max_len;
+}
+
+int compile_nodes(
+    struct NodeTable *table, struct Node nodes[], size_t nodes_max_len
+)
+{
+    size_t i, left, right;
+
+    table->length = 0;
+    for (i = 0; i < nodes_max_len; ++i) {
+        if (!*(nodes[i].self)) continue;
+        table->ids[i] = table->length;
+        memcpy(table->codes[table->length], nodes[i].self, NODE_CODE_LEN);
+        ++(table->length);
+    }
+    for (i = 0; i < nodes_max_len; ++i) {
+        if (!*(nodes[i].self)) continue;
+        left = find_node_slot(nodes, nodes_max_len, nodes[i].left);
+        right = find_node_slot(nodes, nodes_max_len, nodes[i].right);
+        if (left == nodes_max_len || right == nodes_max_len)
+            return 0;
+        table->left[table->ids[i]] = table->ids[left];
+        table->right[table->ids[i]] = table->ids[right];
+    }
+    return 1;
+}
+
+int compile_lrs(
+    size_t *moves[], struct NodeTable *table, char lrs[], size_t lrs_length
+)
+{
+    size_t i;
+    for (i = 0; i < lrs_length; ++i) {
+        switch (lrs[i]) {
+        case 'L':
+            moves[i] = table->left;
+            break;
+        case 'R':
+            moves[i] = table->right;
+            break;
+        default:
+            puts("Got an invalid Left/Right instruction!");
+            return 0;
+        }
+    }
+    return 1;
 }
 
 int main(void)
 {
     struct Node nodes[MAX_NODES], current_node;
+    struct NodeTable table;
     char lrs[MAX_LRS], line[MAX_LINE];
-    size_t lrs_length, line_length, i, start, total, collisions;
+    size_t *moves[MAX_LRS];
+    size_t lrs_length, line_length, i, start, end, current, total, collisions;
 
     for (i = 0; i < MAX_NODES; ++i)
         nodes[i] = (struct Node){ 0 };
@@ -147,21 +204,17 @@ int main(void)
 
     printf("Collisions: %zu\n", collisions);
 
+    if (!compile_nodes(&table, nodes, MAX_NODES)) return 1;
+    if (!compile_lrs(moves, &table, lrs, lrs_length)) return 1;
+    start = find_node_slot(nodes, MAX_NODES, START_NODE_CODE);
+    end = find_node_slot(nodes, MAX_NODES, END_NODE_CODE);
+    if (start == MAX_NODES || end == MAX_NODES) return 1;
+
     i = total = 0;
-    current_node = find_node(nodes, MAX_NODES, START_NODE_CODE);
-    while (strncmp(current_node.self, END_NODE_CODE, NODE_CODE_LEN)) {
-        switch (lrs[i]) {
-        case 'L':
-            current_node = find_node(nodes, MAX_NODES, current_node.left);
-            break;
-        case 'R':
-            current_node = find_node(nodes, MAX_NODES, current_node.right);
-            break;
-        default:
-            puts("Got an invalid Left/Right instruction!");
-            assert(0);
-        }
-        
+    current = table.ids[start];
+    end = table.ids[end];
+    while (current != end) {
+        current = moves[i][current];
         if (++i >= lrs_length)
             i = 0;
         ++total;
@@ -1,6 +1,10 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+
+#include "numtheory.h"
 
 #define NODE_CODE_LEN 4
 #define MAX_NODES 4096 * 8
@@ -8,6 +12,10 @@
 #define MAX_LRS 300
 #define START_NODE_LAST_CHAR 'A'
 #define END_NODE_LAST_CHAR 'Z'
+#define MAX_LEVELS 64
+#define MIN_CONGRUENCES 64
+#define MAX_CONGRUENCES (1U << 20)
+#define NUM_THREADS 8
 
 struct Node {
     char self[NODE_CODE_LEN];
@@ -15,21 +23,30 @@ struct Node {
     char right[NODE_CODE_LEN];
 };
 
-int is_start_node(struct Node node)
+/* The hash map compiled down to dense ids so a step is one array load */
+struct NodeTable {
+    size_t ids[MAX_NODES];  /* hash map slot -> dense id */
+    size_t left[MAX_NODES];
+    size_t right[MAX_NODES];
+    char codes[MAX_NODES][NODE_CODE_LEN];
+    size_t length;
+};
+
+int is_start_node(char code[NODE_CODE_LEN])
 {
-    return node.self[2] == START_NODE_LAST_CHAR;
+    return code[2] == START_NODE_LAST_CHAR;
 }
 
-int is_end_node(struct Node node)
+int is_end_node(char code[NODE_CODE_LEN])
 {
-    return node.self[2] == END_NODE_LAST_CHAR;
+    return code[2] == END_NODE_LAST_CHAR;
 }
 
 int is_all_end_nodes(struct Node nodes[], size_t num_nodes)
 {
     size_t i;
     for (i = 0; i < num_nodes; ++i)
-        if (!is_end_node(nodes[i]))
+        if (!is_end_node(nodes[i].self))
             return 0;
     return 1;
 }
@@ -103,7 +120,7 @@ size_t hash(const char *word, size_t array_length)
     return hash % array_length;
 }
 
-struct Node find_node(
+size_t find_node_slot(
     struct Node nodes[], size_t nodes_max_len, char code[NODE_CODE_LEN]
 )
 {
@@ -111,36 +128,501 @@ struct Node find_node(
 
     start = hash(code, nodes_max_len);
     if (!strncmp(nodes[start].self, code, NODE_CODE_LEN))
-        return nodes[start];
+        return start;
     
     if (start + 1 >= nodes_max_len) i = 0;
     else i = start + 1;
     while (i != start) {
         if (!strncmp(nodes[i].self, code, NODE_CODE_LEN))
-            return nodes[i];
+            return i;
         if (++i >= nodes_max_len)
             i = 0;
     }
     printf("Could not find node: %s\n", code);
-    return nodes[0];
+    return nodes_max_len;
+}
+
+int compile_nodes(
+    struct NodeTable *table, struct Node nodes[], size_t nodes_max_len
+)
+{
+    size_t i, left, right;
+
+    table->length = 0;
+    for (i = 0; i < nodes_max_len; ++i) {
+        if (!*(nodes[i].self)) continue;
+        table->ids[i] = table->length;
+        memcpy(table->codes[table->length], nodes[i].self, NODE_CODE_LEN);
+        ++(table->length);
+    }
+    for (i = 0; i < nodes_max_len; ++i) {
+        if (!*(nodes[i].self)) continue;
+        left = find_node_slot(nodes, nodes_max_len, nodes[i].left);
+        right = find_node_slot(nodes, nodes_max_len, nodes[i].right);
+        if (left == nodes_max_len || right == nodes_max_len)
+            return 0;
+        table->left[table->ids[i]] = table->ids[left];
+        table->right[table->ids[i]] = table->ids[right];
+    }
+    return 1;
 }
 
-int is_all_equal(size_t nums[], size_t nums_count)
+int compile_lrs(
+    size_t *moves[], struct NodeTable *table, char lrs[], size_t lrs_length
+)
 {
-    if (!nums_count) return 1;
     size_t i;
-    for (i = 1; i < nums_count; ++i)
-        if (nums[i] != nums[0])
+    for (i = 0; i < lrs_length; ++i) {
+        switch (lrs[i]) {
+        case 'L':
+            moves[i] = table->left;
+            break;
+        case 'R':
+            moves[i] = table->right;
+            break;
+        default:
+            puts("Got an invalid Left/Right instruction!");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Jump tables over whole passes of the LR instructions
+ * jumps[k][v] is where node v ends up after 2^k full passes and
+ * hits[hit_start[v]..hit_start[v + 1]) are the steps (1..lrs_length)
+ * into a pass starting at v that land on an end node
+ */
+struct PassTable {
+    size_t *jumps[MAX_LEVELS];
+    size_t levels;
+    size_t *hit_start;
+    size_t *hits;
+    size_t num_hits;
+    size_t hits_capacity;
+    size_t lrs_length;
+};
+
+/* Where a ghost's passes start repeating, both counted in whole passes */
+struct Ghost {
+    size_t start;
+    size_t tail;
+    size_t cycle;
+};
+
+/* Measures every stride-th ghost from offset with its own scratch */
+struct GhostWorker {
+    struct Ghost *ghosts;
+    size_t num_ghosts;
+    size_t offset;
+    size_t stride;
+    struct PassTable *passes;
+    size_t *seen;
+    pthread_t thread;
+    int started;
+};
+
+struct Congruence {
+    uint128_t residue;
+    uint128_t modulus;
+};
+
+struct CongruenceArray {
+    struct Congruence *items;
+    size_t length;
+    size_t capacity;
+};
+
+void PassTable_free(struct PassTable *passes)
+{
+    size_t k;
+    if (!passes) return;
+    for (k = 0; k < passes->levels; ++k)
+        free(passes->jumps[k]);
+    free(passes->hit_start);
+    free(passes->hits);
+    free(passes);
+}
+
+int PassTable_push_hit(struct PassTable *passes, size_t step)
+{
+    size_t *temp;
+    if (passes->num_hits >= passes->hits_capacity) {
+        temp = realloc(
+            passes->hits, 2 * passes->hits_capacity * sizeof(*temp)
+        );
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow PassTable hits");
+            return 0;
+        }
+        passes->hits = temp;
+        passes->hits_capacity *= 2;
+    }
+    passes->hits[passes->num_hits++] = step;
+    return 1;
+}
+
+int CongruenceArray_push(
+    struct CongruenceArray *ca, struct Congruence congruence
+)
+{
+    struct Congruence *temp;
+    if (ca->length >= ca->capacity) {
+        temp = realloc(ca->items, 2 * ca->capacity * sizeof(*temp));
+        if (!temp) {
+            perror("realloc");
+            puts("Failed to grow candidate congruences");
             return 0;
+        }
+        ca->items = temp;
+        ca->capacity *= 2;
+    }
+    ca->items[ca->length++] = congruence;
     return 1;
 }
 
+int Congruence_compare(const void *a, const void *b)
+{
+    const struct Congruence *x, *y;
+    x = a;
+    y = b;
+    if (x->residue != y->residue) return x->residue < y->residue ? -1 : 1;
+    if (x->modulus != y->modulus) return x->modulus < y->modulus ? -1 : 1;
+    return 0;
+}
+
+/* Different hit combinations often merge into the same congruence */
+void CongruenceArray_unique(struct CongruenceArray *ca)
+{
+    size_t i, length;
+    if (!ca->length) return;
+    qsort(ca->items, ca->length, sizeof(*ca->items), Congruence_compare);
+    for (i = length = 1; i < ca->length; ++i)
+        if (Congruence_compare(ca->items + length - 1, ca->items + i))
+            ca->items[length++] = ca->items[i];
+    ca->length = length;
+}
+
+struct PassTable *PassTable_create(
+    struct NodeTable *table, size_t *moves[], size_t lrs_length
+)
+{
+    struct PassTable *passes;
+    size_t k, v, i, current;
+
+    passes = malloc(sizeof(*passes));
+    if (!passes) {
+        perror("malloc");
+        puts("Failed to allocate PassTable");
+        return NULL;
+    }
+    passes->lrs_length = lrs_length;
+    passes->num_hits = 0;
+    passes->hits_capacity = table->length + 1;
+    passes->hits = malloc(passes->hits_capacity * sizeof(*(passes->hits)));
+    passes->hit_start = malloc(
+        (table->length + 1) * sizeof(*(passes->hit_start))
+    );
+    /* A ghost never needs to jump more passes than there are nodes */
+    for (passes->levels = 1; passes->levels < MAX_LEVELS; ++passes->levels)
+        if (((size_t)1 << passes->levels) > table->length)
+            break;
+    for (k = 0; k < passes->levels; ++k)
+        passes->jumps[k] = malloc(table->length * sizeof(**(passes->jumps)));
+    for (k = 0; k < passes->levels; ++k)
+        if (!passes->jumps[k]) break;
+    if (!passes->hits || !passes->hit_start || k < passes->levels) {
+        perror("malloc");
+        puts("Failed to allocate PassTable tables");
+        PassTable_free(passes);
+        return NULL;
+    }
+
+    for (v = 0; v < table->length; ++v) {
+        passes->hit_start[v] = passes->num_hits;
+        current = v;
+        for (i = 0; i < lrs_length; ++i) {
+            current = moves[i][current];
+            if (is_end_node(table->codes[current])) {
+                if (!PassTable_push_hit(passes, i + 1)) {
+                    PassTable_free(passes);
+                    return NULL;
+                }
+            }
+        }
+        passes->jumps[0][v] = current;
+    }
+    passes->hit_start[table->length] = passes->num_hits;
+    for (k = 1; k < passes->levels; ++k)
+        for (v = 0; v < table->length; ++v)
+            passes->jumps[k][v] = passes->jumps[k - 1][
+                passes->jumps[k - 1][v]
+            ];
+    return passes;
+}
+
+size_t PassTable_jump(struct PassTable *passes, size_t node, size_t count)
+{
+    size_t k;
+    for (k = 0; count; ++k, count >>= 1)
+        if (count & 1)
+            node = passes->jumps[k][node];
+    return node;
+}
+
+int PassTable_is_hit(struct PassTable *passes, size_t node, size_t step)
+{
+    size_t low, high, mid;
+    low = passes->hit_start[node];
+    high = passes->hit_start[node + 1];
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (passes->hits[mid] == step) return 1;
+        if (passes->hits[mid] < step) low = mid + 1;
+        else high = mid;
+    }
+    return 0;
+}
+
+/* Finds the tail and cycle of the nodes a ghost starts its passes on
+ * seen must be zeroed and is left zeroed
+ */
+void Ghost_measure(
+    struct Ghost *ghost, struct PassTable *passes, size_t seen[]
+)
+{
+    size_t current, count;
+    current = ghost->start;
+    for (count = 1; !seen[current]; ++count) {
+        seen[current] = count;
+        current = passes->jumps[0][current];
+    }
+    ghost->tail = seen[current] - 1;
+    ghost->cycle = count - seen[current];
+    current = ghost->start;
+    while (seen[current]) {
+        seen[current] = 0;
+        current = passes->jumps[0][current];
+    }
+}
+
+void *GhostWorker_run(void *arg)
+{
+    struct GhostWorker *worker;
+    size_t i;
+    worker = arg;
+    for (i = worker->offset; i < worker->num_ghosts; i += worker->stride)
+        Ghost_measure(worker->ghosts + i, worker->passes, worker->seen);
+    return NULL;
+}
+
+int measure_ghosts(
+    struct Ghost ghosts[],
+    size_t num_ghosts,
+    struct PassTable *passes,
+    size_t num_nodes
+)
+{
+    struct GhostWorker workers[NUM_THREADS];
+    size_t i, num_workers;
+    int ret;
+
+    num_workers = num_ghosts < NUM_THREADS ? num_ghosts : NUM_THREADS;
+    ret = 1;
+    for (i = 0; i < num_workers; ++i) {
+        workers[i] = (struct GhostWorker) {
+            .ghosts = ghosts,
+            .num_ghosts = num_ghosts,
+            .offset = i,
+            .stride = num_workers,
+            .passes = passes,
+            .seen = calloc(num_nodes, sizeof(*(workers[i].seen))),
+            .started = 0
+        };
+        if (!workers[i].seen) {
+            perror("calloc");
+            puts("Failed to allocate seen array");
+            ret = 0;
+            num_workers = i;
+            break;
+        }
+        workers[i].started = pthread_create(
+            &(workers[i].thread), NULL, GhostWorker_run, workers + i
+        ) == 0;
+        /* Not fatal, just lose the parallelism for this one */
+        if (!workers[i].started)
+            GhostWorker_run(workers + i);
+    }
+    for (i = 0; i < num_workers; ++i) {
+        if (workers[i].started)
+            pthread_join(workers[i].thread, NULL);
+        free(workers[i].seen);
+    }
+    return ret;
+}
+
+int Ghost_is_on_end(
+    struct Ghost *ghost, struct PassTable *passes, uint128_t steps
+)
+{
+    uint128_t pass;
+    size_t step;
+    if (!steps) return 0;
+    pass = (steps - 1) / passes->lrs_length;
+    step = (steps - 1) % passes->lrs_length + 1;
+    if (pass >= ghost->tail)
+        pass = ghost->tail + (pass - ghost->tail) % ghost->cycle;
+    return PassTable_is_hit(
+        passes, PassTable_jump(passes, ghost->start, pass), step
+    );
+}
+
+/* Smallest step count up to the end of the longest tail, 0 if none */
+uint128_t solve_tails(
+    struct Ghost ghosts[], size_t num_ghosts, struct PassTable *passes
+)
+{
+    size_t i, j, pass, max_tail, current;
+    uint128_t steps;
+
+    max_tail = 0;
+    for (i = 0; i < num_ghosts; ++i)
+        if (ghosts[i].tail > max_tail)
+            max_tail = ghosts[i].tail;
+    current = ghosts[0].start;
+    for (pass = 0; pass < max_tail; ++pass) {
+        for (
+            i = passes->hit_start[current];
+            i < passes->hit_start[current + 1];
+            ++i
+        ) {
+            steps = (uint128_t)pass * passes->lrs_length + passes->hits[i];
+            for (j = 1; j < num_ghosts; ++j)
+                if (!Ghost_is_on_end(ghosts + j, passes, steps))
+                    break;
+            if (j == num_ghosts) return steps;
+        }
+        current = passes->jumps[0][current];
+    }
+    return 0;
+}
+
+/* Every ghost is periodic past the longest tail, so combine each
+ * ghost's end steps within one cycle with CRT and keep the smallest
+ * solution past that point
+ * Returns 0 on failure, otherwise *best is the step count or 0 if the
+ * ghosts never all reach end nodes together
+ */
+int solve_cycles(
+    struct Ghost ghosts[],
+    size_t num_ghosts,
+    struct PassTable *passes,
+    uint128_t *best
+)
+{
+    struct CongruenceArray candidates, merged, temp;
+    struct Congruence congruence;
+    size_t i, j, k, pass, max_tail, current;
+    uint64_t modulus, other;
+    uint128_t lower, steps;
+    enum CrtStatus status;
+    int ret;
+
+    ret = 0;
+    *best = 0;
+    candidates.items = malloc(MIN_CONGRUENCES * sizeof(*candidates.items));
+    merged.items = malloc(MIN_CONGRUENCES * sizeof(*merged.items));
+    candidates.capacity = merged.capacity = MIN_CONGRUENCES;
+    if (!candidates.items || !merged.items) {
+        perror("malloc");
+        puts("Failed to allocate congruences");
+        goto cleanup;
+    }
+    max_tail = 0;
+    for (i = 0; i < num_ghosts; ++i)
+        if (ghosts[i].tail > max_tail)
+            max_tail = ghosts[i].tail;
+    candidates.items[0] = (struct Congruence){ .residue = 0, .modulus = 1 };
+    candidates.length = 1;
+    for (i = 0; i < num_ghosts && candidates.length; ++i) {
+        modulus = (uint64_t)ghosts[i].cycle * passes->lrs_length;
+        current = PassTable_jump(passes, ghosts[i].start, ghosts[i].tail);
+        merged.length = 0;
+        for (pass = 0; pass < ghosts[i].cycle; ++pass) {
+            for (
+                j = passes->hit_start[current];
+                j < passes->hit_start[current + 1];
+                ++j
+            ) {
+                other = (
+                    (uint128_t)(ghosts[i].tail + pass) * passes->lrs_length
+                    + passes->hits[j]
+                ) % modulus;
+                for (k = 0; k < candidates.length; ++k) {
+                    congruence = candidates.items[k];
+                    status = crt_merge128(
+                        &congruence.residue,
+                        &congruence.modulus,
+                        other,
+                        modulus
+                    );
+                    if (status == CRT_NO_SOLUTION) continue;
+                    if (status == CRT_OVERFLOW) {
+                        puts("Combined ghost cycles do not fit in 128 bits!");
+                        goto cleanup;
+                    }
+                    if (merged.length >= MAX_CONGRUENCES)
+                        CongruenceArray_unique(&merged);
+                    if (merged.length >= MAX_CONGRUENCES) {
+                        puts("Too many candidate congruences!");
+                        goto cleanup;
+                    }
+                    if (!CongruenceArray_push(&merged, congruence))
+                        goto cleanup;
+                }
+            }
+            current = passes->jumps[0][current];
+        }
+        CongruenceArray_unique(&merged);
+        temp = candidates;
+        candidates = merged;
+        merged = temp;
+    }
+    lower = (uint128_t)max_tail * passes->lrs_length + 1;
+    for (k = 0; k < candidates.length; ++k) {
+        congruence = candidates.items[k];
+        steps = congruence.residue;
+        if (steps < lower) {
+            steps += ((lower - steps - 1) / congruence.modulus + 1)
+                * congruence.modulus;
+            if (steps < congruence.residue) {
+                puts("Step count does not fit in 128 bits!");
+                goto cleanup;
+            }
+        }
+        if (!*best || steps < *best)
+            *best = steps;
+    }
+    ret = 1;
+
+cleanup:
+    free(candidates.items);
+    free(merged.items);
+    return ret;
+}
+
 int main(void)
 {
     struct Node nodes[MAX_NODES], current_nodes_buf[MAX_NODES], current_node;
+    struct NodeTable table;
     char lrs[MAX_LRS], line[MAX_LINE];
-    size_t lrs_length, line_length, i, j, start, total, collisions;
+    struct PassTable *passes;
+    char steps_str[UINT128_STRING_LEN];
+    size_t *moves[MAX_LRS];
+    size_t lrs_length, line_length, i, start, collisions;
     size_t num_start_nodes;
+    uint128_t steps;
 
     for (i = 0; i < MAX_NODES; ++i)
         nodes[i] = (struct Node){ 0 };
@@ -151,7 +633,7 @@ int main(void)
     collisions = num_start_nodes = 0;
     while ((line_length = get_line(line, MAX_LINE)) != 0) {
         current_node = parse_node(line);
-        if (is_start_node(current_node)) {
+        if (is_start_node(current_node.self)) {
             current_nodes_buf[num_start_nodes] = current_node;
             ++num_start_nodes;
         }
@@ -182,65 +664,46 @@ int main(void)
     printf("Collisions: %zu\n", collisions);
     printf("Num start nodes: %zu\n", num_start_nodes);
 
-    struct Node current_nodes[num_start_nodes];
-    size_t current_nodes_path[num_start_nodes];
-    for (i = 0; i < num_start_nodes; ++i) {
-        current_nodes[i] = current_nodes_buf[i];
-        current_nodes_path[i] = 0;
-    }
+    if (!compile_nodes(&table, nodes, MAX_NODES)) return 1;
+    if (!compile_lrs(moves, &table, lrs, lrs_length)) return 1;
 
-    i = total = 0;
-    for (j = 0; j < num_start_nodes; ++j) {
-        current_node = current_nodes[j];
-        i = 0;
-        while (!is_end_node(current_node)) {
-            switch (lrs[i]) {
-            case 'L':
-                current_node = find_node(nodes, MAX_NODES, current_node.left);
-                break;
-            case 'R':
-                current_node = find_node(nodes, MAX_NODES, current_node.right);
-                break;
-            default:
-                puts("Got an invalid Left/Right instruction!");
-                assert(0);
-            }
-            if (++i >= lrs_length)
-                i = 0;
-            ++current_nodes_path[j];
-        }
+    passes = PassTable_create(&table, moves, lrs_length);
+    if (!passes) return 1;
+
+    struct Ghost ghosts[num_start_nodes];
+    for (i = 0; i < num_start_nodes; ++i) {
+        start = find_node_slot(nodes, MAX_NODES, current_nodes_buf[i].self);
+        ghosts[i].start = table.ids[start];
     }
-    size_t nums[num_start_nodes];
-    size_t max;
-    puts("Path lengths:");
-    for (j = 0; j < num_start_nodes; ++j) {
-        nums[j] = current_nodes_path[j];
-        printf("%zu\n", current_nodes_path[j]);
+    if (!measure_ghosts(ghosts, num_start_nodes, passes, table.length)) {
+        PassTable_free(passes);
+        return 1;
     }
+    puts("Ghost cycles (tail passes, cycle passes):");
+    for (i = 0; i < num_start_nodes; ++i)
+        printf(
+            "%s: %zu, %zu\n",
+            table.codes[ghosts[i].start], ghosts[i].tail, ghosts[i].cycle
+        );
     putchar('\n');
-    i = 0;
-    while (!is_all_equal(nums, num_start_nodes)) {
-        for (j = max = 0; j < num_start_nodes; ++j) {
-            if (nums[j] > nums[max])
-                max = j;
-        }
-        for (j = 0; j < num_start_nodes; ++j) {
-            if (j == max) continue;
-
-            nums[j] = nums[j] + (
-                (nums[max] - nums[j]) / current_nodes_path[j]
-            ) * current_nodes_path[j];
-            if (nums[j] != nums[max])
-                nums[j] = nums[j] + current_nodes_path[j];
+
+    steps = 0;
+    if (num_start_nodes) {
+        steps = solve_tails(ghosts, num_start_nodes, passes);
+        if (!steps && !solve_cycles(ghosts, num_start_nodes, passes, &steps)) {
+            PassTable_free(passes);
+            return 1;
         }
-        if (!(i % 10000000)) {
-            for (j = 0; j < num_start_nodes; ++j)
-                printf("%zu\n", nums[j]);
-            putchar('\n');
+    }
+    for (i = 0; i < num_start_nodes; ++i) {
+        if (!Ghost_is_on_end(ghosts + i, passes, steps)) {
+            puts("Ghosts never all reach end nodes together!");
+            PassTable_free(passes);
+            return 1;
         }
-        ++i;
     }
-    printf("total = %zu\n", nums[0]);
+    PassTable_free(passes);
+    printf("total = %s\n", uint128_to_string(steps, steps_str));
     
     return 0;
 }
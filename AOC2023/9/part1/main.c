@@ -1,114 +1,213 @@
 #include <stdio.h>
-
-#define MAX_LINE 128
-
-int is_digit(char c)
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MIN_SEQUENCE 32U
+
+/*
+ * Values of one history. All arithmetic is done modulo 2^64, which only needs
+ * additions and products, so any result that fits in 64 bits comes out exact
+ * no matter how large the intermediate terms get.
+ */
+struct Sequence {
+    uint64_t *values;
+    size_t length;
+    size_t capacity;
+};
+
+/*
+ * Element-wise sums of every history of one length. The prediction is linear
+ * in the history, so predicting from the sums gives the sum of predictions.
+ */
+struct Batch {
+    uint64_t *sums;
+    size_t count;
+};
+
+/* Batches indexed by history length */
+struct BatchArray {
+    struct Batch *batches;
+    size_t length;
+};
+
+int is_digit(int c)
 {
     return c >= '0' && c <= '9';
 }
 
-int is_number(char c)
+void Sequence_free(struct Sequence *seq)
 {
-    return is_digit(c) || c == '-';
+    free(seq->values);
 }
 
-int seek_next_number(char **p_line)
+int Sequence_push(struct Sequence *seq, uint64_t value)
 {
-    while (**p_line && !is_number(**p_line))
-        ++(*p_line);
-    return **p_line != 0;
+    uint64_t *tmp;
+    size_t capacity;
+
+    if (seq->length == seq->capacity) {
+        capacity = seq->capacity ? seq->capacity * 2 : MIN_SEQUENCE;
+        tmp = realloc(seq->values, capacity * sizeof(*tmp));
+        if (!tmp) {
+            perror("realloc");
+            puts("Failed to grow Sequence");
+            return 0;
+        }
+        seq->values = tmp;
+        seq->capacity = capacity;
+    }
+    seq->values[seq->length++] = value;
+    return 1;
 }
 
-int parse_number(char **p_line)
+/* Reads the next line of input, *more is cleared once it is exhausted */
+int Sequence_read(struct Sequence *seq, int *more)
 {
-    int number, multiplier, is_negative;
-    char *base, *end;
-
-    is_negative = 0;
-    if (**p_line == '-') {
-        is_negative = 1;
-        ++(*p_line);
+    uint64_t value;
+    int c, in_number, is_negative;
+
+    seq->length = 0;
+    value = 0;
+    in_number = is_negative = 0;
+    for (;;) {
+        c = getchar();
+        if (is_digit(c)) {
+            value = value * 10 + (uint64_t)(c - '0');
+            in_number = 1;
+            continue;
+        }
+        if (in_number) {
+            if (!Sequence_push(seq, is_negative ? -value : value))
+                return 0;
+            value = 0;
+            in_number = 0;
+        }
+        if (c == EOF || c == '\n')
+            break;
+        is_negative = c == '-';
     }
+    *more = c != EOF;
+    return 1;
+}
 
-    base = *p_line;
-    while (**p_line && is_digit(**p_line))
-        ++(*p_line);
-
-    end = *p_line;
-    if (!is_digit(**p_line))
-        --(*p_line);
-
-    number = 0;
-    multiplier = 1;
-    while (*p_line != base) {
-        number = number + multiplier * (int)(**p_line - '0');
-        multiplier = multiplier * 10;
-        --(*p_line);
-    }
-    number = number + multiplier * (int)(**p_line - '0');
-    if (is_negative)
-        number = -1 * number;
-    *p_line = end;
-    return number;
+void BatchArray_free(struct BatchArray *ba)
+{
+    size_t i;
+    for (i = 0; i < ba->length; ++i)
+        free(ba->batches[i].sums);
+    free(ba->batches);
 }
 
-int is_all_zeros(int nums[], size_t nums_size)
+int BatchArray_add(struct BatchArray *ba, const struct Sequence *seq)
 {
+    struct Batch *tmp, *batch;
     size_t i;
-    for (i = 0; i < nums_size; ++i)
-        if (nums[i])
+
+    if (!seq->length)
+        return 1;
+    if (seq->length >= ba->length) {
+        tmp = realloc(ba->batches, (seq->length + 1) * sizeof(*tmp));
+        if (!tmp) {
+            perror("realloc");
+            puts("Failed to grow BatchArray");
+            return 0;
+        }
+        memset(
+            tmp + ba->length, 0,
+            (seq->length + 1 - ba->length) * sizeof(*tmp)
+        );
+        ba->batches = tmp;
+        ba->length = seq->length + 1;
+    }
+    batch = ba->batches + seq->length;
+    if (!batch->sums) {
+        batch->sums = calloc(seq->length, sizeof(*(batch->sums)));
+        if (!batch->sums) {
+            perror("calloc");
+            puts("Failed to allocate Batch->sums");
             return 0;
+        }
+    }
+    for (i = 0; i < seq->length; ++i)
+        batch->sums[i] += seq->values[i];
+    ++batch->count;
     return 1;
 }
 
-int get_prediction(int nums[], size_t nums_size)
+/*
+ * The difference table of n values bottoms out in a polynomial of degree
+ * below n, so the next value is sum (-1)^(n-1-i) C(n, i) x_i.
+ */
+uint64_t predict_next(
+    const uint64_t *binomials,
+    const uint64_t *values,
+    size_t n
+)
 {
-    if (!nums_size || is_all_zeros(nums, nums_size)) return 0;
-    int new_nums[nums_size - 1];
+    uint64_t prediction, term;
     size_t i;
 
-    for (i = 1; i < nums_size; ++i)
-        new_nums[i - 1] = nums[i] - nums[i - 1];
-
-    return nums[nums_size - 1] + get_prediction(new_nums, nums_size - 1);
+    prediction = 0;
+    for (i = 0; i < n; ++i) {
+        term = binomials[i] * values[i];
+        prediction += (n - 1 - i) % 2 ? -term : term;
+    }
+    return prediction;
 }
 
-size_t get_line(char line[], size_t max_line)
+/*
+ * Walks Pascal's triangle once up to the longest history, so every length
+ * gets its row of binomials without recomputing the ones before it.
+ */
+int BatchArray_predict(const struct BatchArray *ba, uint64_t *total)
 {
-    size_t i;
-    int c;
-
-    for (
-        i = 0;
-        (c = getchar()) != EOF
-        && c != '\n'
-        && i < max_line - 1;
-        ++i
-    )
-        line[i] = c;
-    line[i] = '\0';
-    if (i == max_line - 1)
-        puts("WARNING: Could not load entire line into buffer");
-    return i;
+    uint64_t *binomials;
+    size_t n, k;
+
+    *total = 0;
+    if (!ba->length)
+        return 1;
+    binomials = calloc(ba->length + 1, sizeof(*binomials));
+    if (!binomials) {
+        perror("calloc");
+        puts("Failed to allocate binomials");
+        return 0;
+    }
+    binomials[0] = 1;
+    for (n = 1; n < ba->length; ++n) {
+        for (k = n; k > 0; --k)
+            binomials[k] += binomials[k - 1];
+        if (ba->batches[n].count)
+            *total += predict_next(binomials, ba->batches[n].sums, n);
+    }
+    free(binomials);
+    return 1;
 }
 
 int main(void)
 {
-    char line[MAX_LINE], *line_pointer;
-    int nums[MAX_LINE], total;
-    size_t nums_size;
-
-    total = 0;
-    while (get_line(line, MAX_LINE) != 0) {
-        line_pointer = line;
-        nums_size = 0;
-        while (seek_next_number(&line_pointer)) {
-            nums[nums_size] = parse_number(&line_pointer);
-            ++nums_size;
-        }
-        total = total + get_prediction(nums, nums_size);
+    struct Sequence seq;
+    struct BatchArray ba;
+    uint64_t total;
+    int more, ret;
+
+    seq = (struct Sequence) { .values = NULL, .length = 0, .capacity = 0 };
+    ba = (struct BatchArray) { .batches = NULL, .length = 0 };
+
+    ret = 1;
+    more = 1;
+    while (more) {
+        if (!Sequence_read(&seq, &more) || !BatchArray_add(&ba, &seq))
+            goto cleanup;
     }
-    printf("Total = %d\n", total);
-
-    return 0;
+    if (!BatchArray_predict(&ba, &total))
+        goto cleanup;
+    printf("Total = %ld\n", (long)total);
+    ret = 0;
+
+cleanup:
+    BatchArray_free(&ba);
+    Sequence_free(&seq);
+    return ret;
 }
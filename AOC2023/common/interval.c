@@ -0,0 +1,27 @@
+#include <stdint.h>
+
+#include "interval.h"
+
+int Interval_is_empty(struct Interval interval)
+{
+    return interval.hi <= interval.lo;
+}
+
+size_t Interval_length(struct Interval interval)
+{
+    return Interval_is_empty(interval) ? 0 : interval.hi - interval.lo;
+}
+
+struct Interval Interval_split(
+    struct Interval *interval, size_t bound, int greater
+)
+{
+    struct Interval below, above;
+    /* value > bound is value >= bound + 1, and nothing is above SIZE_MAX */
+    if (greater && bound < SIZE_MAX) ++bound;
+    below = above = *interval;
+    if (below.hi > bound) below.hi = bound;
+    if (above.lo < bound) above.lo = bound;
+    *interval = greater ? above : below;
+    return greater ? below : above;
+}
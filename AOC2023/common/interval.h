@@ -0,0 +1,25 @@
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include <stddef.h>
+
+/* Half open, [lo, hi), empty once hi <= lo */
+struct Interval {
+    size_t lo;
+    size_t hi;
+};
+
+int Interval_is_empty(struct Interval interval);
+
+/* Number of values in the interval, 0 when it is empty */
+size_t Interval_length(struct Interval interval);
+
+/* Splits interval by value < bound, or by value > bound when greater is
+ * set, leaving the values that pass in interval and returning the rest
+ * Values are taken to be below SIZE_MAX
+ */
+struct Interval Interval_split(
+    struct Interval *interval, size_t bound, int greater
+);
+
+#endif
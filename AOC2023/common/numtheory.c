@@ -0,0 +1,122 @@
+#include "numtheory.h"
+
+#define UINT128_MAX (~(uint128_t)0)
+
+/* Binary (Stein's) gcd */
+uint64_t gcd(uint64_t number, uint64_t other)
+{
+    uint64_t temp;
+    int shift;
+
+    if (!number) return other;
+    if (!other) return number;
+    shift = __builtin_ctzll(number | other);
+    number >>= __builtin_ctzll(number);
+    while (other) {
+        other >>= __builtin_ctzll(other);
+        if (number > other) {
+            temp = number;
+            number = other;
+            other = temp;
+        }
+        other -= number;
+    }
+    return number << shift;
+}
+
+int lcm(uint64_t number, uint64_t other, uint64_t *result)
+{
+    uint128_t product;
+    if (!number || !other) {
+        *result = 0;
+        return 1;
+    }
+    product = (uint128_t)(number / gcd(number, other)) * other;
+    if (product > UINT64_MAX) return 0;
+    *result = product;
+    return 1;
+}
+
+int lcm_accumulate(uint128_t *total, uint64_t number)
+{
+    uint64_t divisor;
+    if (!number) {
+        *total = 0;
+        return 1;
+    }
+    /* gcd(total, number) = gcd(total % number, number) keeps this in 64 bits */
+    divisor = gcd(*total % number, number);
+    number /= divisor;
+    if (*total > UINT128_MAX / number) return 0;
+    *total *= number;
+    return 1;
+}
+
+/* Modular inverse of number mod modulus, number and modulus must be coprime */
+static uint64_t inverse_mod(uint64_t number, uint64_t modulus)
+{
+    __int128 old_r, r, old_s, s, quotient, temp;
+    old_r = number % modulus;
+    r = modulus;
+    old_s = 1;
+    s = 0;
+    while (r) {
+        quotient = old_r / r;
+        temp = old_r - quotient * r;
+        old_r = r;
+        r = temp;
+        temp = old_s - quotient * s;
+        old_s = s;
+        s = temp;
+    }
+    old_s %= (__int128)modulus;
+    if (old_s < 0) old_s += modulus;
+    return old_s;
+}
+
+enum CrtStatus crt_merge128(
+    uint128_t *residue,
+    uint128_t *modulus,
+    uint64_t other_residue,
+    uint64_t other_modulus
+)
+{
+    uint64_t divisor, step, reduced, difference, k, current;
+    uint128_t base, reduced_modulus;
+
+    if (!*modulus || !other_modulus) return CRT_NO_SOLUTION;
+    base = *residue % *modulus;
+    other_residue %= other_modulus;
+    /* Reducing the modulus first keeps the gcd in 64 bits */
+    divisor = gcd(*modulus % other_modulus, other_modulus);
+    current = base % other_modulus;
+    if (current % divisor != other_residue % divisor)
+        return CRT_NO_SOLUTION;
+    reduced_modulus = *modulus / divisor;
+    reduced = other_modulus / divisor;
+    if (reduced_modulus > UINT128_MAX / other_modulus) return CRT_OVERFLOW;
+    /* Solve base + k * modulus = other_residue (mod other_modulus) */
+    step = reduced_modulus % reduced;
+    if (other_residue >= current)
+        difference = other_residue - current;
+    else
+        difference = other_modulus - (current - other_residue);
+    difference = (difference / divisor) % reduced;
+    k = (uint128_t)difference * inverse_mod(step, reduced) % reduced;
+    /* k < reduced, so this stays below the merged modulus */
+    *residue = base + k * *modulus;
+    *modulus = reduced_modulus * other_modulus;
+    return CRT_MERGED;
+}
+
+char *uint128_to_string(uint128_t number, char buffer[UINT128_STRING_LEN])
+{
+    char *cursor;
+    cursor = buffer + UINT128_STRING_LEN - 1;
+    *cursor = '\0';
+    do {
+        *(--cursor) = '0' + number % 10;
+        number /= 10;
+    } while (number);
+    return cursor;
+}
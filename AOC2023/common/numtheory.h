@@ -0,0 +1,44 @@
+#ifndef NUMTHEORY_H
+#define NUMTHEORY_H
+
+#include <stdint.h>
+
+/* Enough for the 39 digits of a 128 bit number plus the terminator */
+#define UINT128_STRING_LEN 40
+
+typedef unsigned __int128 uint128_t;
+
+uint64_t gcd(uint64_t number, uint64_t other);
+
+/* Returns 0 if the result does not fit in 64 bits */
+int lcm(uint64_t number, uint64_t other, uint64_t *result);
+
+/* Folds number into a running 128 bit lcm, total must start at 1
+ * Returns 0 if the result does not fit in 128 bits
+ */
+int lcm_accumulate(uint128_t *total, uint64_t number);
+
+/* Outcome of a congruence merge */
+enum CrtStatus {
+    CRT_NO_SOLUTION = 0,
+    CRT_MERGED = 1,
+    CRT_OVERFLOW = 2
+};
+
+/* Merges x = residue (mod modulus) with x = other_residue (mod other_modulus)
+ * into a single congruence stored back into residue and modulus
+ * The moduli do not have to be coprime
+ * Returns CRT_NO_SOLUTION if the congruences contradict each other and
+ * CRT_OVERFLOW if they agree but the merged modulus does not fit in 128 bits,
+ * in both cases residue and modulus are left untouched
+ */
+enum CrtStatus crt_merge128(
+    uint128_t *residue,
+    uint128_t *modulus,
+    uint64_t other_residue,
+    uint64_t other_modulus
+);
+
+char *uint128_to_string(uint128_t number, char buffer[UINT128_STRING_LEN]);
+
+#endif
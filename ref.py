@@ -0,0 +1,19 @@
+import sys
+g=[l.rstrip('\n') for l in open(sys.argv[1]) if l.strip()]
+steps=int(sys.argv[2]); R=len(g); C=len(g[0])
+for r in range(R):
+  for c in range(C):
+    if g[r][c]=='S': s=(r,c)
+cur={s}; seen={s}; cnt=[1,0]
+# count cells with dist<=steps and parity match
+front=[s]; d=0; tot={0:1}
+par=[1,0]
+while d<steps and front:
+  d+=1; nf=[]
+  for (r,c) in front:
+    for dr,dc in ((1,0),(-1,0),(0,1),(0,-1)):
+      nr,nc=r+dr,c+dc
+      if g[nr%R][nc%C]!='#' and (nr,nc) not in seen:
+        seen.add((nr,nc)); nf.append((nr,nc))
+  par[d%2]+=len(nf); front=nf
+print(par[steps%2])